@@ -1,39 +1,176 @@
 #include "arena.h"
 
+static ArenaBlock*
+MakeArenaBlock(ArenaAllocator* arena, size_t capacity, ArenaBlock* prev)
+{
+  ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + capacity);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->prev = prev;
+  block->capacity = capacity;
+  block->size = 0;
+
+  arena->reserved += capacity;
+  if (arena->reserved > arena->peak_reserved) {
+    arena->peak_reserved = arena->reserved;
+  }
+  arena->blocks++;
+  return block;
+}
+
+static void
+FreeArenaBlock(ArenaAllocator* arena, ArenaBlock* block)
+{
+  arena->reserved -= block->capacity;
+  arena->blocks--;
+  free(block);
+}
+
 ArenaAllocator*
 MakeArenaAllocator(size_t capacity)
 {
-  ArenaAllocator* arena = (ArenaAllocator*)malloc(sizeof(ArenaAllocator));
-  arena->data = (char*)malloc(capacity);
-  arena->capacity = capacity;
-  arena->size = 0;
+  ArenaAllocator* arena = (ArenaAllocator*)calloc(1, sizeof(ArenaAllocator));
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->current = MakeArenaBlock(arena, capacity, NULL);
+  if (arena->current == NULL) {
+    free(arena);
+    return NULL;
+  }
   return arena;
 }
 
 void*
 ArenaAlloc(ArenaAllocator* arena, size_t size)
 {
-  assert(arena->size + size < arena->capacity);
-  void* ptr = arena->data + arena->size;
-  arena->size += size;
-  return ptr;
+  return ArenaAllocAligned(arena, size, ARENA_DEFAULT_ALIGN);
+}
+
+void*
+ArenaAllocAligned(ArenaAllocator* arena, size_t size, size_t align)
+{
+  assert(align != 0 && (align & (align - 1)) == 0);
+
+  ArenaBlock* block = arena->current;
+  uintptr_t base = (uintptr_t)block->data;
+  uintptr_t start = (base + block->size + align - 1) & ~(uintptr_t)(align - 1);
+  size_t end = start - base + size;
+
+  if (end > block->capacity) {
+    size_t capacity = block->capacity * 2;
+    if (capacity < size + align) {
+      capacity = size + align;
+    }
+    block = MakeArenaBlock(arena, capacity, block);
+    if (block == NULL) {
+      return NULL;
+    }
+    arena->current = block;
+
+    base = (uintptr_t)block->data;
+    start = (base + align - 1) & ~(uintptr_t)(align - 1);
+    end = start - base + size;
+  }
+
+  arena->used += end - block->size;
+  if (arena->used > arena->peak) {
+    arena->peak = arena->used;
+  }
+  arena->allocations++;
+  block->size = end;
+  return (void*)start;
+}
+
+ArenaMark
+ArenaGetMark(ArenaAllocator* arena)
+{
+  return (ArenaMark){
+    .block = arena->current,
+    .size = arena->current->size,
+    .used = arena->used,
+  };
+}
+
+void
+ArenaRestore(ArenaAllocator* arena, ArenaMark mark)
+{
+  while (arena->current != mark.block) {
+    ArenaBlock* prev = arena->current->prev;
+    assert(prev != NULL && "mark does not belong to this arena");
+    FreeArenaBlock(arena, arena->current);
+    arena->current = prev;
+  }
+  arena->current->size = mark.size;
+  arena->used = mark.used;
+}
+
+void
+ArenaReset(ArenaAllocator* arena)
+{
+  if (arena->blocks > 1) {
+    size_t capacity = arena->reserved;
+    while (arena->current != NULL) {
+      ArenaBlock* prev = arena->current->prev;
+      FreeArenaBlock(arena, arena->current);
+      arena->current = prev;
+    }
+    arena->current = MakeArenaBlock(arena, capacity, NULL);
+    assert(arena->current != NULL);
+  }
+  arena->current->size = 0;
+  arena->used = 0;
 }
 
 void
 ArenaFree(ArenaAllocator* arena)
 {
-  free(arena->data);
+  while (arena->current != NULL) {
+    ArenaBlock* prev = arena->current->prev;
+    free(arena->current);
+    arena->current = prev;
+  }
   free(arena);
 }
 
-int
-GetTotalMemory(ArenaAllocator* arena)
+ArenaStats
+ArenaGetStats(ArenaAllocator* arena)
 {
-  return arena->capacity;
+  return (ArenaStats){
+    .used = arena->used,
+    .peak = arena->peak,
+    .reserved = arena->reserved,
+    .peak_reserved = arena->peak_reserved,
+    .allocations = arena->allocations,
+    .blocks = arena->blocks,
+  };
 }
 
-int
-GetFreeMemory(ArenaAllocator* arena)
+bool
+export_memory_arena(ArenaAllocator* arena, const char* path)
 {
-  return arena->capacity - arena->size;
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  uint32_t header[2] = { ARENA_SNAPSHOT_MAGIC, ARENA_SNAPSHOT_VERSION };
+  ArenaStats stats = ArenaGetStats(arena);
+  bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+            fwrite(&stats, sizeof(stats), 1, file) == 1;
+
+  // the chain runs newest to oldest, the snapshot oldest to newest
+  for (uint32_t skip = arena->blocks; ok && skip-- > 0;) {
+    ArenaBlock* block = arena->current;
+    for (uint32_t i = 0; i < skip; i++) {
+      block = block->prev;
+    }
+
+    uint64_t sizes[2] = { block->capacity, block->size };
+    ok = fwrite(sizes, sizeof(sizes), 1, file) == 1 &&
+         (block->size == 0 || fwrite(block->data, block->size, 1, file) == 1);
+  }
+
+  return fclose(file) == 0 && ok;
 }
@@ -2,6 +2,9 @@
 #define __ALLOCATOR_H
 
 #include <assert.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,29 +14,93 @@
 #define MB(x) ((size_t)(x) << 20)
 #define GB(x) ((size_t)(x) << 30)
 
-typedef struct ArenaAllocator
+#define ARENA_DEFAULT_ALIGN alignof(max_align_t)
+#define ARENA_SNAPSHOT_MAGIC 0x414E5241 // "ARNA"
+#define ARENA_SNAPSHOT_VERSION 1
+
+/*
+ * Bump allocator over a chain of blocks. When the current block is full a
+ * new one at least twice its size is chained in front of it, so the arena
+ * grows without moving anything already handed out. Memory is given back
+ * all at once with ArenaReset or down to a mark with ArenaRestore.
+ */
+typedef struct ArenaBlock
 {
-  char* data;
+  struct ArenaBlock* prev;
   size_t capacity;
   size_t size;
+  alignas(max_align_t) char data[];
+} ArenaBlock;
+
+typedef struct ArenaAllocator
+{
+  ArenaBlock* current;
+
+  size_t used;          // bytes handed out, padding included
+  size_t peak;          // high-water mark of used
+  size_t reserved;      // bytes held in blocks
+  size_t peak_reserved; // high-water mark of reserved
+  uint64_t allocations; // ArenaAlloc calls since creation
+  uint32_t blocks;
 } ArenaAllocator;
 
+typedef struct ArenaMark
+{
+  ArenaBlock* block;
+  size_t size;
+  size_t used;
+} ArenaMark;
+
+typedef struct ArenaStats
+{
+  size_t used;
+  size_t peak;
+  size_t reserved;
+  size_t peak_reserved;
+  uint64_t allocations;
+  uint32_t blocks;
+} ArenaStats;
+
 ArenaAllocator*
 MakeArenaAllocator(size_t capacity);
 
 void*
 ArenaAlloc(ArenaAllocator* arena, size_t size);
 
-void
-ArenaFree(ArenaAllocator* arena);
+// align must be a power of two
+void*
+ArenaAllocAligned(ArenaAllocator* arena, size_t size, size_t align);
+
+ArenaMark
+ArenaGetMark(ArenaAllocator* arena);
 
-int
-GetTotalMemory(ArenaAllocator* arena);
+// Frees everything allocated after mark was taken.
+void
+ArenaRestore(ArenaAllocator* arena, ArenaMark mark);
 
-int
-GetFreeMemory(ArenaAllocator* arena);
+/*
+ * Frees everything. An arena that had to grow is folded into a single
+ * block as large as all of them, so a per-frame arena stops allocating once
+ * it has seen its largest frame.
+ */
+void
+ArenaReset(ArenaAllocator* arena);
 
 void
+ArenaFree(ArenaAllocator* arena);
+
+ArenaStats
+ArenaGetStats(ArenaAllocator* arena);
+
+/*
+ * Writes the stats followed by every block, oldest first, as
+ *
+ *   u32 magic, u32 version, ArenaStats,
+ *   per block: u64 capacity, u64 size, size bytes of data
+ *
+ * Returns false when the file cannot be written.
+ */
+bool
 export_memory_arena(ArenaAllocator* arena, const char* path);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,158 @@
+#include "asset_pack.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool
+asset_pack_range(const AssetPack* pack, uint32_t offset, uint64_t size)
+{
+  return offset % ASSET_PACK_ALIGN == 0 && offset <= pack->size &&
+         size <= pack->size - offset;
+}
+
+static bool
+asset_pack_image_valid(const AssetPack* pack, const AssetPackImage* image)
+{
+  return image->width > 0 && image->height > 0 &&
+         image->data_size == (uint32_t)GetPixelDataSize(
+                               image->width, image->height, image->format) &&
+         asset_pack_range(pack, image->data_offset, image->data_size);
+}
+
+bool
+asset_pack_open(AssetPack* pack, const char* path)
+{
+  memset(pack, 0, sizeof(*pack));
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(AssetPackHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  pack->data = data;
+  pack->size = st.st_size;
+  pack->header = data;
+
+  const AssetPackHeader* header = pack->header;
+  bool valid = header->magic == ASSET_PACK_MAGIC &&
+               header->version == ASSET_PACK_VERSION &&
+               header->size == pack->size &&
+               asset_pack_range(pack,
+                                header->sprites_offset,
+                                (uint64_t)header->sprite_count *
+                                  sizeof(AssetPackSprite)) &&
+               header->font.glyph_count > 0 &&
+               asset_pack_range(pack,
+                                header->font.glyphs_offset,
+                                (uint64_t)header->font.glyph_count *
+                                  sizeof(AssetPackGlyph)) &&
+               asset_pack_image_valid(pack, &header->font.atlas);
+
+  const AssetPackSprite* sprites =
+    (const AssetPackSprite*)(pack->data + header->sprites_offset);
+  for (uint32_t i = 0; valid && i < header->sprite_count; i++) {
+    valid = memchr(sprites[i].path, '\0', ASSET_PACK_NAME_LEN) != NULL &&
+            asset_pack_image_valid(pack, &sprites[i].image);
+  }
+
+  if (!valid) {
+    fprintf(stderr, "%s: not a valid asset pack, rebuild it\n", path);
+    asset_pack_close(pack);
+    return false;
+  }
+
+  // the pixels are read once, front to back, by the upload; advice values
+  // are not flags, each needs its own call
+  madvise(data, pack->size, MADV_SEQUENTIAL);
+  madvise(data, pack->size, MADV_WILLNEED);
+  return true;
+}
+
+void
+asset_pack_close(AssetPack* pack)
+{
+  if (pack->data != NULL) {
+    munmap((void*)pack->data, pack->size);
+  }
+  memset(pack, 0, sizeof(*pack));
+}
+
+bool
+asset_pack_font(const AssetPack* pack, Font* font, Image* atlas)
+{
+  const AssetPackFont* packed = &pack->header->font;
+  const AssetPackGlyph* glyphs =
+    (const AssetPackGlyph*)(pack->data + packed->glyphs_offset);
+
+  font->baseSize = packed->base_size;
+  font->glyphCount = packed->glyph_count;
+  font->glyphPadding = packed->glyph_padding;
+  font->glyphs = calloc(packed->glyph_count, sizeof(GlyphInfo));
+  font->recs = calloc(packed->glyph_count, sizeof(Rectangle));
+  if (font->glyphs == NULL || font->recs == NULL) {
+    free(font->glyphs);
+    free(font->recs);
+    return false;
+  }
+
+  for (int i = 0; i < packed->glyph_count; i++) {
+    font->glyphs[i] = (GlyphInfo){
+      .value = glyphs[i].value,
+      .offsetX = glyphs[i].offset_x,
+      .offsetY = glyphs[i].offset_y,
+      .advanceX = glyphs[i].advance_x,
+    };
+    font->recs[i] = (Rectangle){
+      glyphs[i].x, glyphs[i].y, glyphs[i].width, glyphs[i].height
+    };
+  }
+
+  *atlas = asset_pack_image(pack, &packed->atlas);
+  return true;
+}
+
+const AssetPackImage*
+asset_pack_find_image(const AssetPack* pack, const char* path)
+{
+  if (strncmp(path, "./", 2) == 0) {
+    path += 2;
+  }
+
+  const AssetPackSprite* sprites =
+    (const AssetPackSprite*)(pack->data + pack->header->sprites_offset);
+  for (uint32_t i = 0; i < pack->header->sprite_count; i++) {
+    if (strcmp(sprites[i].path, path) == 0) {
+      return &sprites[i].image;
+    }
+  }
+  return NULL;
+}
+
+Image
+asset_pack_image(const AssetPack* pack, const AssetPackImage* image)
+{
+  return (Image){
+    .data = (void*)(pack->data + image->data_offset),
+    .width = image->width,
+    .height = image->height,
+    .mipmaps = 1,
+    .format = image->format,
+  };
+}
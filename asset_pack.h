@@ -0,0 +1,107 @@
+#ifndef __ME_ASSET_PACK
+#define __ME_ASSET_PACK
+
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Startup assets baked by the assetpack tool into one file the client maps
+ * read-only: the SDF font atlas with its glyph records, and every sprite
+ * sheet as raw pixels in GPU upload format. Nothing in the pack needs
+ * decoding; images point straight into the mapping.
+ *
+ * Layout (native endianness, the pack is built on the machine that runs it):
+ *
+ *   AssetPackHeader
+ *   AssetPackSprite[sprite_count]   at sprites_offset
+ *   AssetPackGlyph[glyph_count]     at font.glyphs_offset
+ *   pixel data                      at each AssetPackImage.data_offset
+ *
+ * Every offset is from the start of the file and ASSET_PACK_ALIGN aligned.
+ */
+#define ASSET_PACK_MAGIC 0x4B504A42 // "BJPK"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_ALIGN 16
+#define ASSET_PACK_PATH "res/assets.pack"
+#define ASSET_PACK_NAME_LEN 64
+
+// What the client rasterizes when there is no pack; the pack must match.
+#define ASSET_FONT_PATH "res/fonts/times.ttf"
+#define ASSET_FONT_SIZE 128
+#define ASSET_FONT_BASE_SIZE 120
+#define ASSET_FONT_GLYPHS 95
+#define ASSET_SPRITESHEET_PATH "res/spritesheet.png"
+
+typedef struct AssetPackImage
+{
+  uint32_t width;
+  uint32_t height;
+  uint32_t format; // raylib PixelFormat
+  uint32_t data_offset;
+  uint32_t data_size;
+} AssetPackImage;
+
+typedef struct AssetPackGlyph
+{
+  int32_t value;
+  int32_t offset_x;
+  int32_t offset_y;
+  int32_t advance_x;
+  float x, y, width, height; // rectangle in the atlas
+} AssetPackGlyph;
+
+typedef struct AssetPackFont
+{
+  int32_t base_size;
+  int32_t glyph_count;
+  int32_t glyph_padding;
+  uint32_t glyphs_offset;
+  AssetPackImage atlas;
+} AssetPackFont;
+
+typedef struct AssetPackSprite
+{
+  char path[ASSET_PACK_NAME_LEN]; // source path, e.g. res/spritesheet.png
+  AssetPackImage image;
+} AssetPackSprite;
+
+typedef struct AssetPackHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size; // whole file, checked against the mapping
+  uint32_t sprite_count;
+  uint32_t sprites_offset;
+  AssetPackFont font;
+} AssetPackHeader;
+
+typedef struct AssetPack
+{
+  const uint8_t* data;
+  size_t size;
+  const AssetPackHeader* header;
+} AssetPack;
+
+bool
+asset_pack_open(AssetPack* pack, const char* path);
+
+void
+asset_pack_close(AssetPack* pack);
+
+/*
+ * Fills font's glyph records and returns the atlas image for upload. The
+ * glyphs carry no per-glyph images; text drawing only needs the atlas.
+ */
+bool
+asset_pack_font(const AssetPack* pack, Font* font, Image* atlas);
+
+const AssetPackImage*
+asset_pack_find_image(const AssetPack* pack, const char* path);
+
+// Image backed by the mapping; valid until asset_pack_close, never unload it.
+Image
+asset_pack_image(const AssetPack* pack, const AssetPackImage* image);
+
+#endif // __ME_ASSET_PACK
@@ -0,0 +1,241 @@
+/**
+ * Bakes the client's startup assets into one pack, see asset_pack.h.
+ *
+ *   make assetpack pack
+ *   ./assetpack [-o res/assets.pack]
+ *
+ * The SDF font atlas is rasterized and the sprite sheets are decoded to
+ * RGBA here, once, instead of on every client start. Afterwards the pack is
+ * opened the way the client opens it and both paths are timed, so the
+ * report shows what startup saves. GPU upload is the same for both and is
+ * not included.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "asset_pack.c"
+
+static const char* sprite_paths[] = {
+  ASSET_SPRITESHEET_PATH,
+};
+
+#define SPRITE_COUNT (sizeof(sprite_paths) / sizeof(sprite_paths[0]))
+
+static int64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint32_t
+align_up(uint32_t offset)
+{
+  return (offset + ASSET_PACK_ALIGN - 1) & ~(uint32_t)(ASSET_PACK_ALIGN - 1);
+}
+
+// Places an image's pixels at the end of the pack and returns its record.
+static AssetPackImage
+place_image(const Image* image, uint32_t* end)
+{
+  AssetPackImage placed = {
+    .width = image->width,
+    .height = image->height,
+    .format = image->format,
+    .data_offset = align_up(*end),
+    .data_size = GetPixelDataSize(image->width, image->height, image->format),
+  };
+  *end = placed.data_offset + placed.data_size;
+  return placed;
+}
+
+static void
+usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-o pack]\n", name);
+  exit(2);
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* out_path = ASSET_PACK_PATH;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "o:")) != -1) {
+    switch (opt) {
+      case 'o':
+        out_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  SetTraceLogLevel(LOG_WARNING);
+
+  // what the client does at startup without a pack
+  int64_t start = now_ns();
+  int file_size = 0;
+  unsigned char* file_data = LoadFileData(ASSET_FONT_PATH, &file_size);
+  if (file_data == NULL) {
+    fprintf(stderr, "cannot read %s\n", ASSET_FONT_PATH);
+    return 1;
+  }
+  GlyphInfo* glyphs =
+    LoadFontData(file_data, file_size, ASSET_FONT_SIZE, NULL, 0, FONT_SDF);
+  Rectangle* recs = NULL;
+  Image atlas =
+    GenImageFontAtlas(glyphs, &recs, ASSET_FONT_GLYPHS, ASSET_FONT_SIZE, 0, 1);
+  UnloadFileData(file_data);
+  int64_t font_ns = now_ns() - start;
+
+  Image sprites[SPRITE_COUNT];
+  int64_t sprite_ns = 0;
+  for (size_t i = 0; i < SPRITE_COUNT; i++) {
+    start = now_ns();
+    sprites[i] = LoadImage(sprite_paths[i]);
+    sprite_ns += now_ns() - start;
+
+    if (sprites[i].data == NULL) {
+      fprintf(stderr, "cannot read %s\n", sprite_paths[i]);
+      return 1;
+    }
+    if (strlen(sprite_paths[i]) >= ASSET_PACK_NAME_LEN) {
+      fprintf(stderr, "%s: path too long for the pack\n", sprite_paths[i]);
+      return 1;
+    }
+    ImageFormat(&sprites[i], PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  }
+
+  // layout: header, sprite records, glyph records, then pixel data
+  AssetPackHeader header = {
+    .magic = ASSET_PACK_MAGIC,
+    .version = ASSET_PACK_VERSION,
+    .sprite_count = SPRITE_COUNT,
+    .sprites_offset = align_up(sizeof(AssetPackHeader)),
+    .font = {
+      .base_size = ASSET_FONT_BASE_SIZE,
+      .glyph_count = ASSET_FONT_GLYPHS,
+      .glyph_padding = 0,
+    },
+  };
+  header.font.glyphs_offset = align_up(
+    header.sprites_offset + SPRITE_COUNT * sizeof(AssetPackSprite));
+
+  uint32_t end = header.font.glyphs_offset +
+                 ASSET_FONT_GLYPHS * sizeof(AssetPackGlyph);
+  header.font.atlas = place_image(&atlas, &end);
+
+  AssetPackSprite records[SPRITE_COUNT];
+  memset(records, 0, sizeof(records));
+  for (size_t i = 0; i < SPRITE_COUNT; i++) {
+    strcpy(records[i].path, sprite_paths[i]);
+    records[i].image = place_image(&sprites[i], &end);
+  }
+  header.size = align_up(end);
+
+  uint8_t* pack = calloc(1, header.size);
+  if (pack == NULL) {
+    perror("calloc");
+    return 1;
+  }
+
+  memcpy(pack, &header, sizeof(header));
+  memcpy(pack + header.sprites_offset, records, sizeof(records));
+
+  AssetPackGlyph* packed_glyphs =
+    (AssetPackGlyph*)(pack + header.font.glyphs_offset);
+  for (int i = 0; i < ASSET_FONT_GLYPHS; i++) {
+    packed_glyphs[i] = (AssetPackGlyph){
+      .value = glyphs[i].value,
+      .offset_x = glyphs[i].offsetX,
+      .offset_y = glyphs[i].offsetY,
+      .advance_x = glyphs[i].advanceX,
+      .x = recs[i].x,
+      .y = recs[i].y,
+      .width = recs[i].width,
+      .height = recs[i].height,
+    };
+  }
+
+  memcpy(pack + header.font.atlas.data_offset,
+         atlas.data,
+         header.font.atlas.data_size);
+  for (size_t i = 0; i < SPRITE_COUNT; i++) {
+    memcpy(pack + records[i].image.data_offset,
+           sprites[i].data,
+           records[i].image.data_size);
+  }
+
+  FILE* out = fopen(out_path, "wb");
+  if (out == NULL || fwrite(pack, 1, header.size, out) != header.size ||
+      fclose(out) != 0) {
+    perror(out_path);
+    return 1;
+  }
+
+  printf("font      %-24s %dpx SDF, %d glyphs, atlas %dx%d\n",
+         ASSET_FONT_PATH,
+         ASSET_FONT_SIZE,
+         ASSET_FONT_GLYPHS,
+         atlas.width,
+         atlas.height);
+  for (size_t i = 0; i < SPRITE_COUNT; i++) {
+    printf("sprite    %-24s %dx%d RGBA\n",
+           sprite_paths[i],
+           sprites[i].width,
+           sprites[i].height);
+  }
+  printf("wrote     %s, %u bytes\n", out_path, header.size);
+
+  // what the client does at startup with the pack, reading every pixel
+  // once the way the upload would
+  start = now_ns();
+  AssetPack loaded;
+  Font font = { 0 };
+  Image loaded_atlas;
+  if (!asset_pack_open(&loaded, out_path) ||
+      !asset_pack_font(&loaded, &font, &loaded_atlas)) {
+    fprintf(stderr, "%s: cannot read back the pack\n", out_path);
+    return 1;
+  }
+  uint64_t checksum = 0;
+  for (uint32_t i = 0; i < header.font.atlas.data_size; i++) {
+    checksum += ((const uint8_t*)loaded_atlas.data)[i];
+  }
+  for (size_t i = 0; i < SPRITE_COUNT; i++) {
+    const AssetPackImage* image = asset_pack_find_image(&loaded, sprite_paths[i]);
+    const uint8_t* pixels = asset_pack_image(&loaded, image).data;
+    for (uint32_t j = 0; j < image->data_size; j++) {
+      checksum += pixels[j];
+    }
+  }
+  int64_t pack_ns = now_ns() - start;
+
+  printf("startup   rasterize %.2f ms + decode %.2f ms -> pack %.2f ms, "
+         "%.2f ms saved (checksum %llx)\n",
+         font_ns / 1e6,
+         sprite_ns / 1e6,
+         pack_ns / 1e6,
+         (font_ns + sprite_ns - pack_ns) / 1e6,
+         (unsigned long long)checksum);
+
+  free(font.glyphs);
+  free(font.recs);
+  asset_pack_close(&loaded);
+  free(pack);
+  for (size_t i = 0; i < SPRITE_COUNT; i++) {
+    UnloadImage(sprites[i]);
+  }
+  UnloadImage(atlas);
+  UnloadFontData(glyphs, ASSET_FONT_GLYPHS);
+  free(recs);
+  return 0;
+}
@@ -0,0 +1,273 @@
+#include "board.h"
+
+#include <string.h>
+
+#define BOARD_PASTE_(prefix, n, name) prefix##n##_##name
+#define BOARD_PASTE(prefix, n, name) BOARD_PASTE_(prefix, n, name)
+#define BOARD_STRINGIFY_(x) #x
+#define BOARD_STRINGIFY(x) BOARD_STRINGIFY_(x)
+#define BOARD_UNROLL(n) _Pragma(BOARD_STRINGIFY(GCC unroll n))
+
+static inline int
+bit_count(Bitboard b)
+{
+  return __builtin_popcountll(b);
+}
+
+static inline int
+bit_scan(Bitboard b)
+{
+  return __builtin_ctzll(b);
+}
+
+// bit of cell (x, y) within its word, see the layout in board.h
+static inline int
+cell_index(const Board* board, int x, int y)
+{
+  return y * BOARD_STRIDE(board->size) + x;
+}
+
+#define BOARD_N 8
+#include "board_kernel.c"
+#define BOARD_N 10
+#include "board_kernel.c"
+#define BOARD_N 16
+#include "board_kernel.c"
+
+#define BOARD_RNG_MULTIPLIER 6364136223846793005ULL
+#define BOARD_RNG_INCREMENT 1442695040888963407ULL
+
+void
+board_rng_seed(BoardRng* rng, uint64_t seed)
+{
+  *rng = 0;
+  board_rng_next(rng);
+  *rng += seed;
+  board_rng_next(rng);
+}
+
+uint32_t
+board_rng_next(BoardRng* rng)
+{
+  uint64_t old = *rng;
+  *rng = old * BOARD_RNG_MULTIPLIER + BOARD_RNG_INCREMENT;
+  uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+  uint32_t rot = (uint32_t)(old >> 59);
+  return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+Tile
+board_rng_tile(void* user)
+{
+  // multiply-shift instead of a modulo, the bias is below 2^-29
+  uint64_t r = board_rng_next((BoardRng*)user);
+  return (Tile)(T_RED + ((r * BOARD_COLORS) >> 32));
+}
+
+bool
+board_size_supported(int size)
+{
+  switch (size) {
+#define X(n) case n:
+    BOARD_VARIANTS(X)
+#undef X
+    return true;
+  }
+  return false;
+}
+
+bool
+board_init(Board* board, int size)
+{
+  memset(board, 0, sizeof(*board));
+  if (!board_size_supported(size)) {
+    return false;
+  }
+  board->size = size;
+  return true;
+}
+
+bool
+board_from_tiles(Board* board, int size, BoardTiles tiles)
+{
+  if (!board_init(board, size)) {
+    return false;
+  }
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      board_set(board, x, y, tiles[y][x]);
+    }
+  }
+  return true;
+}
+
+void
+board_to_tiles(const Board* board, BoardTiles tiles)
+{
+  for (int y = 0; y < board->size; y++) {
+    for (int x = 0; x < board->size; x++) {
+      tiles[y][x] = board_get(board, x, y);
+    }
+  }
+}
+
+Tile
+board_get(const Board* board, int x, int y)
+{
+  int idx = cell_index(board, x, y);
+  Bitboard bit = 1ULL << (idx & 63);
+  for (int c = 0; c < BOARD_PLANES; c++) {
+    if (board->color[c][idx >> 6] & bit) {
+      return (Tile)(c + 1);
+    }
+  }
+  return EMPTY;
+}
+
+void
+board_set(Board* board, int x, int y, Tile tile)
+{
+  int idx = cell_index(board, x, y);
+  Bitboard bit = 1ULL << (idx & 63);
+  for (int c = 0; c < BOARD_PLANES; c++) {
+    board->color[c][idx >> 6] &= ~bit;
+  }
+  if (tile > EMPTY && tile <= T_SPECIAL) {
+    board->color[tile - 1][idx >> 6] |= bit;
+  }
+}
+
+bool
+board_in_bounds(const Board* board, int x, int y)
+{
+  return x >= 0 && x < board->size && y >= 0 && y < board->size;
+}
+
+bool
+board_is_adjacent(int from_x, int from_y, int to_x, int to_y)
+{
+  return (abs(from_x - to_x) == 1 && from_y == to_y) ||
+         (abs(from_y - to_y) == 1 && from_x == to_x);
+}
+
+void
+board_swap(Board* board, int from_x, int from_y, int to_x, int to_y)
+{
+  Tile a = board_get(board, from_x, from_y);
+  Tile b = board_get(board, to_x, to_y);
+  board_set(board, from_x, from_y, b);
+  board_set(board, to_x, to_y, a);
+}
+
+bool
+board_find_matches(const Board* board, BoardMatches* matches)
+{
+  switch (board->size) {
+#define X(n)                                                                   \
+  case n:                                                                      \
+    return board##n##_find_matches(board, matches);
+    BOARD_VARIANTS(X)
+#undef X
+  }
+  return false;
+}
+
+int32_t
+board_match_score(const Board* board, const BoardMatches* matches)
+{
+  switch (board->size) {
+#define X(n)                                                                   \
+  case n:                                                                      \
+    return board##n##_match_score(matches);
+    BOARD_VARIANTS(X)
+#undef X
+  }
+  return 0;
+}
+
+void
+board_remove_matches(Board* board, const BoardMatches* matches)
+{
+  switch (board->size) {
+#define X(n)                                                                   \
+  case n:                                                                      \
+    board##n##_remove_matches(board, matches);                                 \
+    break;
+    BOARD_VARIANTS(X)
+#undef X
+  }
+}
+
+void
+board_drop(Board* board)
+{
+  switch (board->size) {
+#define X(n)                                                                   \
+  case n:                                                                      \
+    board##n##_drop(board);                                                    \
+    break;
+    BOARD_VARIANTS(X)
+#undef X
+  }
+}
+
+void
+board_fill(Board* board, BoardRefillFn refill, void* user)
+{
+  switch (board->size) {
+#define X(n)                                                                   \
+  case n:                                                                      \
+    board##n##_fill(board, refill, user);                                      \
+    break;
+    BOARD_VARIANTS(X)
+#undef X
+  }
+}
+
+bool
+board_generate(Board* board, int size, BoardRefillFn refill, void* user)
+{
+  if (!board_init(board, size)) {
+    return false;
+  }
+  board_fill(board, refill, user);
+  return true;
+}
+
+int32_t
+board_cascade(Board* board, BoardRefillFn refill, void* user)
+{
+  switch (board->size) {
+#define X(n)                                                                   \
+  case n:                                                                      \
+    return board##n##_cascade(board, refill, user);
+    BOARD_VARIANTS(X)
+#undef X
+  }
+  return 0;
+}
+
+int32_t
+board_apply_move(Board* board,
+                 int from_x,
+                 int from_y,
+                 int to_x,
+                 int to_y,
+                 BoardRefillFn refill,
+                 void* user)
+{
+  if (!board_in_bounds(board, from_x, from_y) ||
+      !board_in_bounds(board, to_x, to_y) ||
+      !board_is_adjacent(from_x, from_y, to_x, to_y)) {
+    return 0;
+  }
+
+  board_swap(board, from_x, from_y, to_x, to_y);
+
+  int32_t score = board_cascade(board, refill, user);
+  if (score == 0) {
+    board_swap(board, from_x, from_y, to_x, to_y);
+  }
+
+  return score;
+}
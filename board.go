@@ -0,0 +1,85 @@
+/**
+ * Board size variants, the Go side of board.h. Keep BOARD_COLORS and the
+ * size list in boardgen.go in sync with it.
+ */
+package main
+
+//go:generate go run boardgen.go
+
+const (
+	BOARD_DEFAULT_SIZE = 8
+	BOARD_MAX_SIZE     = 16
+	BOARD_COLORS       = 5 // colors drawn for refills, Red up to Purple
+)
+
+// Tiles of the largest board; a board of size n uses the top-left n x n
+// cells so every variant shares one layout.
+type Cells [BOARD_MAX_SIZE][BOARD_MAX_SIZE]Tile
+
+// Engine for one board size. The kernels are generated by boardgen.go with
+// the size as a constant, so their loops have fixed bounds.
+type BoardVariant struct {
+	index           int
+	Size            int
+	findMatches     func(board *Cells) []Match
+	dropTiles       func(board *Cells)
+	fillEmptySpaces func(board *Cells, refill func() Tile)
+}
+
+// Board of a game, picked per match; the variant never changes once set.
+// Boards dealt for a game carry a move index, see moves.go; bare boards
+// built by tests and benchmarks run the engine alone.
+type Board struct {
+	Variant *BoardVariant
+	Cells   Cells
+	moves   *MoveIndex
+}
+
+func boardVariantFor(size int) *BoardVariant {
+	for i := range boardVariants {
+		if boardVariants[i].Size == size {
+			return &boardVariants[i]
+		}
+	}
+	return nil
+}
+
+func (b *Board) Size() int {
+	return b.Variant.Size
+}
+
+func (b *Board) inBounds(x, y int) bool {
+	size := b.Variant.Size
+	return x >= 0 && x < size && y >= 0 && y < size
+}
+
+const (
+	BOARD_RNG_MULTIPLIER = 6364136223846793005
+	BOARD_RNG_INCREMENT  = 1442695040888963407
+)
+
+// Refill generator of one game, PCG32 (XSH RR) on a fixed stream; the same
+// generator as board_rng_* in board.c. Its state goes out with every
+// OP_STATE so clients can predict the next move's refills exactly; every
+// move is reseeded, see GameState.nextStream.
+type BoardRng uint64
+
+func (r *BoardRng) seed(seed uint64) {
+	*r = 0
+	r.next()
+	*r += BoardRng(seed)
+	r.next()
+}
+
+func (r *BoardRng) next() uint32 {
+	old := uint64(*r)
+	*r = BoardRng(old*BOARD_RNG_MULTIPLIER + BOARD_RNG_INCREMENT)
+	xorshifted := uint32(((old >> 18) ^ old) >> 27)
+	rot := uint32(old >> 59)
+	return xorshifted>>rot | xorshifted<<(-rot&31)
+}
+
+// Refill tile, multiply-shift instead of a modulo.
+func (r *BoardRng) tile() Tile {
+	return Tile(uint64(r.next())*BOARD_COLORS>>32) + Red
+}
@@ -0,0 +1,161 @@
+#ifndef __ME_BOARD
+#define __ME_BOARD
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Board sizes the engine is specialized for. Every entry gets its own
+ * kernel from board_kernel.c with the size baked in as a constant, so the
+ * match, drop and fill loops are unrolled per size; the board_* entry points
+ * only dispatch on Board.size. Adding a size means adding it here and
+ * including the kernel once more in board.c. Keep in sync with boardgen.go.
+ */
+#define BOARD_VARIANTS(X) X(8) X(10) X(16)
+
+#define BOARD_DEFAULT_SIZE 8
+#define BOARD_MAX_SIZE 16
+#define BOARD_MIN_MATCH 3
+
+typedef enum
+{
+  EMPTY,
+  T_RED,
+  T_BLUE,
+  T_GREEN,
+  T_YELLOW,
+  T_PURPLE,
+  T_SPECIAL
+} Tile;
+
+/*
+ * Colors drawn for refills, T_RED up to T_RED + BOARD_COLORS - 1. Fewer
+ * colors mean longer cascades; the server must be built with the same count
+ * (BOARD_COLORS in board.go).
+ */
+#ifndef BOARD_COLORS
+#define BOARD_COLORS 5
+#endif
+
+#if BOARD_COLORS < 3 || BOARD_COLORS > 5
+#error "BOARD_COLORS must be between 3 and 5"
+#endif
+
+#define BOARD_PLANES T_SPECIAL
+
+/*
+ * Rows packed into 64-bit words. Row y starts at bit y * BOARD_STRIDE(size),
+ * so an 8x8 board is a single word as before and larger boards use 16-bit
+ * row lanes spread over up to BOARD_WORDS words. "Down" is a shift towards
+ * higher bits by one stride; bits outside the size x size area stay clear.
+ */
+typedef uint64_t Bitboard;
+
+#define BOARD_STRIDE(size) ((size) <= 8 ? 8 : 16)
+#define BOARD_WORDS_FOR(size) (((size) * BOARD_STRIDE(size) + 63) / 64)
+#define BOARD_WORDS BOARD_WORDS_FOR(BOARD_MAX_SIZE)
+
+typedef struct Board
+{
+  int size;
+  Bitboard color[BOARD_PLANES][BOARD_WORDS]; // color[tile - 1], EMPTY is implicit
+} Board;
+
+typedef struct BoardMatches
+{
+  Bitboard horizontal[BOARD_WORDS]; // cells that are part of a horizontal run
+  Bitboard vertical[BOARD_WORDS];   // cells that are part of a vertical run
+  Bitboard specials[BOARD_WORDS];   // centre cells of runs longer than BOARD_MIN_MATCH
+} BoardMatches;
+
+/*
+ * Tile grid as sent over the wire. Only the top-left size x size cells of a
+ * BOARD_MAX_SIZE grid are used.
+ */
+typedef Tile BoardTiles[BOARD_MAX_SIZE][BOARD_MAX_SIZE];
+
+/*
+ * Source of refill tiles. Called once per empty cell in row-major order,
+ * which is the order server.go's fillEmptySpaces draws in, so feeding both
+ * engines the same stream yields the same boards.
+ */
+typedef Tile (*BoardRefillFn)(void* user);
+
+/*
+ * Refill generator of a game: PCG32 (XSH RR) on one fixed stream, so its
+ * whole state is one word. The server seeds one per game and sends the
+ * current state with every OP_STATE, which lets a client run a move's
+ * cascade with exactly the refills the server will draw. board.go has the
+ * same generator.
+ */
+typedef uint64_t BoardRng;
+
+void
+board_rng_seed(BoardRng* rng, uint64_t seed);
+
+uint32_t
+board_rng_next(BoardRng* rng);
+
+// BoardRefillFn drawing from the BoardRng that user points to.
+Tile
+board_rng_tile(void* user);
+
+bool
+board_size_supported(int size);
+
+bool
+board_init(Board* board, int size);
+
+bool
+board_from_tiles(Board* board, int size, BoardTiles tiles);
+
+void
+board_to_tiles(const Board* board, BoardTiles tiles);
+
+Tile
+board_get(const Board* board, int x, int y);
+
+void
+board_set(Board* board, int x, int y, Tile tile);
+
+bool
+board_in_bounds(const Board* board, int x, int y);
+
+bool
+board_is_adjacent(int from_x, int from_y, int to_x, int to_y);
+
+void
+board_swap(Board* board, int from_x, int from_y, int to_x, int to_y);
+
+bool
+board_find_matches(const Board* board, BoardMatches* matches);
+
+int32_t
+board_match_score(const Board* board, const BoardMatches* matches);
+
+void
+board_remove_matches(Board* board, const BoardMatches* matches);
+
+void
+board_drop(Board* board);
+
+void
+board_fill(Board* board, BoardRefillFn refill, void* user);
+
+bool
+board_generate(Board* board, int size, BoardRefillFn refill, void* user);
+
+int32_t
+board_cascade(Board* board, BoardRefillFn refill, void* user);
+
+int32_t
+board_apply_move(Board* board,
+                 int from_x,
+                 int from_y,
+                 int to_x,
+                 int to_y,
+                 BoardRefillFn refill,
+                 void* user);
+
+#endif // __ME_BOARD
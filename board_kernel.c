@@ -0,0 +1,312 @@
+/*
+ * Board engine for one board size. board.c includes this file once per entry
+ * of BOARD_VARIANTS with BOARD_N defined, which yields board<N>_find_matches,
+ * board<N>_drop and friends. Stride, word count and masks are constants, so
+ * every loop below unrolls; at 8x8 the kernel is a single-word bitboard.
+ */
+#ifndef BOARD_N
+#error "board_kernel.c is included by board.c with BOARD_N defined"
+#endif
+
+#if BOARD_N < BOARD_MIN_MATCH || BOARD_N > BOARD_MAX_SIZE
+#error "BOARD_N out of range"
+#endif
+
+#define KERNEL(name) BOARD_PASTE(board, BOARD_N, name)
+#define STRIDE BOARD_STRIDE(BOARD_N)
+#define WORDS BOARD_WORDS_FOR(BOARD_N)
+#define ROWS_PER_WORD (64 / STRIDE)
+#define UNROLL BOARD_UNROLL(WORDS)
+
+// column 0 of every row lane in a word
+#define LANE_FIRST (STRIDE == 8 ? 0x0101010101010101ULL : 0x0001000100010001ULL)
+#define LANE_MASK ((1ULL << STRIDE) - 1)
+#define ROW_CELLS ((1ULL << BOARD_N) - 1)
+#define RUN_STARTS ((1ULL << (BOARD_N - 2)) - 1) // columns a run of three fits after
+
+// cells of the board that live in word i
+static inline Bitboard
+KERNEL(valid)(int i)
+{
+  int rows = BOARD_N - i * ROWS_PER_WORD;
+  Bitboard lanes = rows >= ROWS_PER_WORD ? ~0ULL : (1ULL << (rows * STRIDE)) - 1;
+  return lanes & (LANE_FIRST * ROW_CELLS);
+}
+
+// out = in moved towards higher cells (down the board) by bits
+static inline void
+KERNEL(shift_down)(Bitboard out[WORDS], const Bitboard in[WORDS], int bits)
+{
+  int q = bits / 64;
+  int r = bits % 64;
+
+  UNROLL
+  for (int i = WORDS - 1; i >= 0; i--) {
+    Bitboard hi = i - q >= 0 ? in[i - q] : 0;
+    Bitboard lo = i - q - 1 >= 0 ? in[i - q - 1] : 0;
+    out[i] = r ? (hi << r) | (lo >> (64 - r)) : hi;
+  }
+}
+
+// out = in moved towards lower cells (up the board) by bits
+static inline void
+KERNEL(shift_up)(Bitboard out[WORDS], const Bitboard in[WORDS], int bits)
+{
+  int q = bits / 64;
+  int r = bits % 64;
+
+  UNROLL
+  for (int i = 0; i < WORDS; i++) {
+    Bitboard lo = i + q < WORDS ? in[i + q] : 0;
+    Bitboard hi = i + q + 1 < WORDS ? in[i + q + 1] : 0;
+    out[i] = r ? (lo >> r) | (hi << (64 - r)) : lo;
+  }
+}
+
+static inline void
+KERNEL(occupied)(const Board* board, Bitboard occupied[WORDS])
+{
+  UNROLL
+  for (int i = 0; i < WORDS; i++) {
+    occupied[i] = 0;
+    for (int c = 0; c < BOARD_PLANES; c++) {
+      occupied[i] |= board->color[c][i];
+    }
+  }
+}
+
+static void
+KERNEL(mark_specials_horizontal)(Bitboard run, Bitboard* specials)
+{
+  Bitboard starts = run & ~((run << 1) & ~LANE_FIRST);
+  while (starts) {
+    int s = bit_scan(starts);
+    starts &= starts - 1;
+
+    int x = s % STRIDE;
+    Bitboard row = (run >> (s - x)) & LANE_MASK;
+    int length = bit_scan(~(row >> x));
+    if (length > BOARD_MIN_MATCH) {
+      *specials |= 1ULL << (s + length / 2);
+    }
+  }
+}
+
+static void
+KERNEL(mark_specials_vertical)(const Bitboard run[WORDS], Bitboard specials[WORDS])
+{
+  Bitboard starts[WORDS];
+  KERNEL(shift_down)(starts, run, STRIDE);
+
+  for (int i = 0; i < WORDS; i++) {
+    Bitboard pending = run[i] & ~starts[i];
+    while (pending) {
+      int s = i * 64 + bit_scan(pending);
+      pending &= pending - 1;
+
+      int length = 1;
+      for (int t = s + STRIDE; t < WORDS * 64 && (run[t / 64] >> (t % 64)) & 1;
+           t += STRIDE) {
+        length++;
+      }
+      if (length > BOARD_MIN_MATCH) {
+        int centre = s + (length / 2) * STRIDE;
+        specials[centre / 64] |= 1ULL << (centre % 64);
+      }
+    }
+  }
+}
+
+static bool
+KERNEL(find_matches)(const Board* board, BoardMatches* matches)
+{
+  Bitboard found = 0;
+
+  UNROLL
+  for (int i = 0; i < WORDS; i++) {
+    matches->horizontal[i] = 0;
+    matches->vertical[i] = 0;
+    matches->specials[i] = 0;
+  }
+
+  for (int c = 0; c < BOARD_PLANES; c++) {
+    const Bitboard* m = board->color[c];
+    Bitboard below[WORDS], below2[WORDS], v[WORDS];
+    Bitboard starts = 0;
+
+    UNROLL
+    for (int i = 0; i < WORDS; i++) {
+      Bitboard h = m[i] & (m[i] >> 1) & (m[i] >> 2) & (LANE_FIRST * RUN_STARTS);
+      if (h) {
+        Bitboard run = h | (h << 1) | (h << 2);
+        matches->horizontal[i] |= run;
+        found |= run;
+        // two neighbouring starts mean a run of four or more
+        if (h & (h >> 1)) {
+          KERNEL(mark_specials_horizontal)(run, &matches->specials[i]);
+        }
+      }
+    }
+
+    KERNEL(shift_up)(below, m, STRIDE);
+    KERNEL(shift_up)(below2, m, 2 * STRIDE);
+
+    UNROLL
+    for (int i = 0; i < WORDS; i++) {
+      v[i] = m[i] & below[i] & below2[i];
+      starts |= v[i];
+    }
+
+    if (starts) {
+      Bitboard run[WORDS], next[WORDS];
+      Bitboard longer = 0;
+
+      KERNEL(shift_down)(below, v, STRIDE);
+      KERNEL(shift_down)(below2, v, 2 * STRIDE);
+      KERNEL(shift_up)(next, v, STRIDE);
+
+      UNROLL
+      for (int i = 0; i < WORDS; i++) {
+        run[i] = v[i] | below[i] | below2[i];
+        matches->vertical[i] |= run[i];
+        found |= run[i];
+        longer |= v[i] & next[i];
+      }
+
+      if (longer) {
+        KERNEL(mark_specials_vertical)(run, matches->specials);
+      }
+    }
+  }
+
+  return found != 0;
+}
+
+static int32_t
+KERNEL(match_score)(const BoardMatches* matches)
+{
+  int cells = 0;
+
+  UNROLL
+  for (int i = 0; i < WORDS; i++) {
+    cells += bit_count(matches->horizontal[i]) + bit_count(matches->vertical[i]);
+  }
+
+  // cells shared by a horizontal and a vertical run score twice, exactly as
+  // they appear in two separate Match entries on the server
+  return cells * 10;
+}
+
+static void
+KERNEL(remove_matches)(Board* board, const BoardMatches* matches)
+{
+  UNROLL
+  for (int i = 0; i < WORDS; i++) {
+    Bitboard cleared = matches->horizontal[i] | matches->vertical[i];
+    for (int c = 0; c < BOARD_PLANES; c++) {
+      board->color[c][i] &= ~cleared;
+    }
+    board->color[T_SPECIAL - 1][i] |= matches->specials[i];
+  }
+}
+
+static void
+KERNEL(drop)(Board* board)
+{
+  Bitboard occupied[WORDS], below[WORDS], movers[WORDS], moved[WORDS];
+  KERNEL(occupied)(board, occupied);
+
+  for (;;) {
+    // every tile with an empty cell anywhere below it falls one row per step
+    UNROLL
+    for (int i = 0; i < WORDS; i++) {
+      moved[i] = ~occupied[i] & KERNEL(valid)(i);
+    }
+    KERNEL(shift_up)(below, moved, STRIDE);
+    for (int rows = 1; rows < BOARD_N; rows <<= 1) {
+      KERNEL(shift_up)(moved, below, rows * STRIDE);
+      UNROLL
+      for (int i = 0; i < WORDS; i++) {
+        below[i] |= moved[i];
+      }
+    }
+
+    Bitboard moving = 0;
+    UNROLL
+    for (int i = 0; i < WORDS; i++) {
+      movers[i] = occupied[i] & below[i];
+      moving |= movers[i];
+    }
+    if (!moving) {
+      break;
+    }
+
+    for (int c = 0; c < BOARD_PLANES; c++) {
+      Bitboard* m = board->color[c];
+      UNROLL
+      for (int i = 0; i < WORDS; i++) {
+        moved[i] = m[i] & movers[i];
+        m[i] &= ~movers[i];
+      }
+      KERNEL(shift_down)(moved, moved, STRIDE);
+      UNROLL
+      for (int i = 0; i < WORDS; i++) {
+        m[i] |= moved[i];
+      }
+    }
+
+    KERNEL(shift_down)(moved, movers, STRIDE);
+    UNROLL
+    for (int i = 0; i < WORDS; i++) {
+      occupied[i] = (occupied[i] & ~movers[i]) | moved[i];
+    }
+  }
+}
+
+static void
+KERNEL(fill)(Board* board, BoardRefillFn refill, void* user)
+{
+  Bitboard occupied[WORDS];
+  KERNEL(occupied)(board, occupied);
+
+  // ascending bits are row-major order
+  for (int i = 0; i < WORDS; i++) {
+    Bitboard empty = ~occupied[i] & KERNEL(valid)(i);
+    while (empty) {
+      int s = bit_scan(empty);
+      empty &= empty - 1;
+
+      Tile tile = refill(user);
+      if (tile > EMPTY && tile <= T_SPECIAL) {
+        board->color[tile - 1][i] |= 1ULL << s;
+      }
+    }
+  }
+}
+
+static int32_t
+KERNEL(cascade)(Board* board, BoardRefillFn refill, void* user)
+{
+  int32_t score = 0;
+  BoardMatches matches;
+
+  while (KERNEL(find_matches)(board, &matches)) {
+    score += KERNEL(match_score)(&matches);
+    KERNEL(remove_matches)(board, &matches);
+    KERNEL(drop)(board);
+    KERNEL(fill)(board, refill, user);
+  }
+
+  return score;
+}
+
+#undef RUN_STARTS
+#undef ROW_CELLS
+#undef LANE_MASK
+#undef LANE_FIRST
+#undef UNROLL
+#undef ROWS_PER_WORD
+#undef WORDS
+#undef STRIDE
+#undef KERNEL
+#undef BOARD_N
@@ -0,0 +1,128 @@
+//go:build ignore
+
+/**
+ * Generates boards.go, one match/drop/fill kernel per board size with the
+ * size baked in as a constant:
+ *
+ *	go run boardgen.go
+ *
+ * The size list mirrors BOARD_VARIANTS in board.h.
+ */
+package main
+
+import (
+	"bytes"
+	"go/format"
+	"log"
+	"os"
+	"text/template"
+)
+
+var sizes = []int{8, 10, 16}
+
+var kernels = template.Must(template.New("boards").Parse(`// Code generated by boardgen.go; DO NOT EDIT.
+
+package main
+
+const BOARD_VARIANTS = {{len .}}
+
+var boardVariants = [BOARD_VARIANTS]BoardVariant{
+{{- range $i, $n := .}}
+	{index: {{$i}}, Size: {{$n}}, findMatches: findMatches{{$n}}, dropTiles: dropTiles{{$n}}, fillEmptySpaces: fillEmptySpaces{{$n}}},
+{{- end}}
+}
+{{range .}}
+func findMatches{{.}}(board *Cells) []Match {
+	const size = {{.}}
+	var matches []Match
+
+	// horizontal matches
+	for y := 0; y < size; y++ {
+		x := 0
+		for x < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				x++
+				continue
+			}
+			match := []Point{ {x, y} }
+			k := x + 1
+			for k < size && board[y][k] == currentTile {
+				match = append(match, Point{k, y})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "horizontal"})
+			}
+			x = k
+		}
+	}
+
+	// vertical matches
+	for x := 0; x < size; x++ {
+		y := 0
+		for y < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				y++
+				continue
+			}
+			match := []Point{ {x, y} }
+			k := y + 1
+			for k < size && board[k][x] == currentTile {
+				match = append(match, Point{x, k})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "vertical"})
+			}
+			y = k
+		}
+	}
+
+	return matches
+}
+
+func dropTiles{{.}}(board *Cells) {
+	const size = {{.}}
+	for x := 0; x < size; x++ {
+		emptyRow := size - 1
+		for y := size - 1; y >= 0; y-- {
+			if board[y][x] != Empty {
+				board[emptyRow][x] = board[y][x]
+				if emptyRow != y {
+					board[y][x] = Empty
+				}
+				emptyRow--
+			}
+		}
+	}
+}
+
+// Refill tiles are drawn in row-major order, the same order board.c's
+// board_fill consumes its refill callback.
+func fillEmptySpaces{{.}}(board *Cells, refill func() Tile) {
+	const size = {{.}}
+	for y := 0; y < size; y++ {
+		for x := 0; x < size; x++ {
+			if board[y][x] == Empty {
+				board[y][x] = refill()
+			}
+		}
+	}
+}
+{{end}}`))
+
+func main() {
+	var buf bytes.Buffer
+	if err := kernels.Execute(&buf, sizes); err != nil {
+		log.Fatal(err)
+	}
+	src, err := format.Source(buf.Bytes())
+	if err != nil {
+		log.Fatal(err)
+	}
+	if err := os.WriteFile("boards.go", src, 0o644); err != nil {
+		log.Fatal(err)
+	}
+}
@@ -0,0 +1,251 @@
+// Code generated by boardgen.go; DO NOT EDIT.
+
+package main
+
+const BOARD_VARIANTS = 3
+
+var boardVariants = [BOARD_VARIANTS]BoardVariant{
+	{index: 0, Size: 8, findMatches: findMatches8, dropTiles: dropTiles8, fillEmptySpaces: fillEmptySpaces8},
+	{index: 1, Size: 10, findMatches: findMatches10, dropTiles: dropTiles10, fillEmptySpaces: fillEmptySpaces10},
+	{index: 2, Size: 16, findMatches: findMatches16, dropTiles: dropTiles16, fillEmptySpaces: fillEmptySpaces16},
+}
+
+func findMatches8(board *Cells) []Match {
+	const size = 8
+	var matches []Match
+
+	// horizontal matches
+	for y := 0; y < size; y++ {
+		x := 0
+		for x < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				x++
+				continue
+			}
+			match := []Point{{x, y}}
+			k := x + 1
+			for k < size && board[y][k] == currentTile {
+				match = append(match, Point{k, y})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "horizontal"})
+			}
+			x = k
+		}
+	}
+
+	// vertical matches
+	for x := 0; x < size; x++ {
+		y := 0
+		for y < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				y++
+				continue
+			}
+			match := []Point{{x, y}}
+			k := y + 1
+			for k < size && board[k][x] == currentTile {
+				match = append(match, Point{x, k})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "vertical"})
+			}
+			y = k
+		}
+	}
+
+	return matches
+}
+
+func dropTiles8(board *Cells) {
+	const size = 8
+	for x := 0; x < size; x++ {
+		emptyRow := size - 1
+		for y := size - 1; y >= 0; y-- {
+			if board[y][x] != Empty {
+				board[emptyRow][x] = board[y][x]
+				if emptyRow != y {
+					board[y][x] = Empty
+				}
+				emptyRow--
+			}
+		}
+	}
+}
+
+// Refill tiles are drawn in row-major order, the same order board.c's
+// board_fill consumes its refill callback.
+func fillEmptySpaces8(board *Cells, refill func() Tile) {
+	const size = 8
+	for y := 0; y < size; y++ {
+		for x := 0; x < size; x++ {
+			if board[y][x] == Empty {
+				board[y][x] = refill()
+			}
+		}
+	}
+}
+
+func findMatches10(board *Cells) []Match {
+	const size = 10
+	var matches []Match
+
+	// horizontal matches
+	for y := 0; y < size; y++ {
+		x := 0
+		for x < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				x++
+				continue
+			}
+			match := []Point{{x, y}}
+			k := x + 1
+			for k < size && board[y][k] == currentTile {
+				match = append(match, Point{k, y})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "horizontal"})
+			}
+			x = k
+		}
+	}
+
+	// vertical matches
+	for x := 0; x < size; x++ {
+		y := 0
+		for y < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				y++
+				continue
+			}
+			match := []Point{{x, y}}
+			k := y + 1
+			for k < size && board[k][x] == currentTile {
+				match = append(match, Point{x, k})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "vertical"})
+			}
+			y = k
+		}
+	}
+
+	return matches
+}
+
+func dropTiles10(board *Cells) {
+	const size = 10
+	for x := 0; x < size; x++ {
+		emptyRow := size - 1
+		for y := size - 1; y >= 0; y-- {
+			if board[y][x] != Empty {
+				board[emptyRow][x] = board[y][x]
+				if emptyRow != y {
+					board[y][x] = Empty
+				}
+				emptyRow--
+			}
+		}
+	}
+}
+
+// Refill tiles are drawn in row-major order, the same order board.c's
+// board_fill consumes its refill callback.
+func fillEmptySpaces10(board *Cells, refill func() Tile) {
+	const size = 10
+	for y := 0; y < size; y++ {
+		for x := 0; x < size; x++ {
+			if board[y][x] == Empty {
+				board[y][x] = refill()
+			}
+		}
+	}
+}
+
+func findMatches16(board *Cells) []Match {
+	const size = 16
+	var matches []Match
+
+	// horizontal matches
+	for y := 0; y < size; y++ {
+		x := 0
+		for x < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				x++
+				continue
+			}
+			match := []Point{{x, y}}
+			k := x + 1
+			for k < size && board[y][k] == currentTile {
+				match = append(match, Point{k, y})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "horizontal"})
+			}
+			x = k
+		}
+	}
+
+	// vertical matches
+	for x := 0; x < size; x++ {
+		y := 0
+		for y < size {
+			currentTile := board[y][x]
+			if currentTile == Empty {
+				y++
+				continue
+			}
+			match := []Point{{x, y}}
+			k := y + 1
+			for k < size && board[k][x] == currentTile {
+				match = append(match, Point{x, k})
+				k++
+			}
+			if len(match) >= MIN_MATCH {
+				matches = append(matches, Match{Points: match, Direction: "vertical"})
+			}
+			y = k
+		}
+	}
+
+	return matches
+}
+
+func dropTiles16(board *Cells) {
+	const size = 16
+	for x := 0; x < size; x++ {
+		emptyRow := size - 1
+		for y := size - 1; y >= 0; y-- {
+			if board[y][x] != Empty {
+				board[emptyRow][x] = board[y][x]
+				if emptyRow != y {
+					board[y][x] = Empty
+				}
+				emptyRow--
+			}
+		}
+	}
+}
+
+// Refill tiles are drawn in row-major order, the same order board.c's
+// board_fill consumes its refill callback.
+func fillEmptySpaces16(board *Cells, refill func() Tile) {
+	const size = 16
+	for y := 0; y < size; y++ {
+		for x := 0; x < size; x++ {
+			if board[y][x] == Empty {
+				board[y][x] = refill()
+			}
+		}
+	}
+}
@@ -2,77 +2,173 @@
  * $Author David Kviloria
  * $Last Modified 2019
  */
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <math.h>
 #include <raylib.h>
+#include <rlgl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "arena.c"
+#include "profiler.c"
+#include "board.c"
+#include "protocol.c"
+#include "net_thread.c"
 #include "texture_storage.c"
+#include "text_cache.c"
+#include "asset_pack.c"
+#include "tween.c"
+#include "replay.c"
+#include "work_pool.c"
+#include "solver.c"
 
 #define PORT 8080
 #define BUFLEN 512
 #define MAX_GAMES 100
-#define BOARD_SIZE 8
-#define TILE_SIZE 60
-#define ANIMATION_DURATION 0.05f
-
-typedef enum
-{
-  EMPTY,
-  T_RED,
-  T_BLUE,
-  T_GREEN,
-  T_YELLOW,
-  T_PURPLE,
-  T_SPECIAL
-} Tile;
-
-struct GameState
-{
-  int32_t game_id;
-  Tile board[BOARD_SIZE][BOARD_SIZE];
-  int32_t current_turn;
-  int32_t player1_score;
-  int32_t player2_score;
-  bool game_started;
-  bool game_over;
-};
+#define BOARD_PIXELS 480
+#define BOARD_ORIGIN 100
+#define BACKGROUND_COLOR ((Color){ 30, 39, 46, 255 })
+
+#define SPRITE_SIZE 84
+#define SPRITE_FRAMES 20
+#define SPRITE_FRAME_DURATION 0.15f
+#define TILE_MARGIN 5.0f
+#define DROP_DURATION 0.08f // seconds to fall one row, longer falls take sqrt(rows)
+#define DROP_STAGGER 0.02f  // delay between rows when a whole board drops in
+#define POP_DURATION 0.12f
+#define SWAP_ANIMATION_DURATION 0.05f
+#define TEXTURE_UPLOAD_BUDGET 0.004 // seconds of texture upload per frame
+#define HINT_BUDGET_NS 2000000      // move search for a hint, within a frame
+#define PROFILER_DUMP_SECONDS 5
+#define PROFILER_ZONES 24
+#define PROFILER_BUCKETS 16 // frame time histogram, 2 ms per bucket
+#define MOVE_RTO_MIN 0.03   // seconds before an unacked move is resent
+#define MOVE_RTO_MAX 1.0
+
+// seconds without a first state before the server's pick is asked again
+#define SPECTATE_PICK_RETRY 2.0
 
 typedef enum
 {
   MAIN_MENU,
-  IN_GAME
+  IN_GAME,
+  REPLAY
 } GameScreen;
 
+typedef struct SpriteUV
+{
+  float u0, v0, u1, v1;
+} SpriteUV;
+
+typedef struct SpriteQuad
+{
+  Rectangle dest;
+  SpriteUV uv;
+} SpriteQuad;
+
 Font font = { 0 };
+ArenaAllocator* frame_arena; // reset at the start of every frame
+TextCache text_cache;
 int sockfd;
+NetThread net;
 struct sockaddr_in server_addr, client_addr;
 int player_id = -1;
 bool connected = false;
 
+uint16_t send_seq = 0;
+uint16_t state_seq = 0;
+bool have_state_seq = false;
+
 struct GameState game_state;
 struct GameState previous_board;
+struct GameState predicted_state;
+
+// Waiting for the server to match an opponent; the ticket is renewed
+// every PROTO_QUEUE_RENEW_MS until OP_PLAYER_ID arrives.
+bool queued = false;
+double connect_sent = 0.0;
+
+// Watching a game instead of playing; the subscription is renewed every
+// PROTO_SPECTATE_RENEW_MS. Until the first state names watched_game the
+// server's pick is only asked for again after SPECTATE_PICK_RETRY, and
+// states of any other game it picked meanwhile are turned down with a leave.
+bool spectating = false;
+double spectate_sent = 0.0;
+int32_t watched_game = 0;
+
+// The last move until a state acks it. It is resent under its sequence
+// after move_rto(), doubling with every retry; the server handles it once.
+uint8_t unacked_move[PROTO_MAX_PACKET];
+int unacked_move_len = 0; // 0 when no move is in flight
+uint16_t unacked_move_seq;
+double move_first_sent = 0.0;
+double move_last_sent = 0.0;
+int move_retries = 0;
+double move_srtt = 0.1; // smoothed move -> ack round trip, seconds
+double state_ack_sent = 0.0;
+
+bool prediction_pending = false;
+bool prediction_shown = false;
+int32_t prediction_count = 0;
+int32_t prediction_misses = 0;
 
 GameScreen current_screen = MAIN_MENU;
 
 Vector2 selected_tile = { -1, -1 };
 Vector2 hover_tile = { -1, -1 };
 
-float tile_offsets[BOARD_SIZE][BOARD_SIZE] = { 0 };
-bool animating = false;
-float animation_timer = 0;
+int requested_board_size = BOARD_DEFAULT_SIZE;
+float tile_size = (float)BOARD_PIXELS / BOARD_DEFAULT_SIZE;
+
+// Animated values, each driven by at most one tween. pop_scale shrinks the
+// gem in pop_tiles that a match removed from its cell.
+TweenSystem tweens;
+float tile_offsets[BOARD_MAX_SIZE][BOARD_MAX_SIZE] = { 0 };
+float pop_scale[BOARD_MAX_SIZE][BOARD_MAX_SIZE] = { 0 };
+Tile pop_tiles[BOARD_MAX_SIZE][BOARD_MAX_SIZE];
+bool animating = false; // any tween running
 
-const float SWAP_ANIMATION_DURATION = 0.05f;
 bool animating_swap = false;
-float swap_animation_timer = 0.0f;
+float swap_progress = 0.0f;
 Vector2 swap_from = { -1, -1 };
 Vector2 swap_to = { -1, -1 };
 
+// Texture coordinates of every tile color and animation frame.
+SpriteUV sprite_uvs[T_SPECIAL + 1][SPRITE_FRAMES];
+
+// Tile backgrounds, drawn once per board size.
+RenderTexture2D board_background;
+// Backgrounds plus every gem that is not moving or animating; cached_tiles
+// records which gem each cell holds, EMPTY for none.
+RenderTexture2D board_cache;
+BoardTiles cached_tiles;
+int board_layers_size = 0;
+
+bool show_profiler = false;
+
+// Every game is recorded to replay_<game>_<time>.bjr unless -n is given.
+bool record_matches = true;
+ReplayWriter recorder;
+int32_t recording_game_id = 0;
+double record_start = 0.0;
+
+// Best moves of the board on screen, searched when H is pressed.
+WorkPool solver_pool;
+SolverResult hint;
+bool show_hint = false;
+
+// Playback with -r; replay_clock runs at replay_speed times real time.
+Replay replay;
+double replay_clock = 0.0;
+double replay_speed = 1.0;
+bool replay_paused = false;
+
 void
 die(const char* s)
 {
@@ -92,68 +188,158 @@ set_socket_nonblocking(int sock)
   }
 }
 
+void
+send_packet(const uint8_t* buffer, int len)
+{
+  if (!net_thread_send(&net, buffer, len)) {
+    TraceLog(LOG_WARNING, "Outgoing queue full, dropped packet");
+  }
+}
+
 void
 send_connect_request()
 {
-  char buffer[BUFLEN];
-  strcpy(buffer, "CONNECT");
-  if (sendto(sockfd,
-             buffer,
-             strlen(buffer),
-             0,
-             (struct sockaddr*)&server_addr,
-             sizeof(server_addr)) == -1) {
-    die("sendto() failed");
+  uint8_t buffer[PROTO_MAX_PACKET];
+  send_packet(buffer,
+              proto_encode_connect(
+                buffer, send_seq++, requested_board_size, -1));
+  connect_sent = GetTime();
+}
+
+void
+start_queueing()
+{
+  queued = true;
+  have_state_seq = false;
+  current_screen = IN_GAME;
+  send_connect_request();
+}
+
+void
+send_spectate_request(int32_t game_id, bool leave)
+{
+  uint8_t buffer[PROTO_MAX_PACKET];
+  send_packet(buffer,
+              proto_encode_spectate(
+                buffer, send_seq++, game_id, state_seq, leave));
+  spectate_sent = GetTime();
+}
+
+void
+start_spectating()
+{
+  spectating = true;
+  watched_game = 0;
+  have_state_seq = false;
+  current_screen = IN_GAME;
+  send_spectate_request(0, false);
+}
+
+void
+renew_spectating()
+{
+  double since = GetTime() - spectate_sent;
+  if (watched_game != 0 && since >= PROTO_SPECTATE_RENEW_MS / 1000.0) {
+    send_spectate_request(watched_game, false);
+  } else if (watched_game == 0 && since >= SPECTATE_PICK_RETRY) {
+    send_spectate_request(0, false);
   }
 }
 
 void
 send_disconnect_request()
 {
-  char buffer[BUFLEN];
-  strcpy(buffer, "DISCONNECT");
-  if (sendto(sockfd,
-             buffer,
-             strlen(buffer),
-             0,
-             (struct sockaddr*)&server_addr,
-             sizeof(server_addr)) == -1) {
-    die("sendto() failed");
+  uint8_t buffer[PROTO_MAX_PACKET];
+  if (spectating) {
+    send_spectate_request(watched_game, true);
+  } else {
+    send_packet(buffer,
+                proto_encode_request(buffer, OP_DISCONNECT, send_seq++));
   }
+  spectating = false;
+  queued = false;
   connected = false;
   player_id = -1;
   current_screen = MAIN_MENU;
 }
 
+uint32_t
+record_time()
+{
+  return (uint32_t)((GetTime() - record_start) * 1000.0);
+}
+
 void
-send_move(int fromX, int fromY, int toX, int toY)
+stop_recording()
+{
+  if (recorder.file != NULL) {
+    replay_writer_close(&recorder);
+  }
+}
+
+void
+record_state(struct GameState* state)
 {
-  char buffer[BUFLEN];
-  snprintf(buffer, BUFLEN, "%d %d %d %d %d", player_id, fromX, fromY, toX, toY);
-  if (sendto(sockfd,
-             buffer,
-             strlen(buffer),
-             0,
-             (struct sockaddr*)&server_addr,
-             sizeof(server_addr)) == -1) {
-    die("sendto() failed");
+  if (!record_matches) {
+    return;
+  }
+  if (recorder.file != NULL && state->game_id != recording_game_id) {
+    stop_recording();
+  }
+
+  if (recorder.file == NULL) {
+    if (!state->game_started || state->game_over) {
+      return;
+    }
+    const char* path =
+      TextFormat("replay_%d_%ld.bjr", state->game_id, (long)time(NULL));
+    if (!replay_writer_open(
+          &recorder, path, state->board_size, player_id, state->game_id)) {
+      TraceLog(LOG_WARNING, "Cannot record game %d to %s", state->game_id, path);
+      return;
+    }
+    recording_game_id = state->game_id;
+    record_start = GetTime();
+    TraceLog(LOG_INFO, "Recording game %d to %s", state->game_id, path);
+  }
+
+  replay_write_state(&recorder, state, record_time());
+  if (state->game_over) {
+    stop_recording();
   }
 }
 
 void
-blit_text(Font* font,
+send_move(int fromX, int fromY, int toX, int toY)
+{
+  unacked_move_seq = send_seq++;
+  unacked_move_len = proto_encode_move(
+    unacked_move, unacked_move_seq, player_id, fromX, fromY, toX, toY);
+  send_packet(unacked_move, unacked_move_len);
+  move_first_sent = move_last_sent = GetTime();
+  move_retries = 0;
+  replay_write_move(
+    &recorder, player_id, fromX, fromY, toX, toY, record_time());
+}
+
+// Draws str with a drop shadow from the text cache. Strings whose value
+// changes pass a fixed key so each new value replaces the last one.
+void
+blit_text(const char* key,
           const char* str,
           Vector2 position,
           float size,
           Color color)
 {
-  DrawTextEx(*font,
-             str,
-             (Vector2){ position.x + 1.5f, position.y + 1.5f },
-             size,
-             1.0f,
-             BLACK);
-  DrawTextEx(*font, str, position, size, 1.0f, color);
+  ProfZone zone = prof_begin("text");
+  text_cache_draw(&text_cache, key, str, position, size, color);
+  prof_end(zone);
+}
+
+Vector2
+measure_text(const char* str, float size)
+{
+  return text_cache_measure(&text_cache, NULL, str, size);
 }
 
 bool
@@ -167,7 +353,7 @@ draw_button(const char* text, Rectangle bounds, Color color)
     color = Fade(color, 0.8f);
   }
 
-  Vector2 size = MeasureTextEx(font, text, 30, 1.0);
+  Vector2 size = measure_text(text, 30);
 
   if (bounds.width < size.x) {
     bounds.width = size.x + 20;
@@ -177,7 +363,7 @@ draw_button(const char* text, Rectangle bounds, Color color)
   DrawRectangleRoundedLines(bounds, 0.2, 10, 2, BLACK);
 
   blit_text(
-    &font,
+    NULL,
     text,
     (Vector2){ bounds.x + 10, bounds.y + bounds.height / 2 - size.y / 2 },
     30,
@@ -192,116 +378,456 @@ draw_button(const char* text, Rectangle bounds, Color color)
   return false;
 }
 
+// Cycles through the board sizes the engine is built for.
+void
+next_board_size()
+{
+  static const int sizes[] = {
+#define X(n) n,
+    BOARD_VARIANTS(X)
+#undef X
+  };
+  const int count = sizeof(sizes) / sizeof(sizes[0]);
+
+  for (int i = 0; i < count; i++) {
+    if (sizes[i] == requested_board_size) {
+      requested_board_size = sizes[(i + 1) % count];
+      return;
+    }
+  }
+  requested_board_size = sizes[0];
+}
+
+// Retransmission timeout, twice the smoothed round trip.
+double
+move_rto()
+{
+  double rto = 2.0 * move_srtt;
+  rto = rto < MOVE_RTO_MIN ? MOVE_RTO_MIN : rto;
+  return rto > MOVE_RTO_MAX ? MOVE_RTO_MAX : rto;
+}
+
+// Retires the move in flight once a state acks it. Round trips are only
+// sampled from moves that went out once, a retried one is ambiguous.
+void
+note_move_ack(struct GameState* state)
+{
+  if (unacked_move_len > 0 && state->game_over) {
+    // the game is released with this state, nothing will ack the move
+    unacked_move_len = 0;
+    return;
+  }
+  if (unacked_move_len == 0 || player_id < 0 || player_id > 1 ||
+      proto_seq_newer(unacked_move_seq, state->move_ack[player_id])) {
+    return;
+  }
+  if (move_retries == 0) {
+    move_srtt += 0.125 * ((GetTime() - move_first_sent) - move_srtt);
+  }
+  unacked_move_len = 0;
+}
+
+// Resends the move in flight when its timeout passes and acks the newest
+// state every PROTO_ACK_INTERVAL_MS, so the server notices a lost one.
+void
+update_reliability()
+{
+  if (!connected || spectating) {
+    return;
+  }
+
+  double now = GetTime();
+  if (unacked_move_len > 0) {
+    double timeout = move_rto() * (double)(1 << move_retries);
+    if (now - move_last_sent >= (timeout > MOVE_RTO_MAX ? MOVE_RTO_MAX : timeout)) {
+      send_packet(unacked_move, unacked_move_len);
+      move_last_sent = now;
+      move_retries += move_retries < 8;
+    }
+  }
+
+  if (now - state_ack_sent >= PROTO_ACK_INTERVAL_MS / 1000.0) {
+    uint8_t buffer[PROTO_MAX_PACKET];
+    send_packet(buffer,
+                proto_encode_ack(
+                  buffer, send_seq++, have_state_seq ? state_seq : 0));
+    state_ack_sent = now;
+  }
+}
+
 void
 reset_game_state()
 {
   connected = false;
+  spectating = false;
+  queued = false;
+  unacked_move_len = 0;
   player_id = -1;
+  prediction_pending = false;
+  prediction_shown = false;
   memset(&game_state, 0, sizeof(struct GameState));
   current_screen = MAIN_MENU;
+
+  stop_recording();
+  show_hint = false;
+  tween_clear(&tweens);
+  memset(tile_offsets, 0, sizeof(tile_offsets));
+  memset(pop_scale, 0, sizeof(pop_scale));
+  animating = false;
+  animating_swap = false;
 }
 
 void
-update_animation(float delta_time)
+predict_move(int fromX, int fromY, int toX, int toY)
 {
-  bool any_animating = false;
-
-  for (int y = 0; y < BOARD_SIZE; y++) {
-    for (int x = 0; x < BOARD_SIZE; x++) {
-      if (tile_offsets[y][x] != 0) {
-        any_animating = true;
+  Board board;
+
+  memcpy(&predicted_state, &game_state, sizeof(struct GameState));
+  board_from_tiles(&board, predicted_state.board_size, predicted_state.board);
+
+  // the state carries the server's refill generator, so the whole cascade
+  // comes out as the server will compute it
+  int32_t score = board_apply_move(
+    &board, fromX, fromY, toX, toY, board_rng_tile, &predicted_state.rng);
+  if (score > 0) {
+    board_to_tiles(&board, predicted_state.board);
+
+    if (player_id == 0) {
+      predicted_state.player1_score += score;
+    } else {
+      predicted_state.player2_score += score;
+    }
+    predicted_state.current_turn = (predicted_state.current_turn + 1) % 2;
+  }
 
-        float progress = animation_timer / ANIMATION_DURATION;
-        if (progress > 1.0f)
-          progress = 1.0f;
+  prediction_pending = true;
+  prediction_shown = false;
+  prediction_count++;
+}
 
-        float eased_progress = 1.0f - (1.0f - progress) * (1.0f - progress);
-        tile_offsets[y][x] = -TILE_SIZE + eased_progress * TILE_SIZE;
+// Lets the gem at (x, y) fall in from rows cells above after delay.
+void
+animate_drop(int x, int y, int rows, float delay)
+{
+  tween_start(&tweens,
+              &tile_offsets[y][x],
+              -tile_size * rows,
+              0.0f,
+              DROP_DURATION * sqrtf((float)rows),
+              delay,
+              EASE_IN_QUAD);
+}
 
-        animation_timer += delta_time;
+// Shrinks away the gem a match removed from (x, y).
+void
+animate_pop(int x, int y, Tile tile)
+{
+  pop_tiles[y][x] = tile;
+  tween_start(
+    &tweens, &pop_scale[y][x], 1.0f, 0.0f, POP_DURATION, 0.0f, EASE_IN_QUAD);
+}
 
-        if (animation_timer >= ANIMATION_DURATION) {
-          tile_offsets[y][x] = 0;
-          animation_timer = 0;
-        }
+// Pops the gems of before that game_state replaced and drops in the new ones.
+void
+animate_board_change(struct GameState* before)
+{
+  for (int y = 0; y < game_state.board_size; y++) {
+    for (int x = 0; x < game_state.board_size; x++) {
+      Tile old = before->board[y][x];
+      Tile tile = game_state.board[y][x];
+      // the swap animation already moved these two gems on screen
+      if (x == (int)swap_from.x && y == (int)swap_from.y) {
+        old = before->board[(int)swap_to.y][(int)swap_to.x];
+      } else if (x == (int)swap_to.x && y == (int)swap_to.y) {
+        old = before->board[(int)swap_from.y][(int)swap_from.x];
+      }
+      if (tile == old) {
+        continue;
+      }
+      if (old != EMPTY) {
+        animate_pop(x, y, old);
+      }
+      if (tile != EMPTY) {
+        animate_drop(x, y, 1, 0.0f);
       }
     }
   }
+}
 
-  animating = any_animating;
+void
+show_prediction()
+{
+  show_hint = false;
+  memcpy(&previous_board, &game_state, sizeof(struct GameState));
+  memcpy(&game_state, &predicted_state, sizeof(struct GameState));
+  prediction_shown = true;
+  animate_board_change(&previous_board);
+}
 
-  if (animating_swap) {
-    swap_animation_timer += delta_time;
-    if (swap_animation_timer >= SWAP_ANIMATION_DURATION) {
-      animating_swap = false;
-      swap_animation_timer = 0.0f;
+void
+update_animation(float delta_time)
+{
+  tween_update(&tweens, delta_time);
+  animating = tweens.count > 0;
 
-      // Swap tiles in the game_state
-      // Tile temp = game_state.board[(int)swap_from.y][(int)swap_from.x];
-      // game_state.board[(int)swap_from.y][(int)swap_from.x] =
-      //   game_state.board[(int)swap_to.y][(int)swap_to.x];
-      // game_state.board[(int)swap_to.y][(int)swap_to.x] = temp;
+  if (animating_swap && !tween_running(&tweens, &swap_progress)) {
+    animating_swap = false;
 
-      swap_from = (Vector2){ -1, -1 };
-      swap_to = (Vector2){ -1, -1 };
+    if (prediction_pending && !prediction_shown) {
+      show_prediction();
     }
+
+    swap_from = (Vector2){ -1, -1 };
+    swap_to = (Vector2){ -1, -1 };
   }
 }
 
 void
-start_animation()
+start_swap_animation(Vector2 from, Vector2 to)
+{
+  animating_swap = true;
+  swap_from = from;
+  swap_to = to;
+  tween_start(&tweens,
+              &swap_progress,
+              0.0f,
+              1.0f,
+              SWAP_ANIMATION_DURATION,
+              0.0f,
+              EASE_OUT_QUAD);
+}
+
+/*
+ * Drops the whole of state in from above the board, bottom row first,
+ * popping the gems of game_state it replaces.
+ */
+void
+start_animation(struct GameState* state)
+{
+  int size = state->board_size;
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      Tile old = game_state.board_size == size ? game_state.board[y][x] : EMPTY;
+      if (old != EMPTY && old != state->board[y][x]) {
+        animate_pop(x, y, old);
+      }
+      if (state->board[y][x] != EMPTY) {
+        animate_drop(x, y, y + 1, (size - 1 - y) * DROP_STAGGER);
+      }
+    }
+  }
+}
+
+bool
+prediction_matches(struct GameState* predicted, struct GameState* actual)
 {
-  animating = true;
-  animation_timer = 0;
-  for (int i = 0; i < BOARD_SIZE; i++) {
-    for (int j = 0; j < BOARD_SIZE; j++) {
-      if (game_state.board[i][j] != EMPTY) {
-        tile_offsets[i][j] = -TILE_SIZE * (i + 1);
+  if (predicted->board_size != actual->board_size ||
+      predicted->current_turn != actual->current_turn ||
+      predicted->player1_score != actual->player1_score ||
+      predicted->player2_score != actual->player2_score ||
+      predicted->rng != actual->rng) {
+    return false;
+  }
+
+  for (int y = 0; y < actual->board_size; y++) {
+    for (int x = 0; x < actual->board_size; x++) {
+      if (predicted->board[y][x] != actual->board[y][x]) {
+        return false;
       }
     }
   }
+
+  return true;
 }
 
 void
-receive_server_message()
+apply_server_state(struct GameState* new_state)
+{
+  bool confirmed = false;
+
+  show_hint = false;
+  tile_size = (float)BOARD_PIXELS / new_state->board_size;
+
+  if (prediction_pending) {
+    prediction_pending = false;
+    confirmed = prediction_matches(&predicted_state, new_state);
+
+    if (!confirmed) {
+      prediction_misses++;
+      printf("Prediction miss (%d of %d)\n", prediction_misses, prediction_count);
+    }
+
+    // a miss rolls back to the last authoritative board and replays the
+    // server's result from there like any other update
+    if (prediction_shown && !confirmed) {
+      memcpy(&game_state, &previous_board, sizeof(struct GameState));
+    }
+  }
+
+  // a confirmed prediction already shows this board, refills included
+  if (!confirmed || !prediction_shown) {
+    start_animation(new_state);
+  }
+
+  prediction_shown = false;
+
+  if (!game_state.game_over && new_state->game_over) {
+    printf("Game Over! Player 1 Score: %d, Player 2 Score: %d\n",
+           new_state->player1_score,
+           new_state->player2_score);
+  }
+
+  memcpy(&previous_board, &game_state, sizeof(struct GameState));
+  memcpy(&game_state, new_state, sizeof(struct GameState));
+}
+
+void
+request_hint()
+{
+  Board board;
+  board_from_tiles(&board, game_state.board_size, game_state.board);
+
+  ProfZone zone = prof_begin("solver");
+  solver_solve(&solver_pool,
+               &board,
+               game_state.rng,
+               work_pool_now_ns() + HINT_BUDGET_NS,
+               &hint);
+  prof_end(zone);
+  show_hint = true;
+}
+
+void
+handle_state_event(NetEvent* event)
 {
-  char buffer[BUFLEN];
-  socklen_t slen = sizeof(server_addr);
-  int recv_len =
-    recvfrom(sockfd, buffer, BUFLEN, 0, (struct sockaddr*)&server_addr, &slen);
-  if (recv_len == -1) {
+  if (spectating && watched_game == 0) {
+    watched_game = event->state.game_id;
+  } else if (spectating && event->state.game_id != watched_game) {
+    // a retried pick subscribed to a second game
+    send_spectate_request(event->state.game_id, true);
     return;
   }
 
-  if (strncmp(buffer, "PLAYER_ID:", 10) == 0) {
-    sscanf(buffer, "PLAYER_ID:%d", &player_id);
-    printf("Assigned Player ID: %d\n", player_id);
+  // a resent state repeats its sequence but may ack a newer move
+  note_move_ack(&event->state);
+
+  // datagrams can arrive out of order, never go back to an older board
+  if (have_state_seq && !proto_seq_newer(event->seq, state_seq)) {
+    return;
+  }
+
+  state_seq = event->seq;
+  have_state_seq = true;
+  if (spectating) {
     connected = true;
-    current_screen = IN_GAME;
-  } else {
-    struct GameState new_state;
-    memcpy(&new_state, buffer, sizeof(struct GameState));
-
-    for (int y = 0; y < BOARD_SIZE; y++) {
-      for (int x = 0; x < BOARD_SIZE; x++) {
-        if (previous_board.board[y][x] == EMPTY &&
-            new_state.board[y][x] != EMPTY) {
-          tile_offsets[y][x] = -TILE_SIZE;
-        }
-      }
-    }
+  }
+  apply_server_state(&event->state);
+  record_state(&event->state);
+}
+
+void
+show_replay_state()
+{
+  int size = replay.state.board_size;
+  tile_size = (float)BOARD_PIXELS / size;
+  memcpy(&previous_board, &game_state, sizeof(struct GameState));
+  memcpy(&game_state, &replay.state, sizeof(struct GameState));
+  animate_board_change(&previous_board);
+}
+
+void
+seek_replay(int64_t steps)
+{
+  if (steps < 0) {
+    steps = 0;
+  }
+  replay_seek(&replay, (uint32_t)steps);
+  replay_clock = replay.time_ms;
+  show_replay_state();
+}
+
+/*
+ * Space pauses, left and right step one state, page up and down jump a
+ * keyframe interval, home and end go to either end, up and down change the
+ * speed.
+ */
+void
+update_replay(float delta_time)
+{
+  int64_t step = replay.step;
+  if (IsKeyPressed(KEY_SPACE)) {
+    replay_paused = !replay_paused;
+  }
+  if (IsKeyPressed(KEY_UP) && replay_speed < REPLAY_MAX_SPEED) {
+    replay_speed *= 2.0;
+    replay_speed = replay_speed > REPLAY_MAX_SPEED ? REPLAY_MAX_SPEED : replay_speed;
+  }
+  if (IsKeyPressed(KEY_DOWN) && replay_speed > 0.25) {
+    replay_speed /= 2.0;
+  }
+
+  if (IsKeyPressed(KEY_LEFT)) {
+    seek_replay(step - 1);
+  } else if (IsKeyPressed(KEY_RIGHT)) {
+    seek_replay(step + 1);
+  } else if (IsKeyPressed(KEY_PAGE_UP)) {
+    seek_replay(step - replay.keyframe_interval);
+  } else if (IsKeyPressed(KEY_PAGE_DOWN)) {
+    seek_replay(step + replay.keyframe_interval);
+  } else if (IsKeyPressed(KEY_HOME)) {
+    seek_replay(0);
+  } else if (IsKeyPressed(KEY_END)) {
+    seek_replay(replay.steps);
+  }
+
+  if (replay_paused) {
+    return;
+  }
 
-    start_animation();
+  replay_clock += delta_time * 1000.0 * replay_speed;
+  bool advanced = false;
+  while (replay_advance(&replay, (uint32_t)replay_clock)) {
+    advanced = true;
+  }
+  if (advanced) {
+    show_replay_state();
+  }
+}
 
-    memcpy(&previous_board, &game_state, sizeof(struct GameState));
-    memcpy(&game_state, &new_state, sizeof(struct GameState));
+void
+receive_server_message()
+{
+  NetEvent event;
+  NetEvent latest;
+  bool have_latest = false;
+
+  while (net_thread_poll(&net, &event)) {
+    switch (event.type) {
+      case NET_EVENT_PLAYER_ID:
+        if (have_latest) {
+          handle_state_event(&latest);
+          have_latest = false;
+        }
+        player_id = event.player_id;
+        printf("Assigned Player ID: %d\n", player_id);
+        connected = true;
+        queued = false;
+        have_state_seq = false;
+        current_screen = IN_GAME;
+        break;
 
-    if (!game_state.game_over && new_state.game_over) {
-      printf("Game Over! Player 1 Score: %d, Player 2 Score: %d\n",
-             new_state.player1_score,
-             new_state.player2_score);
+      case NET_EVENT_STATE:
+        if (!have_latest || !proto_seq_newer(latest.seq, event.seq)) {
+          latest = event;
+          have_latest = true;
+        }
+        break;
     }
   }
+
+  if (have_latest) {
+    handle_state_event(&latest);
+  }
 }
 
 Vector2
@@ -337,216 +863,552 @@ tile_to_sprite_coord(Tile tile)
   }
 }
 
+// Fills sprite_uvs from the sprite sheet: one row per tile color, one
+// column per animation frame.
+void
+build_sprite_uvs(Texture* sheet)
+{
+  for (int tile = T_RED; tile <= T_SPECIAL; tile++) {
+    Vector2 coords = tile_to_sprite_coord((Tile)tile);
+    for (int frame = 0; frame < SPRITE_FRAMES; frame++) {
+      sprite_uvs[tile][frame] = (SpriteUV){
+        .u0 = (float)(frame * SPRITE_SIZE) / sheet->width,
+        .v0 = (coords.y * SPRITE_SIZE) / sheet->height,
+        .u1 = (float)((frame + 1) * SPRITE_SIZE) / sheet->width,
+        .v1 = ((coords.y + 1) * SPRITE_SIZE) / sheet->height,
+      };
+    }
+  }
+}
+
+/*
+ * Draws every quad from one texture as a single rlgl batch. This is what
+ * DrawTexturePro does per call, minus the rotation math and the per-call
+ * batch bookkeeping.
+ */
 void
-draw_sprite_frame(Texture* texture,
-                  Vector2 size,
-                  Vector2 coords,
-                  Vector2 position,
-                  float scale,
-                  Color color)
+draw_sprite_batch(Texture* texture, const SpriteQuad* quads, int count)
 {
-  int32_t spire_sheet_width = texture->width;
-  int32_t spire_sheet_height = texture->height;
+  if (count == 0) {
+    return;
+  }
 
-  Vector2 sprite_size = { size.x, size.y };
+  rlCheckRenderBatchLimit(count * 4);
+  rlSetTexture(texture->id);
+  rlBegin(RL_QUADS);
+  rlColor4ub(255, 255, 255, 255);
+  rlNormal3f(0.0f, 0.0f, 1.0f);
+
+  for (int i = 0; i < count; i++) {
+    Rectangle d = quads[i].dest;
+    SpriteUV uv = quads[i].uv;
+
+    rlTexCoord2f(uv.u0, uv.v0);
+    rlVertex2f(d.x, d.y);
+    rlTexCoord2f(uv.u0, uv.v1);
+    rlVertex2f(d.x, d.y + d.height);
+    rlTexCoord2f(uv.u1, uv.v1);
+    rlVertex2f(d.x + d.width, d.y + d.height);
+    rlTexCoord2f(uv.u1, uv.v0);
+    rlVertex2f(d.x + d.width, d.y);
+  }
 
-  Vector2 sprite_pos = {
-    (sprite_size.x * coords.x),
-    (sprite_size.y * coords.y),
-  };
+  rlEnd();
+  rlSetTexture(0);
+}
 
-  Rectangle source = {
-    sprite_pos.x, sprite_pos.y, sprite_size.x, sprite_size.y
-  };
-  Rectangle dest = {
-    position.x, position.y, sprite_size.x * scale, sprite_size.y * scale
+Rectangle
+tile_rect(float x, float y)
+{
+  return (Rectangle){
+    x + TILE_MARGIN, y + TILE_MARGIN,
+    tile_size - 2 * TILE_MARGIN, tile_size - 2 * TILE_MARGIN,
   };
+}
 
-  Vector2 origin = { 0.0f, 0.0f };
-  DrawTexturePro(*texture, source, dest, origin, 0.0f, color);
+// Redraws the tile backgrounds for a new board size and resets the cache to
+// them.
+void
+render_board_layers(int size)
+{
+  Rectangle flipped = { 0, 0, BOARD_PIXELS, -BOARD_PIXELS };
+
+  BeginTextureMode(board_background);
+  ClearBackground(BACKGROUND_COLOR);
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      Rectangle rect = tile_rect(x * tile_size, y * tile_size);
+      DrawRectangleRounded(rect, 0.2f, 10, BROWN);
+      DrawRectangleRoundedLines(rect, 0.2f, 10, 2, BLACK);
+    }
+  }
+  EndTextureMode();
+
+  BeginTextureMode(board_cache);
+  DrawTextureRec(board_background.texture, flipped, Vector2Zero(), WHITE);
+  EndTextureMode();
+
+  memset(cached_tiles, EMPTY, sizeof(cached_tiles));
+  board_layers_size = size;
 }
 
+/*
+ * The board is drawn in three passes: the cached layer as one texture, the
+ * gems that move or play an animation in one batch on top of it, and the
+ * selection outlines. Cells whose settled gem changed are patched into the
+ * cache first, restoring the background from board_background and baking
+ * the new gem, again as two batches.
+ */
 void
 draw_board(Texture* sprite_sheet)
 {
+  int size = game_state.board_size;
+  size_t quads = sizeof(SpriteQuad) * size * size;
+  SpriteQuad* restored = ArenaAlloc(frame_arena, quads);
+  SpriteQuad* baked = ArenaAlloc(frame_arena, quads);
+  SpriteQuad* live = ArenaAlloc(frame_arena, 2 * quads); // gem and pop
+  int restored_count = 0;
+  int baked_count = 0;
+  int live_count = 0;
+
+  if (board_layers_size != size) {
+    render_board_layers(size);
+  }
 
-  static float frame_timer[BOARD_SIZE][BOARD_SIZE] = { 0.0f };
-  static int32_t coordx[BOARD_SIZE][BOARD_SIZE] = { 0 };
-
-  const int32_t max_frames = 19;
-  const float frame_duration = 0.15f;
+  int frame = (int)(GetTime() / SPRITE_FRAME_DURATION) % SPRITE_FRAMES;
+  float cell_uv = tile_size / BOARD_PIXELS;
 
-  for (int y = 0; y < BOARD_SIZE; y++) {
-    for (int x = 0; x < BOARD_SIZE; x++) {
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      Tile tile = game_state.board[y][x];
       bool is_selected = (x == (int)selected_tile.x && y == (int)selected_tile.y);
-      bool is_hovered = (x == (int)hover_tile.x && y == (int)hover_tile.y);
-      bool is_adjacent = false;
-
-      if (selected_tile.x != -1 && !is_selected) {
-        if ((abs(x - selected_tile.x) == 1 && y == (int)selected_tile.y) ||
-            (abs(y - selected_tile.y) == 1 && x == (int)selected_tile.x)) {
-          is_adjacent = true;
+      bool is_swapping =
+        animating_swap && ((x == (int)swap_from.x && y == (int)swap_from.y) ||
+                           (x == (int)swap_to.x && y == (int)swap_to.y));
+      bool is_animated = tile == T_SPECIAL || is_selected;
+      bool is_popping = pop_scale[y][x] > 0.0f;
+      bool is_live =
+        is_popping || (tile != EMPTY && (is_swapping || is_animated ||
+                                         tile_offsets[y][x] != 0));
+
+      Tile settled = is_live ? EMPTY : tile;
+      if (cached_tiles[y][x] != settled) {
+        // board_background is a render texture, stored upside down
+        restored[restored_count++] = (SpriteQuad){
+          .dest = { x * tile_size, y * tile_size, tile_size, tile_size },
+          .uv = { x * cell_uv, 1.0f - y * cell_uv,
+                  (x + 1) * cell_uv, 1.0f - (y + 1) * cell_uv },
+        };
+        if (settled != EMPTY) {
+          baked[baked_count++] = (SpriteQuad){
+            .dest = tile_rect(x * tile_size, y * tile_size),
+            .uv = sprite_uvs[settled][0],
+          };
         }
+        cached_tiles[y][x] = settled;
       }
 
-      Tile display_tile = game_state.board[y][x];
+      if (!is_live) {
+        continue;
+      }
 
-      float pos_x = 100 + x * TILE_SIZE;
-      float pos_y = 100 + y * TILE_SIZE;
+      float pos_x = BOARD_ORIGIN + x * tile_size;
+      float pos_y = BOARD_ORIGIN + y * tile_size;
+
+      if (is_popping) {
+        Rectangle rect = tile_rect(pos_x, pos_y);
+        float shrink = (1.0f - pop_scale[y][x]) * 0.5f;
+        rect.x += rect.width * shrink;
+        rect.y += rect.height * shrink;
+        rect.width *= pop_scale[y][x];
+        rect.height *= pop_scale[y][x];
+        live[live_count++] = (SpriteQuad){
+          .dest = rect,
+          .uv = sprite_uvs[pop_tiles[y][x]][0],
+        };
+      }
 
-      if (animating_swap) {
-        if ((x == (int)swap_from.x && y == (int)swap_from.y) ||
-            (x == (int)swap_to.x && y == (int)swap_to.y)) {
-          float t = swap_animation_timer / SWAP_ANIMATION_DURATION;
-          if (t > 1.0f) t = 1.0f;
+      if (tile == EMPTY) {
+        continue;
+      }
 
-          float dx = (swap_to.x - swap_from.x) * TILE_SIZE * t;
-          float dy = (swap_to.y - swap_from.y) * TILE_SIZE * t;
+      if (is_swapping) {
+        float dx = (swap_to.x - swap_from.x) * tile_size * swap_progress;
+        float dy = (swap_to.y - swap_from.y) * tile_size * swap_progress;
 
-          if (x == (int)swap_from.x && y == (int)swap_from.y) {
-            pos_x += dx;
-            pos_y += dy;
-          } else if (x == (int)swap_to.x && y == (int)swap_to.y) {
-            pos_x -= dx;
-            pos_y -= dy;
-          }
+        if (x == (int)swap_from.x && y == (int)swap_from.y) {
+          pos_x += dx;
+          pos_y += dy;
+        } else {
+          pos_x -= dx;
+          pos_y -= dy;
         }
       }
 
       pos_y += tile_offsets[y][x];
 
-      Rectangle tileRect = {
-        pos_x + 5.0f, pos_y + 5.0f, TILE_SIZE - 10.0f, TILE_SIZE - 10.0f
+      live[live_count++] = (SpriteQuad){
+        .dest = tile_rect(pos_x, pos_y),
+        .uv = sprite_uvs[tile][is_animated ? frame : 0],
       };
-      Color tileColor;
-
-      switch (display_tile) {
-        case T_RED:
-          tileColor = RED;
-          break;
-        case T_BLUE:
-          tileColor = BLUE;
-          break;
-        case T_GREEN:
-          tileColor = GREEN;
-          break;
-        case T_YELLOW:
-          tileColor = YELLOW;
-          break;
-        case T_PURPLE:
-          tileColor = PURPLE;
-          break;
-        default:
-          tileColor = LIGHTGRAY;
-          break;
-      }
-
-      DrawRectangleRounded(tileRect, 0.2f, 10, BROWN);
-      DrawRectangleRoundedLines(tileRect, 0.2f, 10, 2, BLACK);
-
-      frame_timer[y][x] += GetFrameTime();
+    }
+  }
 
-      if (frame_timer[y][x] >= frame_duration) {
-        frame_timer[y][x] = 0.0f;
-        coordx[y][x]++;
+  if (restored_count > 0) {
+    BeginTextureMode(board_cache);
+    draw_sprite_batch(&board_background.texture, restored, restored_count);
+    draw_sprite_batch(sprite_sheet, baked, baked_count);
+    EndTextureMode();
+  }
 
-        if (coordx[y][x] > max_frames) {
-          coordx[y][x] = 0;
-        }
+  DrawTextureRec(board_cache.texture,
+                 (Rectangle){ 0, 0, BOARD_PIXELS, -BOARD_PIXELS },
+                 (Vector2){ BOARD_ORIGIN, BOARD_ORIGIN },
+                 WHITE);
+  draw_sprite_batch(sprite_sheet, live, live_count);
+
+  if (selected_tile.x != -1) {
+    int sx = (int)selected_tile.x;
+    int sy = (int)selected_tile.y;
+    const int neighbours[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+
+    for (int i = 0; i < 4; i++) {
+      int nx = sx + neighbours[i][0];
+      int ny = sy + neighbours[i][1];
+      if (nx >= 0 && nx < size && ny >= 0 && ny < size) {
+        Rectangle rect = tile_rect(BOARD_ORIGIN + nx * tile_size,
+                                   BOARD_ORIGIN + ny * tile_size);
+        DrawRectangleRoundedLines(rect, 0.2f, 10, 2, LIGHTGRAY);
       }
+    }
+    Rectangle rect = tile_rect(BOARD_ORIGIN + sx * tile_size,
+                               BOARD_ORIGIN + sy * tile_size);
+    DrawRectangleRoundedLines(rect, 0.2f, 10, 4, WHITE);
+  }
 
-      Vector2 coords = tile_to_sprite_coord(display_tile);
-      Vector2 sprite_coords = {
-        coords.x, coords.y
-      };
+  if (show_hint && hint.count > 0) {
+    const SolverMove* best = &hint.moves[0];
+    DrawRectangleRoundedLines(tile_rect(BOARD_ORIGIN + best->from_x * tile_size,
+                                        BOARD_ORIGIN + best->from_y * tile_size),
+                              0.2f,
+                              10,
+                              3,
+                              GOLD);
+    DrawRectangleRoundedLines(tile_rect(BOARD_ORIGIN + best->to_x * tile_size,
+                                        BOARD_ORIGIN + best->to_y * tile_size),
+                              0.2f,
+                              10,
+                              3,
+                              GOLD);
+  }
 
-      if (display_tile == T_SPECIAL || is_selected) {
-        sprite_coords.x = coordx[y][x] * 84;
-      }
+  if (hover_tile.x != -1 && !board_is_adjacent(hover_tile.x,
+                                                hover_tile.y,
+                                                selected_tile.x,
+                                                selected_tile.y) &&
+      (hover_tile.x != selected_tile.x || hover_tile.y != selected_tile.y)) {
+    Rectangle rect = tile_rect(BOARD_ORIGIN + hover_tile.x * tile_size,
+                               BOARD_ORIGIN + hover_tile.y * tile_size);
+    DrawRectangleRoundedLines(rect, 0.2f, 10, 2, DARKGRAY);
+  }
+}
 
-      draw_sprite_frame(sprite_sheet,
-                        (Vector2){ 84.0f, 84.0f },
-                        sprite_coords,
-                        (Vector2){ tileRect.x, tileRect.y },
-                        0.6f,
-                        WHITE);
-
-      if (is_selected) {
-        DrawRectangleRoundedLines(tileRect, 0.2f, 10, 4, WHITE);
-      } else if (is_adjacent) {
-        DrawRectangleRoundedLines(tileRect, 0.2f, 10, 2, LIGHTGRAY);
-      } else if (is_hovered) {
-        DrawRectangleRoundedLines(tileRect, 0.2f, 10, 2, DARKGRAY);
+/*
+ * F1 overlay: per-zone averages of the render thread over the last second,
+ * refreshed twice a second so the numbers stay readable, and a histogram of
+ * recent frame times. Drawn with raylib's default font so it stays out of
+ * the text cache it reports on.
+ */
+void
+draw_profiler_overlay()
+{
+  static ProfZoneStats zones[PROFILER_ZONES];
+  static int zone_count = 0;
+  static uint32_t frames = 1;
+  static double refreshed = 0;
+
+  if (GetTime() - refreshed >= 0.5) {
+    refreshed = GetTime();
+    zone_count = prof_zone_stats(zones, PROFILER_ZONES, 1.0);
+    frames = 1;
+    for (int i = 0; i < zone_count; i++) {
+      if (strcmp(zones[i].name, "frame") == 0 && zones[i].calls > 0) {
+        frames = zones[i].calls;
       }
     }
   }
+
+  uint64_t* times = ArenaAlloc(frame_arena, sizeof(uint64_t) * PROF_FRAME_HISTORY);
+  int time_count = prof_frame_times(times, PROF_FRAME_HISTORY);
+  int buckets[PROFILER_BUCKETS] = { 0 };
+  int tallest = 1;
+  for (int i = 0; i < time_count; i++) {
+    int bucket = (int)(times[i] / 2000000);
+    if (bucket >= PROFILER_BUCKETS) {
+      bucket = PROFILER_BUCKETS - 1;
+    }
+    if (++buckets[bucket] > tallest) {
+      tallest = buckets[bucket];
+    }
+  }
+
+  int x = 10;
+  int y = 90;
+  int line = 12;
+  DrawRectangle(x - 5, y - 5, 330, (zone_count + 5) * line + 70, Fade(BLACK, 0.8f));
+
+  DrawText("zone                      ms/call  ms/frame   max", x, y, 10, YELLOW);
+  y += line;
+  for (int i = 0; i < zone_count; i++) {
+    ProfZoneStats* zone = &zones[i];
+    DrawText(TextFormat("%*s%-*s %7.3f %8.3f %7.3f",
+                        zone->depth * 2,
+                        "",
+                        24 - zone->depth * 2,
+                        zone->name,
+                        zone->total_ns / 1e6 / zone->calls,
+                        zone->total_ns / 1e6 / frames,
+                        zone->max_ns / 1e6),
+             x,
+             y,
+             10,
+             RAYWHITE);
+    y += line;
+  }
+
+  y += 4;
+  DrawText(TextFormat("frame times, last %d frames, 2 ms buckets", time_count),
+           x,
+           y,
+           10,
+           YELLOW);
+  y += line;
+  for (int i = 0; i < PROFILER_BUCKETS; i++) {
+    int height = 40 * buckets[i] / tallest;
+    DrawRectangle(x + i * 20, y + 40 - height, 16, height, i < 9 ? GREEN : RED);
+  }
+  y += 44;
+
+  ArenaStats frame_stats = ArenaGetStats(frame_arena);
+  DrawText(TextFormat("text cache %u hits %u misses %u rebuilds",
+                      text_cache.hits,
+                      text_cache.misses,
+                      text_cache.rebuilds),
+           x,
+           y,
+           10,
+           LIGHTGRAY);
+  y += line;
+  DrawText(TextFormat("frame arena %zu B peak, %u block(s)",
+                      frame_stats.peak,
+                      frame_stats.blocks),
+           x,
+           y,
+           10,
+           LIGHTGRAY);
+  y += line;
+  DrawText(TextFormat("F2 writes the last %d s as Chrome trace JSON",
+                      PROFILER_DUMP_SECONDS),
+           x,
+           y,
+           10,
+           GRAY);
+}
+
+void
+usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-n] [-r recording [-x speed]]\n", name);
+  exit(2);
 }
 
 int
-main()
+main(int argc, char** argv)
 {
+  const char* replay_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "nr:x:")) != -1) {
+    switch (opt) {
+      case 'n':
+        record_matches = false;
+        break;
+      case 'r':
+        replay_path = optarg;
+        break;
+      case 'x':
+        replay_speed = atof(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (replay_speed <= 0 || replay_speed > REPLAY_MAX_SPEED) {
+    usage(argv[0]);
+  }
 
   SetConfigFlags(FLAG_VSYNC_HINT | FLAG_MSAA_4X_HINT);
 
   InitWindow(680, 720, "Bejeweled PvP");
   SetTargetFPS(60);
 
-  font.baseSize = 120;
-  font.glyphCount = 95;
+  double load_start = GetTime();
+  AssetPack pack;
+  bool have_pack = asset_pack_open(&pack, ASSET_PACK_PATH);
+
+  Image atlas;
+  if (have_pack && asset_pack_font(&pack, &font, &atlas)) {
+    font.texture = LoadTextureFromImage(atlas);
+  } else {
+    font.baseSize = ASSET_FONT_BASE_SIZE;
+    font.glyphCount = ASSET_FONT_GLYPHS;
 
-  uint32_t fileSize = 0;
-  uint8_t* fileData = LoadFileData("res/fonts/times.ttf", &fileSize);
-  uint32_t fontSize = 128;
+    uint32_t fileSize = 0;
+    uint8_t* fileData = LoadFileData(ASSET_FONT_PATH, &fileSize);
 
-  font.glyphs = LoadFontData(fileData, fileSize, fontSize, 0, 0, FONT_SDF);
-  Image atlas =
-    GenImageFontAtlas(font.glyphs, &font.recs, font.glyphCount, fontSize, 0, 1);
-  font.texture = LoadTextureFromImage(atlas);
+    font.glyphs =
+      LoadFontData(fileData, fileSize, ASSET_FONT_SIZE, 0, 0, FONT_SDF);
+    atlas = GenImageFontAtlas(
+      font.glyphs, &font.recs, font.glyphCount, ASSET_FONT_SIZE, 0, 1);
+    font.texture = LoadTextureFromImage(atlas);
 
-  UnloadImage(atlas);
-  UnloadFileData(fileData);
+    UnloadImage(atlas);
+    UnloadFileData(fileData);
+  }
   SetTextureFilter(font.texture, TEXTURE_FILTER_BILINEAR);
+  text_cache_init(&text_cache, &font);
 
-  ArenaAllocator* arena = MakeArenaAllocator((1024 << 2));
+  ArenaAllocator* arena = MakeArenaAllocator(KB(16));
+  frame_arena = MakeArenaAllocator(KB(64));
 
   TextureStorage* texture_storage;
-  texture_storage = (TextureStorage*)ArenaAlloc(arena, sizeof(TextureStorage));
+  texture_storage = (TextureStorage*)ArenaAllocAligned(
+    arena, sizeof(TextureStorage), alignof(TextureStorage));
   for (uint32_t i = 0; i < TEXTURE_COUNT; i++) {
     texture_storage->data[i] =
       (TextureStorageEntry*)ArenaAlloc(arena, sizeof(TextureStorageEntry));
     texture_storage->data[i]->texture =
       (Texture*)ArenaAlloc(arena, sizeof(Texture));
   }
+  if (!texture_storage_init(texture_storage)) {
+    die("texture_storage_init");
+  }
 
-  texture_storage_load(
-    texture_storage, "./res/spritesheet.png", TEXTURE0, Vector2Zero());
+  const AssetPackImage* spritesheet =
+    have_pack ? asset_pack_find_image(&pack, ASSET_SPRITESHEET_PATH) : NULL;
+  if (spritesheet) {
+    texture_storage_load_image(
+      texture_storage, asset_pack_image(&pack, spritesheet), TEXTURE0);
+  } else {
+    texture_storage_load(
+      texture_storage, ASSET_SPRITESHEET_PATH, TEXTURE0, Vector2Zero());
+  }
 
-  if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
-    die("socket");
+  // everything is on the GPU now
+  if (have_pack) {
+    asset_pack_close(&pack);
+    TraceLog(LOG_INFO,
+             "Assets loaded in %.1f ms from " ASSET_PACK_PATH,
+             (GetTime() - load_start) * 1000.0);
+  } else {
+    TraceLog(LOG_INFO,
+             "Font rasterized in %.1f ms, sprites decode in the background; "
+             "run `make pack` to bake them",
+             (GetTime() - load_start) * 1000.0);
   }
 
-  memset((char*)&server_addr, 0, sizeof(server_addr));
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(PORT);
-  server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  if (replay_path != NULL) {
+    if (!replay_open(&replay, replay_path)) {
+      fprintf(stderr, "cannot replay %s\n", replay_path);
+      exit(1);
+    }
+    TraceLog(LOG_INFO,
+             "Replaying game %u, %u states over %.1f s",
+             replay.game_id,
+             replay.steps,
+             replay.duration_ms / 1000.0);
+    current_screen = REPLAY;
+  } else {
+    if ((sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
+      die("socket");
+    }
+
+    memset((char*)&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(PORT);
+    server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    set_socket_nonblocking(sockfd);
 
-  set_socket_nonblocking(sockfd);
+    if (!net_thread_start(&net, sockfd, &server_addr)) {
+      die("net_thread_start");
+    }
+  }
 
   Rectangle connectButton = {
     GetScreenWidth() / 2 - 250 / 2, GetScreenHeight() / 2, 200, 50
   };
+  Rectangle boardSizeButton = {
+    GetScreenWidth() / 2 - 250 / 2, GetScreenHeight() / 2 + 70, 200, 50
+  };
+  Rectangle watchButton = {
+    GetScreenWidth() / 2 - 250 / 2, GetScreenHeight() / 2 + 140, 200, 50
+  };
   Rectangle disconnectButton = { GetScreenWidth() - (100 + 185), 20, 180, 40 };
 
   memset(&previous_board, 0, sizeof(struct GameState));
-  Texture* sprite_sheet = texture_storage_get(texture_storage, TEXTURE0);
+  bool sprite_sheet_ready = false;
+
+  if (!work_pool_init(&solver_pool, 0)) {
+    die("work_pool_init");
+  }
+
+  board_background = LoadRenderTexture(BOARD_PIXELS, BOARD_PIXELS);
+  board_cache = LoadRenderTexture(BOARD_PIXELS, BOARD_PIXELS);
+  if (current_screen == REPLAY) {
+    seek_replay(0);
+  }
 
   while (!WindowShouldClose()) {
+    ArenaReset(frame_arena);
     float delta_time = GetFrameTime();
+
+    ProfZone zone = prof_begin("update_animation");
     update_animation(delta_time);
-    receive_server_message();
+    prof_end(zone);
+
+    if (current_screen == REPLAY) {
+      zone = prof_begin("update_replay");
+      update_replay(delta_time);
+      prof_end(zone);
+    } else {
+      zone = prof_begin("receive_server_message");
+      receive_server_message();
+      prof_end(zone);
+
+      if (spectating) {
+        renew_spectating();
+      }
+      if (queued &&
+          GetTime() - connect_sent >= PROTO_QUEUE_RENEW_MS / 1000.0) {
+        send_connect_request();
+      }
+      update_reliability();
+    }
 
+    zone = prof_begin("texture_upload");
+    texture_storage_update(texture_storage, TEXTURE_UPLOAD_BUDGET);
+    prof_end(zone);
+    Texture* sprite_sheet = texture_storage_get(texture_storage, TEXTURE0);
+    if (!sprite_sheet_ready && texture_storage_ready(texture_storage, TEXTURE0)) {
+      build_sprite_uvs(sprite_sheet);
+      board_layers_size = 0; // gems baked from the placeholder
+      sprite_sheet_ready = true;
+    }
+
+    ProfZone draw_zone = prof_begin("draw");
     BeginDrawing();
-    ClearBackground((Color){ 30, 39, 46, 255 });
+    ClearBackground(BACKGROUND_COLOR);
 
     switch (current_screen) {
       case MAIN_MENU:
@@ -557,28 +1419,39 @@ main()
 
         float title_font_size = 90.0f;
         const char* title = "Bejeweled PvP";
-        Vector2 title_size = MeasureTextEx(font, title, title_font_size, 1.0f);
+        Vector2 title_size = measure_text(title, title_font_size);
         Vector2 title_pos = {
           GetScreenWidth() * 0.5f - title_size.x * 0.5f,
           200.0f,
         };
 
-        blit_text(&font, title, title_pos, title_font_size, WHITE);
+        blit_text(NULL, title, title_pos, title_font_size, WHITE);
         if (draw_button("Connect To Server", connectButton, BLUE)) {
-          send_connect_request();
+          start_queueing();
+        }
+        if (draw_button(TextFormat("Board: %dx%d",
+                                   requested_board_size,
+                                   requested_board_size),
+                        boardSizeButton,
+                        GRAY)) {
+          next_board_size();
+        }
+        if (draw_button("Watch a Game", watchButton, GRAY)) {
+          start_spectating();
         }
 
         break;
 
       case IN_GAME:
         if (!connected) {
-          blit_text(&font,
-                    "Connecting to the server...",
+          blit_text(NULL,
+                    spectating ? "Looking for a game to watch..."
+                               : "Looking for an opponent...",
                     (Vector2){ 190, 200 },
                     20,
                     LIGHTGRAY);
         } else if (!game_state.game_started) {
-          blit_text(&font,
+          blit_text(NULL,
                     "Waiting for another player...",
                     (Vector2){ 190, 200 },
                     20,
@@ -586,18 +1459,35 @@ main()
 
         } else {
 
-          blit_text(&font,
+          blit_text("p1_score",
                     TextFormat("P1: %d", game_state.player1_score),
                     (Vector2){ 100, 20 },
                     20,
                     BLUE);
-          blit_text(&font,
+          blit_text("p2_score",
                     TextFormat("P2: %d", game_state.player2_score),
                     (Vector2){ 100, 50 },
                     20,
                     RED);
+          if (spectating) {
+            blit_text("watching",
+                      TextFormat("Watching game %d", game_state.game_id),
+                      (Vector2){ 100, GetScreenHeight() - 30 },
+                      16,
+                      GRAY);
+          } else {
+            blit_text("prediction_misses",
+                      TextFormat("Prediction misses: %d/%d",
+                                 prediction_misses,
+                                 prediction_count),
+                      (Vector2){ 100, GetScreenHeight() - 30 },
+                      16,
+                      GRAY);
+          }
 
+          zone = prof_begin("draw_board");
           draw_board(sprite_sheet);
+          prof_end(zone);
 
           if (draw_button("Disconnect", disconnectButton, PINK)) {
             send_disconnect_request();
@@ -608,6 +1498,10 @@ main()
             const char* result;
             if (game_state.player1_score == game_state.player2_score) {
               result = "It's a Tie!";
+            } else if (spectating) {
+              result = game_state.player1_score > game_state.player2_score
+                         ? "Player 1 Won!"
+                         : "Player 2 Won!";
             } else if ((player_id == 0 &&
                         game_state.player1_score > game_state.player2_score) ||
                        (player_id == 1 &&
@@ -617,7 +1511,7 @@ main()
               result = "You Lost!";
             }
 
-            Vector2 text_size = MeasureTextEx(font, result, 40, 1);
+            Vector2 text_size = measure_text(result, 40);
             float center_x = (GetScreenWidth() - text_size.x) / 2;
 
             float padding = 20;
@@ -630,10 +1524,10 @@ main()
                                  0.3,
                                  10,
                                  DARKGRAY);
-            blit_text(&font, result, (Vector2){ center_x, 300 }, 40, GREEN);
+            blit_text(NULL, result, (Vector2){ center_x, 300 }, 40, GREEN);
 
             const char* instruction = "Press Space to return to main menu";
-            Vector2 instruction_size = MeasureTextEx(font, instruction, 20, 1);
+            Vector2 instruction_size = measure_text(instruction, 20);
             float instruction_center_x =
               (GetScreenWidth() - instruction_size.x) / 2;
 
@@ -646,7 +1540,7 @@ main()
                                  0.3,
                                  10,
                                  DARKGRAY);
-            blit_text(&font,
+            blit_text(NULL,
                       instruction,
                       (Vector2){ instruction_center_x, 400 },
                       20,
@@ -661,21 +1555,35 @@ main()
 
             float font_size = 30.0f;
             const char* str = "Your turn!";
-            Vector2 size = MeasureTextEx(font, str, font_size, 1.0f);
-            blit_text(&font,
+            Vector2 size = measure_text(str, font_size);
+            blit_text(NULL,
                       str,
                       (Vector2){ GetScreenWidth() / 2 - size.x / 2,
                                  GetScreenHeight() - size.y * 4 },
                       font_size,
                       GREEN);
 
+            if (IsKeyPressed(KEY_H)) {
+              request_hint();
+            }
+            if (show_hint && hint.count == 0) {
+              const char* hint_str = hint.evaluated == hint.swaps
+                                       ? "No moves left"
+                                       : "No move found in time";
+              blit_text(NULL,
+                        hint_str,
+                        (Vector2){ 100, GetScreenHeight() - 50 },
+                        16,
+                        GOLD);
+            }
+
             Vector2 mousePoint = GetMousePosition();
-            int hoverX = (mousePoint.x - 100) / TILE_SIZE;
-            int hoverY = (mousePoint.y - 100) / TILE_SIZE;
+            int hoverX = (mousePoint.x - BOARD_ORIGIN) / tile_size;
+            int hoverY = (mousePoint.y - BOARD_ORIGIN) / tile_size;
 
             hover_tile = (Vector2){ -1, -1 };
-            if (hoverX >= 0 && hoverX < BOARD_SIZE && hoverY >= 0 &&
-                hoverY < BOARD_SIZE) {
+            if (hoverX >= 0 && hoverX < game_state.board_size && hoverY >= 0 &&
+                hoverY < game_state.board_size) {
               hover_tile = (Vector2){ hoverX, hoverY };
             }
 
@@ -687,11 +1595,8 @@ main()
                   if ((abs(hover_tile.x - selected_tile.x) == 1 && hover_tile.y == selected_tile.y) ||
                       (abs(hover_tile.y - selected_tile.y) == 1 && hover_tile.x == selected_tile.x)) {
                     send_move(selected_tile.x, selected_tile.y, hover_tile.x, hover_tile.y);
-                    animating_swap = true;
-                    swap_animation_timer = 0.0f;
-
-                    swap_from = selected_tile;
-                    swap_to = hover_tile;
+                    predict_move(selected_tile.x, selected_tile.y, hover_tile.x, hover_tile.y);
+                    start_swap_animation(selected_tile, hover_tile);
 
                     selected_tile = (Vector2){ -1, -1 };
                   } else if (hover_tile.x == selected_tile.x && hover_tile.y == selected_tile.y) {
@@ -708,8 +1613,8 @@ main()
           } else {
             float font_size = 30.0f;
             const char* str = "Opponent's Turn!";
-            Vector2 size = MeasureTextEx(font, str, font_size, 1.0f);
-            blit_text(&font,
+            Vector2 size = measure_text(str, font_size);
+            blit_text(NULL,
                       str,
                       (Vector2){ GetScreenWidth() / 2 - size.x / 2,
                                  GetScreenHeight() - size.y * 4 },
@@ -718,12 +1623,101 @@ main()
           }
         }
         break;
+
+      case REPLAY:
+        blit_text("p1_score",
+                  TextFormat("P1: %d", game_state.player1_score),
+                  (Vector2){ 100, 20 },
+                  20,
+                  BLUE);
+        blit_text("p2_score",
+                  TextFormat("P2: %d", game_state.player2_score),
+                  (Vector2){ 100, 50 },
+                  20,
+                  RED);
+
+        zone = prof_begin("draw_board");
+        draw_board(sprite_sheet);
+        prof_end(zone);
+
+        blit_text("replay_status",
+                  TextFormat("Game %u, state %u of %u, %gx%s",
+                             replay.game_id,
+                             replay.step,
+                             replay.steps,
+                             replay_speed,
+                             replay_paused ? ", paused" : ""),
+                  (Vector2){ 100, GetScreenHeight() - 50 },
+                  16,
+                  GRAY);
+        blit_text(NULL,
+                  "Space pause, left/right step, page up/down jump, "
+                  "up/down speed",
+                  (Vector2){ 100, GetScreenHeight() - 30 },
+                  16,
+                  GRAY);
+        break;
     }
 
+    if (IsKeyPressed(KEY_F1)) {
+      show_profiler = !show_profiler;
+    }
+    if (show_profiler) {
+      draw_profiler_overlay();
+    }
+    prof_end(draw_zone);
+
+    // includes waiting for vsync
+    zone = prof_begin("present");
     EndDrawing();
+    prof_end(zone);
+    prof_frame();
+
+    if (IsKeyPressed(KEY_F2)) {
+      const char* path = TextFormat("trace_%ld.json", (long)time(NULL));
+      if (prof_dump_chrome(path, PROFILER_DUMP_SECONDS)) {
+        TraceLog(LOG_INFO, "Last %d s of profile written to %s", PROFILER_DUMP_SECONDS, path);
+      }
+    }
+    if (IsKeyPressed(KEY_F10)) {
+      if (export_memory_arena(arena, "arena_assets.bin") &&
+          export_memory_arena(frame_arena, "arena_frame.bin")) {
+        TraceLog(LOG_INFO, "Arenas written to arena_assets.bin, arena_frame.bin");
+      }
+    }
   }
 
-  close(sockfd);
+  if (current_screen == REPLAY) {
+    replay_close(&replay);
+  } else {
+    net_thread_stop(&net);
+    close(sockfd);
+    TraceLog(LOG_INFO,
+             "Net thread: %u state(s) superseded while the render loop lagged",
+             (unsigned)atomic_load(&net.dropped_events));
+  }
+  stop_recording();
+  work_pool_destroy(&solver_pool);
+  TraceLog(LOG_INFO,
+           "Text cache: %u hits, %u misses, %u rebuilds, %u evictions, "
+           "%u uncached",
+           text_cache.hits,
+           text_cache.misses,
+           text_cache.rebuilds,
+           text_cache.evictions,
+           text_cache.uncached);
+  ArenaStats frame_stats = ArenaGetStats(frame_arena);
+  TraceLog(LOG_INFO,
+           "Frame arena: %zu bytes peak in %u block(s), %llu allocations",
+           frame_stats.peak,
+           frame_stats.blocks,
+           (unsigned long long)frame_stats.allocations);
+  text_cache_destroy(&text_cache);
+  texture_storage_destroy(texture_storage);
+  UnloadRenderTexture(board_cache);
+  UnloadRenderTexture(board_background);
+  ArenaFree(frame_arena);
+  ArenaFree(arena);
   CloseWindow();
   return 0;
 }
@@ -0,0 +1,278 @@
+/**
+ * Benchmark and differential harness for the native board engine.
+ *
+ *   make enginebench
+ *   ./enginebench [-n iterations] [-s seed]
+ *   ./enginebench -d < cases
+ *
+ * The default mode times match detection, a full cascade and a full move on
+ * seeded random boards of every size in BOARD_VARIANTS and reports ns/op and
+ * allocs/op. Boards, moves and refills come from the same xorshift stream
+ * server_test.go uses, so the numbers line up with `make bench`.
+ *
+ * Sizes stop at BOARD_MAX_SIZE, 16: move packets carry 4-bit coordinates,
+ * the native engine packs a row into a 16-bit lane and the server's move
+ * index does too, so there is no 64x64 engine to time.
+ *
+ * With -d it reads one case per line from stdin and answers each with the
+ * engine's result, which is how server_test.go's differential tests drive
+ * it:
+ *
+ *   in:  <n> <n*n tile digits> <from x> <from y> <to x> <to y> [refill digits]
+ *   out: <score> <n*n tile digits> <refills consumed>
+ *
+ * Tiles are row-major, 0 is EMPTY. Once a cascade has used up the refill
+ * digits it continues with the xorshift stream seeded with DEFAULT_SEED; a
+ * stream that simply wrapped could keep matching forever.
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "board.c"
+
+#define DEFAULT_ITERATIONS 2000000
+#define DEFAULT_SEED 0x9E3779B97F4A7C15ULL
+#define BENCH_BOARDS 1024
+#define MAX_LINE 65536
+
+/*
+ * Linked with -Wl,--wrap for malloc and friends so every allocation made by
+ * the engine is counted; libc's own allocations are not wrapped.
+ */
+static uint64_t allocations;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void*
+__wrap_malloc(size_t size)
+{
+  allocations++;
+  return __real_malloc(size);
+}
+
+void*
+__wrap_calloc(size_t count, size_t size)
+{
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void*
+__wrap_realloc(void* ptr, size_t size)
+{
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+typedef struct BenchRandom
+{
+  uint64_t state;
+} BenchRandom;
+
+static uint64_t
+bench_next(BenchRandom* rng)
+{
+  rng->state ^= rng->state << 13;
+  rng->state ^= rng->state >> 7;
+  rng->state ^= rng->state << 17;
+  return rng->state;
+}
+
+static Tile
+bench_refill(void* user)
+{
+  return (Tile)(bench_next(user) % BOARD_COLORS + 1);
+}
+
+// Adjacent swap to the right or downwards, mirrored at the board edge.
+static void
+bench_move(BenchRandom* rng, int size, int* fx, int* fy, int* tx, int* ty)
+{
+  int cell = bench_next(rng) % (uint64_t)(size * size);
+  *fx = *tx = cell % size;
+  *fy = *ty = cell / size;
+
+  if (bench_next(rng) & 1) {
+    *tx = *fx < size - 1 ? *fx + 1 : *fx - 1;
+  } else {
+    *ty = *fy < size - 1 ? *fy + 1 : *fy - 1;
+  }
+}
+
+static int64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+report(const char* name,
+       int size,
+       int64_t elapsed,
+       uint64_t allocs,
+       long iterations)
+{
+  printf("%-14s %2dx%-6d %10ld %10.1f ns/op %6.2f allocs/op\n",
+         name,
+         size,
+         size,
+         iterations,
+         (double)elapsed / (double)iterations,
+         (double)allocs / (double)iterations);
+}
+
+static void
+run_benchmarks(int size, long iterations, uint64_t seed)
+{
+  static Board boards[BENCH_BOARDS];
+  static int moves[BENCH_BOARDS][4];
+
+  BenchRandom rng = { seed };
+  for (int i = 0; i < BENCH_BOARDS; i++) {
+    board_generate(&boards[i], size, bench_refill, &rng);
+    bench_move(
+      &rng, size, &moves[i][0], &moves[i][1], &moves[i][2], &moves[i][3]);
+  }
+
+  volatile int32_t sink = 0;
+  BoardMatches matches;
+  uint64_t allocs;
+  int64_t start;
+
+  allocs = allocations;
+  start = now_ns();
+  for (long i = 0; i < iterations; i++) {
+    sink += board_find_matches(&boards[i & (BENCH_BOARDS - 1)], &matches);
+  }
+  report("find_matches", size, now_ns() - start, allocations - allocs, iterations);
+
+  allocs = allocations;
+  start = now_ns();
+  for (long i = 0; i < iterations; i++) {
+    Board board = boards[i & (BENCH_BOARDS - 1)];
+    sink += board_cascade(&board, bench_refill, &rng);
+  }
+  report("cascade", size, now_ns() - start, allocations - allocs, iterations);
+
+  allocs = allocations;
+  start = now_ns();
+  for (long i = 0; i < iterations; i++) {
+    Board board = boards[i & (BENCH_BOARDS - 1)];
+    int* m = moves[i & (BENCH_BOARDS - 1)];
+    sink += board_apply_move(&board, m[0], m[1], m[2], m[3], bench_refill, &rng);
+  }
+  report("move", size, now_ns() - start, allocations - allocs, iterations);
+
+  (void)sink;
+}
+
+typedef struct RefillStream
+{
+  const char* tiles;
+  int len;
+  int consumed;
+  BenchRandom tail;
+} RefillStream;
+
+static Tile
+stream_refill(void* user)
+{
+  RefillStream* stream = user;
+  int next = stream->consumed++;
+  if (next < stream->len) {
+    return (Tile)(stream->tiles[next] - '0');
+  }
+  return bench_refill(&stream->tail);
+}
+
+static int
+run_differential()
+{
+  static char line[MAX_LINE];
+  char cells[BOARD_MAX_SIZE * BOARD_MAX_SIZE + 1];
+  int size, fx, fy, tx, ty, offset;
+
+  while (fgets(line, sizeof(line), stdin)) {
+    if (sscanf(line, "%d %256s %d %d %d %d %n", &size, cells, &fx, &fy, &tx, &ty, &offset) != 6 ||
+        !board_size_supported(size) || strlen(cells) != (size_t)(size * size)) {
+      fprintf(stderr, "enginebench: malformed case: %s", line);
+      return 1;
+    }
+
+    RefillStream stream = {
+      line + offset, (int)strcspn(line + offset, " \r\n"), 0, { DEFAULT_SEED }
+    };
+
+    BoardTiles tiles;
+    for (int i = 0; i < size * size; i++) {
+      tiles[i / size][i % size] = (Tile)(cells[i] - '0');
+    }
+
+    Board board;
+    board_from_tiles(&board, size, tiles);
+    int32_t score = board_apply_move(&board, fx, fy, tx, ty, stream_refill, &stream);
+    board_to_tiles(&board, tiles);
+
+    for (int i = 0; i < size * size; i++) {
+      cells[i] = (char)('0' + tiles[i / size][i % size]);
+    }
+    cells[size * size] = '\0';
+
+    printf("%d %s %d\n", score, cells, stream.consumed);
+    fflush(stdout);
+  }
+
+  return 0;
+}
+
+static void
+usage(const char* name)
+{
+  fprintf(stderr, "usage: %s [-n iterations] [-s seed] | -d\n", name);
+  exit(2);
+}
+
+int
+main(int argc, char** argv)
+{
+  long iterations = DEFAULT_ITERATIONS;
+  uint64_t seed = DEFAULT_SEED;
+  bool differential = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:s:d")) != -1) {
+    switch (opt) {
+      case 'n':
+        iterations = atol(optarg);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'd':
+        differential = true;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (iterations <= 0 || seed == 0) {
+    usage(argv[0]);
+  }
+
+  if (differential) {
+    return run_differential();
+  }
+
+#define X(n) run_benchmarks(n, iterations, seed);
+  BOARD_VARIANTS(X)
+#undef X
+  return 0;
+}
@@ -0,0 +1,90 @@
+package main
+
+import (
+	"net/netip"
+	"sync"
+)
+
+const INITIAL_GAMES = 128
+
+// Seat a player occupies, found in O(1) from the sender address.
+type PlayerRef struct {
+	Game *GameState
+	Seat int
+}
+
+// Growable table of live games. Freed slots are recycled through a free
+// list so the slice only grows when every slot is in use.
+//
+// Lock order is table.mu before GameState.mu. Code holding a game lock must
+// release it before calling back into the table.
+type GameTable struct {
+	mu         sync.RWMutex
+	slots      []*GameState
+	free       []int
+	players    map[netip.AddrPort]PlayerRef
+	games      map[int32]*GameState // by GameID, for spectators
+	queue      MatchQueue
+	nextGameID int32
+	count      int
+}
+
+func newGameTable() *GameTable {
+	return &GameTable{
+		slots:      make([]*GameState, 0, INITIAL_GAMES),
+		players:    make(map[netip.AddrPort]PlayerRef, INITIAL_GAMES*2),
+		games:      make(map[int32]*GameState, INITIAL_GAMES),
+		queue:      MatchQueue{tickets: make(map[netip.AddrPort]*Ticket)},
+		nextGameID: 1,
+	}
+}
+
+func (t *GameTable) lookup(addr netip.AddrPort) (PlayerRef, bool) {
+	t.mu.RLock()
+	ref, ok := t.players[addr]
+	t.mu.RUnlock()
+	return ref, ok
+}
+
+// Must be called with t.mu held.
+func (t *GameTable) allocate(variant *BoardVariant) *GameState {
+	game := &GameState{GameID: t.nextGameID}
+	game.Board.Variant = variant
+	t.nextGameID++
+
+	if n := len(t.free); n > 0 {
+		game.Slot = t.free[n-1]
+		t.free = t.free[:n-1]
+		t.slots[game.Slot] = game
+	} else {
+		game.Slot = len(t.slots)
+		t.slots = append(t.slots, game)
+	}
+
+	t.games[game.GameID] = game
+	t.count++
+	return game
+}
+
+// Drops a closed game from the table and the player index. The game must
+// not be locked by the caller; its addresses no longer change once closed.
+func (t *GameTable) release(game *GameState) {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	if game.Slot < 0 || t.slots[game.Slot] != game {
+		return
+	}
+
+	for seat, addr := range [2]netip.AddrPort{game.Player1Addr, game.Player2Addr} {
+		if ref, ok := t.players[addr]; ok && ref.Game == game && ref.Seat == seat {
+			delete(t.players, addr)
+		}
+	}
+
+	delete(t.games, game.GameID)
+	t.slots[game.Slot] = nil
+	t.free = append(t.free, game.Slot)
+	game.Slot = -1
+	t.count--
+}
@@ -0,0 +1,625 @@
+/**
+ * Headless load generator for the game server.
+ *
+ *   make loadgen
+ *   ./loadgen -n 10000 -d 30
+ *
+ * Simulates N players from one process, one UDP socket each, all driven by
+ * a single epoll loop. Players connect, play a legal move whenever it is
+ * their turn and report move -> state round trips, timed from the first
+ * send of each move, when the run ends.
+ * With -a ms they play the solver's best move instead, searched within that
+ * many milliseconds per move. -w adds spectators that watch the server's
+ * top game and count the states fanned out to them. -R spreads the
+ * players' ratings over that many points so matchmaking has buckets to
+ * pair across; connect latency is the time until a player is matched.
+ * Run the server with -log-level warn so it measures the game loop rather
+ * than stdout.
+ */
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "board.c"
+#include "protocol.c"
+#include "solver.c"
+#include "work_pool.c"
+
+#define DEFAULT_PLAYERS 1000
+#define DEFAULT_DURATION 10
+#define DEFAULT_CONNECT_RATE 5000
+#define RETRY_TIMEOUT_NS 1000000000LL
+#define MOVE_RETRY_NS 200000000LL // unacked move, resent under its sequence
+#define MAX_EVENTS 1024
+#define MAX_SAMPLES (1 << 24)
+
+typedef enum
+{
+  P_IDLE,
+  P_CONNECTING,
+  P_WAITING,
+  P_PLAYING,
+  P_SPECTATING,
+} PlayerPhase;
+
+typedef struct Player
+{
+  int fd;
+  bool spectator;
+  PlayerPhase phase;
+  int player_id;
+  uint16_t send_seq;
+  uint16_t state_seq;
+  bool have_state;
+  int32_t watching; // game a spectator follows, valid with have_state
+  int32_t finished; // game a spectator saw end, late states of it are ignored
+  struct GameState state;
+
+  int64_t connect_sent_ns; // first request, for the latency
+  int64_t connect_renewed_ns;
+  int64_t move_sent_ns;   // first send, for the round trip
+  int64_t move_resent_ns; // last send, for the retry timer
+  int64_t spectate_sent_ns;
+  bool awaiting_reply;
+  uint8_t last_move[PROTO_MAX_PACKET];
+  int last_move_len;
+  uint16_t last_move_seq;
+  uint64_t rng;
+  int rating;
+} Player;
+
+typedef struct Samples
+{
+  uint32_t* values; // microseconds
+  size_t count;
+} Samples;
+
+typedef struct Stats
+{
+  Samples connect;
+  Samples rtt;
+  uint64_t connects_sent;
+  uint64_t connect_renewals;
+  uint64_t moves_sent;
+  uint64_t moves_retried; // needed at least one resend
+  uint64_t move_resends;
+  uint64_t states_received;
+  uint64_t bytes_sent;
+  uint64_t bytes_received;
+  uint64_t games_over;
+  uint64_t spectator_states;
+  uint64_t spectator_skipped; // states a spectator never saw
+} Stats;
+
+static Stats stats;
+static int board_size; // 0 lets the server pick
+static int rating_spread; // 0 leaves players unrated
+static int64_t solver_budget_ns; // 0 for cheap random bots
+static WorkPool solver_pool;
+static SolverResult solver_result;
+
+static int64_t
+now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void
+sample_add(Samples* samples, int64_t ns)
+{
+  if (samples->count < MAX_SAMPLES) {
+    samples->values[samples->count++] = (uint32_t)(ns / 1000);
+  }
+}
+
+static int
+compare_u32(const void* a, const void* b)
+{
+  uint32_t x = *(const uint32_t*)a;
+  uint32_t y = *(const uint32_t*)b;
+  return (x > y) - (x < y);
+}
+
+static uint32_t
+percentile(Samples* samples, double p)
+{
+  if (samples->count == 0) {
+    return 0;
+  }
+  size_t i = (size_t)(p * (double)(samples->count - 1));
+  return samples->values[i];
+}
+
+static uint64_t
+player_random(Player* player)
+{
+  player->rng ^= player->rng << 13;
+  player->rng ^= player->rng >> 7;
+  player->rng ^= player->rng << 17;
+  return player->rng;
+}
+
+static void
+player_send(Player* player, const uint8_t* data, int len)
+{
+  if (send(player->fd, data, len, 0) == -1) {
+    if (errno != EAGAIN && errno != ECONNREFUSED) {
+      perror("send() failed");
+    }
+    return;
+  }
+  stats.bytes_sent += len;
+}
+
+static void
+player_connect(Player* player, int64_t now)
+{
+  uint8_t buffer[PROTO_MAX_PACKET];
+  if (player->phase == P_CONNECTING) {
+    stats.connect_renewals++;
+  } else {
+    player->connect_sent_ns = now;
+    stats.connects_sent++;
+  }
+  player->phase = P_CONNECTING;
+  player->connect_renewed_ns = now;
+  int rating = rating_spread > 0 ? player->rating : -1;
+  player_send(player,
+              buffer,
+              proto_encode_connect(
+                buffer, player->send_seq++, board_size, rating));
+}
+
+// Subscribes to the game being watched, or the server's pick before the
+// first state; sent again every PROTO_SPECTATE_RENEW_MS to stay subscribed.
+static void
+player_spectate(Player* player, int64_t now, bool leave)
+{
+  uint8_t buffer[PROTO_MAX_PACKET];
+  int32_t game_id = player->have_state ? player->watching : 0;
+  player->phase = P_SPECTATING;
+  player->spectate_sent_ns = now;
+  player_send(player,
+              buffer,
+              proto_encode_spectate(
+                buffer, player->send_seq++, game_id, player->state_seq, leave));
+}
+
+// Picks a swap that makes a match, starting from a random position so the
+// bots do not all hammer the same corner. Falls back to any swap when the
+// board has none, which the server simply reverts.
+static void
+player_choose_move(Player* player, int* fx, int* fy, int* tx, int* ty)
+{
+  Board board;
+  BoardMatches matches;
+  const int size = player->state.board_size;
+  board_from_tiles(&board, size, player->state.board);
+
+  if (solver_budget_ns > 0 &&
+      solver_solve(&solver_pool,
+                   &board,
+                   player->state.rng,
+                   work_pool_now_ns() + solver_budget_ns,
+                   &solver_result)) {
+    const SolverMove* best = &solver_result.moves[0];
+    *fx = best->from_x, *fy = best->from_y, *tx = best->to_x, *ty = best->to_y;
+    return;
+  }
+
+  const int swaps = size * (size - 1) * 2;
+  int start = (int)(player_random(player) % swaps);
+
+  for (int k = 0; k < swaps; k++) {
+    int i = (start + k) % swaps;
+    int horizontal = i < swaps / 2;
+    int j = horizontal ? i : i - swaps / 2;
+    int x = horizontal ? j % (size - 1) : j % size;
+    int y = horizontal ? j / (size - 1) : j / size;
+    int x2 = horizontal ? x + 1 : x;
+    int y2 = horizontal ? y : y + 1;
+
+    Board probe = board;
+    board_swap(&probe, x, y, x2, y2);
+    if (board_find_matches(&probe, &matches)) {
+      *fx = x, *fy = y, *tx = x2, *ty = y2;
+      return;
+    }
+  }
+
+  *fx = 0, *fy = 0, *tx = 1, *ty = 0;
+}
+
+static void
+player_move(Player* player, int64_t now)
+{
+  int fx, fy, tx, ty;
+  player_choose_move(player, &fx, &fy, &tx, &ty);
+
+  player->last_move_seq = player->send_seq++;
+  player->last_move_len = proto_encode_move(player->last_move,
+                                            player->last_move_seq,
+                                            player->player_id,
+                                            fx,
+                                            fy,
+                                            tx,
+                                            ty);
+  player_send(player, player->last_move, player->last_move_len);
+  player->move_sent_ns = now;
+  player->move_resent_ns = now;
+  player->awaiting_reply = true;
+  stats.moves_sent++;
+}
+
+static void
+player_receive(Player* player, const uint8_t* data, int len, int64_t now)
+{
+  PacketHeader header;
+  if (!proto_read_header(data, len, &header)) {
+    return;
+  }
+
+  stats.bytes_received += len;
+
+  if (header.opcode == OP_PLAYER_ID) {
+    if (player->phase == P_CONNECTING &&
+        proto_decode_player_id(data, len, &player->player_id)) {
+      sample_add(&stats.connect, now - player->connect_sent_ns);
+      player->phase = P_WAITING;
+      player->have_state = false;
+    }
+    return;
+  }
+
+  if (header.opcode != OP_STATE) {
+    return;
+  }
+
+  // a resent state keeps its sequence but may ack the move in flight
+  if (player->have_state && proto_seq_newer(player->state_seq, header.seq)) {
+    return;
+  }
+  if (!proto_decode_state(data, len, &player->state)) {
+    return;
+  }
+
+  if (player->spectator) {
+    if (player->state.game_id == player->finished) {
+      return;
+    }
+    if (player->have_state && player->state.game_id != player->watching) {
+      // a renewal sent before the first state arrived picked a second game
+      uint8_t buffer[PROTO_MAX_PACKET];
+      player_send(player,
+                  buffer,
+                  proto_encode_spectate(buffer,
+                                        player->send_seq++,
+                                        player->state.game_id,
+                                        header.seq,
+                                        true));
+      return;
+    }
+    if (player->have_state && header.seq == player->state_seq) {
+      return;
+    }
+    player->watching = player->state.game_id;
+    stats.spectator_states++;
+    if (player->have_state) {
+      stats.spectator_skipped += (uint16_t)(header.seq - player->state_seq - 1);
+    }
+    player->have_state = !player->state.game_over;
+    player->state_seq = header.seq;
+    if (player->state.game_over) {
+      player->finished = player->state.game_id;
+      player->phase = P_IDLE;
+    }
+    return;
+  }
+
+  player->have_state = true;
+  player->state_seq = header.seq;
+  stats.states_received++;
+
+  if (player->awaiting_reply &&
+      !proto_seq_newer(player->last_move_seq,
+                       player->state.move_ack[player->player_id])) {
+    sample_add(&stats.rtt, now - player->move_sent_ns);
+    player->awaiting_reply = false;
+  }
+
+  if (player->state.game_over) {
+    stats.games_over++;
+    player->phase = P_IDLE;
+    return;
+  }
+
+  if (player->state.game_started) {
+    player->phase = P_PLAYING;
+    if (player->state.current_turn == player->player_id &&
+        !player->awaiting_reply) {
+      player_move(player, now);
+    }
+  }
+}
+
+static void
+player_check_timeouts(Player* player, int64_t now)
+{
+  if (player->phase == P_CONNECTING &&
+      now - player->connect_renewed_ns > PROTO_QUEUE_RENEW_MS * 1000000LL) {
+    // renews the ticket while queued, or retries a lost request
+    player_connect(player, now);
+  } else if (player->phase == P_SPECTATING &&
+             now - player->spectate_sent_ns >
+               PROTO_SPECTATE_RENEW_MS * 1000000LL) {
+    player_spectate(player, now, false);
+  } else if (player->awaiting_reply &&
+             now - player->move_resent_ns > MOVE_RETRY_NS) {
+    // the move or its state was dropped, or is only late; the server
+    // answers a duplicate with the current state either way
+    if (player->move_resent_ns == player->move_sent_ns) {
+      stats.moves_retried++;
+    }
+    stats.move_resends++;
+    player_send(player, player->last_move, player->last_move_len);
+    player->move_resent_ns = now;
+  }
+}
+
+static void
+raise_fd_limit(int wanted)
+{
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)wanted) {
+    limit.rlim_cur =
+      limit.rlim_max < (rlim_t)wanted ? (rlim_t)limit.rlim_max : (rlim_t)wanted;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+static void
+report(double seconds, int players, int spectators)
+{
+  qsort(stats.connect.values, stats.connect.count, sizeof(uint32_t), compare_u32);
+  qsort(stats.rtt.values, stats.rtt.count, sizeof(uint32_t), compare_u32);
+
+  uint64_t answered = stats.rtt.count;
+  double retried =
+    stats.moves_sent
+      ? 100.0 * (double)stats.moves_retried / (double)stats.moves_sent
+      : 0.0;
+
+  printf("players        %d (%zu connected)\n", players, stats.connect.count);
+  printf("duration       %.2f s\n", seconds);
+  printf("connect        p50 %u us  p99 %u us  max %u us  renewals %lu\n",
+         percentile(&stats.connect, 0.50),
+         percentile(&stats.connect, 0.99),
+         percentile(&stats.connect, 1.0),
+         stats.connect_renewals);
+  printf("move -> state  p50 %u us  p99 %u us  p999 %u us  max %u us\n",
+         percentile(&stats.rtt, 0.50),
+         percentile(&stats.rtt, 0.99),
+         percentile(&stats.rtt, 0.999),
+         percentile(&stats.rtt, 1.0));
+  printf("moves          %lu sent  %lu answered  %lu retried (%.3f%%)  "
+         "%lu resends\n",
+         stats.moves_sent,
+         answered,
+         stats.moves_retried,
+         retried,
+         stats.move_resends);
+  printf("throughput     %.0f moves/s  %.0f states/s\n",
+         (double)answered / seconds,
+         (double)stats.states_received / seconds);
+  printf("bandwidth      %.1f KB/s out  %.1f KB/s in\n",
+         (double)stats.bytes_sent / seconds / 1024.0,
+         (double)stats.bytes_received / seconds / 1024.0);
+  printf("games over     %lu\n", stats.games_over);
+  if (spectators > 0) {
+    printf("spectators     %d  %.0f states/s  %lu skipped\n",
+           spectators,
+           (double)stats.spectator_states / seconds,
+           stats.spectator_skipped);
+  }
+}
+
+static void
+usage(const char* name)
+{
+  fprintf(stderr,
+          "usage: %s [-n players] [-d seconds] [-r connects/s] "
+          "[-b board size] [-s host] [-p port] [-a solver ms] "
+          "[-w spectators] [-R rating spread]\n",
+          name);
+  exit(2);
+}
+
+int
+main(int argc, char** argv)
+{
+  int players = DEFAULT_PLAYERS;
+  int spectators = 0;
+  int duration = DEFAULT_DURATION;
+  int connect_rate = DEFAULT_CONNECT_RATE;
+  const char* host = "127.0.0.1";
+  int port = 8080;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:d:r:b:s:p:a:w:R:")) != -1) {
+    switch (opt) {
+      case 'n':
+        players = atoi(optarg);
+        break;
+      case 'd':
+        duration = atoi(optarg);
+        break;
+      case 'r':
+        connect_rate = atoi(optarg);
+        break;
+      case 'b':
+        board_size = atoi(optarg);
+        break;
+      case 's':
+        host = optarg;
+        break;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'a':
+        solver_budget_ns = (int64_t)(atof(optarg) * 1e6);
+        break;
+      case 'w':
+        spectators = atoi(optarg);
+        break;
+      case 'R':
+        rating_spread = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (players <= 0 || spectators < 0 || duration <= 0 || connect_rate <= 0 ||
+      rating_spread < 0 ||
+      (board_size != 0 && !board_size_supported(board_size))) {
+    usage(argv[0]);
+  }
+
+  int clients = players + spectators;
+  raise_fd_limit(clients + 64);
+  if (solver_budget_ns > 0) {
+    work_pool_init(&solver_pool, 0);
+  }
+
+  struct sockaddr_in server_addr;
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(port);
+  server_addr.sin_addr.s_addr = inet_addr(host);
+
+  stats.connect.values = malloc(sizeof(uint32_t) * MAX_SAMPLES);
+  stats.rtt.values = malloc(sizeof(uint32_t) * MAX_SAMPLES);
+  Player* pool = calloc(clients, sizeof(Player));
+  if (!stats.connect.values || !stats.rtt.values || !pool) {
+    perror("malloc");
+    return 1;
+  }
+
+  int epfd = epoll_create1(0);
+  if (epfd == -1) {
+    perror("epoll_create1");
+    return 1;
+  }
+
+  for (int i = 0; i < clients; i++) {
+    Player* player = &pool[i];
+    player->spectator = i >= players;
+    player->rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(i + 1);
+    if (rating_spread > 0) {
+      player->rating = (int)(player_random(player) % (uint64_t)rating_spread);
+    }
+    player->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, IPPROTO_UDP);
+    if (player->fd == -1) {
+      perror("socket");
+      return 1;
+    }
+    if (connect(player->fd,
+                (struct sockaddr*)&server_addr,
+                sizeof(server_addr)) == -1) {
+      perror("connect");
+      return 1;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = player };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, player->fd, &ev) == -1) {
+      perror("epoll_ctl");
+      return 1;
+    }
+  }
+
+  struct epoll_event events[MAX_EVENTS];
+  uint8_t buffer[512];
+
+  int64_t start = now_ns();
+  int64_t end = start + (int64_t)duration * 1000000000LL;
+  int64_t last_sweep = start;
+  int next_connect = 0;
+
+  for (;;) {
+    int64_t now = now_ns();
+    if (now >= end) {
+      break;
+    }
+
+    // ramp connections up at the configured rate
+    int64_t due = (now - start) * connect_rate / 1000000000LL;
+    while (next_connect < clients && next_connect < due) {
+      Player* player = &pool[next_connect++];
+      if (player->spectator) {
+        player_spectate(player, now, false);
+      } else {
+        player_connect(player, now);
+      }
+    }
+
+    int ready = epoll_wait(epfd, events, MAX_EVENTS, 5);
+    now = now_ns();
+
+    for (int i = 0; i < ready; i++) {
+      Player* player = (Player*)events[i].data.ptr;
+      for (;;) {
+        int len = recv(player->fd, buffer, sizeof(buffer), 0);
+        if (len <= 0) {
+          break;
+        }
+        player_receive(player, buffer, len, now);
+      }
+    }
+
+    // retry lost packets and re-queue players whose game ended
+    if (now - last_sweep > RETRY_TIMEOUT_NS / 10) {
+      last_sweep = now;
+      for (int i = 0; i < next_connect; i++) {
+        if (pool[i].phase == P_IDLE && pool[i].spectator) {
+          player_spectate(&pool[i], now, false);
+        } else if (pool[i].phase == P_IDLE) {
+          player_connect(&pool[i], now);
+        } else {
+          player_check_timeouts(&pool[i], now);
+        }
+      }
+    }
+  }
+
+  double seconds = (double)(now_ns() - start) / 1e9;
+
+  for (int i = 0; i < clients; i++) {
+    uint8_t* out = buffer;
+    if (pool[i].spectator) {
+      player_spectate(&pool[i], now_ns(), true);
+    } else {
+      player_send(&pool[i], out, proto_encode_request(out, OP_DISCONNECT, 0));
+    }
+    close(pool[i].fd);
+  }
+  close(epfd);
+
+  report(seconds, players, spectators);
+
+  if (solver_budget_ns > 0) {
+    work_pool_destroy(&solver_pool);
+  }
+  free(pool);
+  free(stats.connect.values);
+  free(stats.rtt.values);
+  return 0;
+}
@@ -0,0 +1,264 @@
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"io"
+	"os"
+	"strconv"
+	"strings"
+	"sync/atomic"
+	"time"
+)
+
+type LogLevel int32
+
+const (
+	LOG_DEBUG LogLevel = iota
+	LOG_INFO
+	LOG_WARN
+	LOG_ERROR
+	LOG_OFF
+)
+
+type LogCategory int
+
+const (
+	CAT_SERVER LogCategory = iota
+	CAT_NET
+	CAT_GAME
+	CAT_MOVE
+	CAT_BOARD
+	CAT_COUNT
+)
+
+const (
+	LOG_RING_SIZE     = 1 << 14
+	LOG_FLUSH_TIMEOUT = 100 * time.Millisecond
+)
+
+var (
+	levelNames    = [...]string{"DEBUG", "INFO", "WARN", "ERROR", "OFF"}
+	categoryNames = [...]string{"server", "net", "game", "move", "board"}
+)
+
+// Slot in the log ring. seq follows Vyukov's bounded queue: a producer may
+// claim the slot at position pos when seq == pos, and the writer may read it
+// once seq == pos+1.
+type logEntry struct {
+	seq    atomic.Uint64
+	at     time.Time
+	level  LogLevel
+	cat    LogCategory
+	format string
+	args   []any
+}
+
+// Leveled logger. Producers never block and never format; entries go into
+// a lock-free ring that a single background goroutine formats and writes.
+// When the ring is full the entry is dropped and counted.
+type Logger struct {
+	level   atomic.Int32
+	sample  [CAT_COUNT]atomic.Uint32
+	counter [CAT_COUNT]atomic.Uint32
+
+	ring []logEntry
+	mask uint64
+	head atomic.Uint64
+	tail uint64
+
+	wake    chan struct{}
+	done    chan struct{}
+	closed  atomic.Bool
+	dropped atomic.Uint64
+	out     *bufio.Writer
+}
+
+var logger = newLogger(os.Stdout, LOG_RING_SIZE)
+
+func newLogger(w io.Writer, size int) *Logger {
+	l := &Logger{
+		ring: make([]logEntry, size),
+		mask: uint64(size - 1),
+		wake: make(chan struct{}, 1),
+		done: make(chan struct{}),
+		out:  bufio.NewWriterSize(w, 64*1024),
+	}
+	for i := range l.ring {
+		l.ring[i].seq.Store(uint64(i))
+	}
+	l.level.Store(int32(LOG_INFO))
+	go l.run()
+	return l
+}
+
+// Cheap check for the hot path. Callers that would allocate arguments
+// should guard with it and then call logWrite:
+//
+//	if logEnabled(CAT_NET, LOG_DEBUG) {
+//		logWrite(CAT_NET, LOG_DEBUG, "...", args...)
+//	}
+//
+// Debug and info entries are sampled per category; warnings and errors
+// always pass.
+func logEnabled(cat LogCategory, level LogLevel) bool {
+	if int32(level) < logger.level.Load() {
+		return false
+	}
+	if level >= LOG_WARN {
+		return true
+	}
+	n := logger.sample[cat].Load()
+	return n <= 1 || logger.counter[cat].Add(1)%n == 0
+}
+
+func logWrite(cat LogCategory, level LogLevel, format string, args ...any) {
+	logger.push(cat, level, format, args)
+}
+
+func logf(cat LogCategory, level LogLevel, format string, args ...any) {
+	if logEnabled(cat, level) {
+		logger.push(cat, level, format, args)
+	}
+}
+
+func (l *Logger) push(cat LogCategory, level LogLevel, format string, args []any) {
+	pos := l.head.Load()
+	for {
+		e := &l.ring[pos&l.mask]
+		seq := e.seq.Load()
+		switch diff := int64(seq) - int64(pos); {
+		case diff == 0:
+			if l.head.CompareAndSwap(pos, pos+1) {
+				e.at = time.Now()
+				e.level = level
+				e.cat = cat
+				e.format = format
+				e.args = args
+				e.seq.Store(pos + 1)
+
+				select {
+				case l.wake <- struct{}{}:
+				default:
+				}
+				return
+			}
+			pos = l.head.Load()
+		case diff < 0:
+			l.dropped.Add(1)
+			return
+		default:
+			pos = l.head.Load()
+		}
+	}
+}
+
+// Writes every published entry, returns false when the ring was empty.
+func (l *Logger) drain() bool {
+	wrote := false
+	for {
+		e := &l.ring[l.tail&l.mask]
+		if e.seq.Load() != l.tail+1 {
+			break
+		}
+
+		l.out.WriteString(e.at.Format("15:04:05.000000 "))
+		fmt.Fprintf(l.out, "%-5s %s: ", levelNames[e.level], categoryNames[e.cat])
+		fmt.Fprintf(l.out, e.format, e.args...)
+		l.out.WriteByte('\n')
+
+		e.args = nil
+		e.seq.Store(l.tail + l.mask + 1)
+		l.tail++
+		wrote = true
+	}
+
+	if n := l.dropped.Swap(0); n > 0 {
+		fmt.Fprintf(l.out, "%s WARN  server: log ring full, dropped %d entries\n",
+			time.Now().Format("15:04:05.000000"), n)
+	}
+	return wrote
+}
+
+func (l *Logger) run() {
+	ticker := time.NewTicker(LOG_FLUSH_TIMEOUT)
+	defer ticker.Stop()
+
+	for {
+		if !l.drain() {
+			l.out.Flush()
+			if l.closed.Load() {
+				close(l.done)
+				return
+			}
+			select {
+			case <-l.wake:
+			case <-ticker.C:
+			}
+		}
+	}
+}
+
+// Flushes everything queued so far and stops the writer.
+func (l *Logger) Close() {
+	if l.closed.Swap(true) {
+		return
+	}
+	select {
+	case l.wake <- struct{}{}:
+	default:
+	}
+	<-l.done
+}
+
+func parseLogLevel(name string) (LogLevel, bool) {
+	for i, n := range levelNames {
+		if strings.EqualFold(n, name) {
+			return LogLevel(i), true
+		}
+	}
+	return LOG_INFO, false
+}
+
+// Parses "net=100,board=10": keep one in N debug/info entries per category.
+func parseLogSampling(spec string) error {
+	if spec == "" {
+		return nil
+	}
+	for _, part := range strings.Split(spec, ",") {
+		name, rate, ok := strings.Cut(part, "=")
+		if !ok {
+			return fmt.Errorf("bad sampling entry %q", part)
+		}
+		n, err := strconv.ParseUint(rate, 10, 32)
+		if err != nil {
+			return fmt.Errorf("bad sampling rate %q", part)
+		}
+		found := false
+		for i, c := range categoryNames {
+			if c == name {
+				logger.sample[i].Store(uint32(n))
+				found = true
+			}
+		}
+		if !found {
+			return fmt.Errorf("unknown log category %q", name)
+		}
+	}
+	return nil
+}
+
+// Board formatted lazily by the writer goroutine, one row per line.
+type boardDump Board
+
+func (b boardDump) String() string {
+	var sb strings.Builder
+	for i := 0; i < b.Variant.Size; i++ {
+		sb.WriteString("\n\t")
+		for j := 0; j < b.Variant.Size; j++ {
+			sb.WriteString(tileToString(b.Cells[i][j]))
+			sb.WriteByte(' ')
+		}
+	}
+	return sb.String()
+}
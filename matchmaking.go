@@ -0,0 +1,195 @@
+/**
+ * Matchmaking. OP_CONNECT queues the sender under the board size it asked
+ * for and a bucket of its rating; a game is only allocated once two queued
+ * players are paired, so players waiting for an opponent hold no game slot.
+ *
+ * A bucket never holds more than one ticket, the next arrival is paired
+ * with it right away, so queuing and pairing cost O(1). A ticket that has
+ * waited matchMaxWait starts accepting players one bucket further away,
+ * and one more for every matchMaxWait after that.
+ */
+package main
+
+import (
+	"net/netip"
+	"time"
+)
+
+const (
+	RATING_BUCKETS        = 32
+	RATING_DEFAULT        = 1500 // for players that send no rating
+	DEFAULT_RATING_BUCKET = 100  // rating points per bucket
+	MATCH_MAX_WAIT        = 5 * time.Second
+	MATCH_TICK            = 250 * time.Millisecond // widening and expiry
+	QUEUE_TIMEOUT         = 5 * time.Second        // without a repeated OP_CONNECT
+)
+
+var (
+	ratingBucket = DEFAULT_RATING_BUCKET
+	matchMaxWait = MATCH_MAX_WAIT
+)
+
+type Ticket struct {
+	Addr     netip.AddrPort
+	Rating   int
+	Variant  *BoardVariant
+	Bucket   int
+	Queued   int64 // unix nanoseconds
+	LastSeen int64 // of the last OP_CONNECT
+}
+
+// Players waiting for an opponent, one slot per board variant and rating
+// bucket. Protected by table.mu.
+type MatchQueue struct {
+	slots   [BOARD_VARIANTS][RATING_BUCKETS]*Ticket
+	tickets map[netip.AddrPort]*Ticket
+}
+
+func bucketOf(rating int) int {
+	return min(max(rating/ratingBucket, 0), RATING_BUCKETS-1)
+}
+
+// Buckets away from its own the ticket accepts an opponent from.
+func (ticket *Ticket) reach(now int64) int {
+	return int((now - ticket.Queued) / int64(matchMaxWait))
+}
+
+func (q *MatchQueue) add(ticket *Ticket) {
+	q.slots[ticket.Variant.index][ticket.Bucket] = ticket
+	q.tickets[ticket.Addr] = ticket
+}
+
+func (q *MatchQueue) remove(ticket *Ticket) {
+	q.slots[ticket.Variant.index][ticket.Bucket] = nil
+	delete(q.tickets, ticket.Addr)
+}
+
+// The oldest queued ticket that ticket may play, nearest bucket first.
+// Two tickets pair when either one's reach covers the distance between
+// their buckets. Tickets whose renewals stopped are dropped on the way.
+func (q *MatchQueue) partner(ticket *Ticket, now int64) *Ticket {
+	slots := &q.slots[ticket.Variant.index]
+	expired := now - int64(QUEUE_TIMEOUT)
+	reach := ticket.reach(now)
+
+	var found *Ticket
+	for d := 0; d < RATING_BUCKETS && found == nil; d++ {
+		for _, b := range [2]int{ticket.Bucket - d, ticket.Bucket + d} {
+			if b < 0 || b >= RATING_BUCKETS {
+				continue
+			}
+			other := slots[b]
+			if other == nil || other == ticket {
+				continue
+			}
+			if other.LastSeen < expired {
+				if logEnabled(CAT_GAME, LOG_INFO) {
+					logWrite(CAT_GAME, LOG_INFO, "Queued player %v timed out", other.Addr)
+				}
+				q.remove(other)
+				continue
+			}
+			if d <= max(reach, other.reach(now)) && (found == nil || other.Queued < found.Queued) {
+				found = other
+			}
+		}
+	}
+	return found
+}
+
+// Queues the player, or pairs them with a waiting one and returns the game
+// startGame opened for them. A player already queued only renews their
+// ticket. Must be called with t.mu held.
+func (t *GameTable) join(out *Outbox, addr netip.AddrPort, variant *BoardVariant, rating int, now int64) *GameState {
+	if ticket, ok := t.queue.tickets[addr]; ok {
+		ticket.LastSeen = now
+		if logEnabled(CAT_GAME, LOG_DEBUG) {
+			logWrite(CAT_GAME, LOG_DEBUG, "Player %v still queued", addr)
+		}
+		return nil
+	}
+
+	ticket := &Ticket{
+		Addr:     addr,
+		Rating:   rating,
+		Variant:  variant,
+		Bucket:   bucketOf(rating),
+		Queued:   now,
+		LastSeen: now,
+	}
+	if other := t.queue.partner(ticket, now); other != nil {
+		t.queue.remove(other)
+		return t.startGame(out, other, ticket, now)
+	}
+	t.queue.add(ticket)
+	if logEnabled(CAT_GAME, LOG_DEBUG) {
+		logWrite(CAT_GAME, LOG_DEBUG, "Player %v queued for a %dx%d game, rating %d",
+			addr, variant.Size, variant.Size, rating)
+	}
+	return nil
+}
+
+// Drops addr from the queue, false if it was not queued.
+func (t *GameTable) leaveQueue(addr netip.AddrPort) bool {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	ticket, ok := t.queue.tickets[addr]
+	if ok {
+		t.queue.remove(ticket)
+	}
+	return ok
+}
+
+// Expires silent tickets and pairs the ones whose reach grew since they
+// were queued. Only one ticket per bucket is ever waiting, so this costs
+// BOARD_VARIANTS * RATING_BUCKETS slots however many players are queued.
+// The games it starts are appended to started, for begin once t.mu is
+// released.
+func (t *GameTable) sweepQueue(out *Outbox, now int64, started []*GameState) []*GameState {
+	t.mu.Lock()
+	defer t.mu.Unlock()
+
+	expired := now - int64(QUEUE_TIMEOUT)
+	for v := range t.queue.slots {
+		slots := &t.queue.slots[v]
+		for b := range slots {
+			ticket := slots[b]
+			if ticket == nil {
+				continue
+			}
+			if ticket.LastSeen < expired {
+				if logEnabled(CAT_GAME, LOG_INFO) {
+					logWrite(CAT_GAME, LOG_INFO, "Queued player %v timed out", ticket.Addr)
+				}
+				t.queue.remove(ticket)
+				continue
+			}
+			if ticket.reach(now) == 0 {
+				continue
+			}
+			if other := t.queue.partner(ticket, now); other != nil {
+				t.queue.remove(ticket)
+				t.queue.remove(other)
+				if other.Queued < ticket.Queued {
+					ticket, other = other, ticket
+				}
+				started = append(started, t.startGame(out, ticket, other, now))
+			}
+		}
+	}
+	return started
+}
+
+func runMatchmaker(out *Outbox) {
+	ticker := time.NewTicker(MATCH_TICK)
+	defer ticker.Stop()
+	var started []*GameState
+	for now := range ticker.C {
+		started = table.sweepQueue(out, now.UnixNano(), started[:0])
+		for _, game := range started {
+			game.begin(out)
+		}
+		out.flush()
+	}
+}
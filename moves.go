@@ -0,0 +1,181 @@
+/**
+ * Legal-move index of a game board. One bit per adjacent swap says whether
+ * the swap completes a match, so a move that would score nothing is turned
+ * away without touching the board, and a board with no bits left is known
+ * to be dead without searching it.
+ *
+ * The bits are kept current incrementally: cells the cascade changes are
+ * marked dirty, and refresh re-evaluates only the swaps whose neighborhood
+ * includes a dirty cell.
+ */
+package main
+
+import "math/bits"
+
+// Deals tried before falling back to the staggered pattern.
+const DEAL_ATTEMPTS = 8
+
+type MoveIndex struct {
+	across [BOARD_MAX_SIZE]uint16 // bit x of row y: (x,y) <-> (x+1,y) matches
+	down   [BOARD_MAX_SIZE]uint16 // bit x of row y: (x,y) <-> (x,y+1) matches
+	dirty  [BOARD_MAX_SIZE]uint16 // bit x of row y: cell changed since refresh
+	drops  [BOARD_MAX_SIZE]int8   // per column, rows from the top that fell or refilled
+	count  int                    // legal swaps
+}
+
+// O(1) check of a move that is in bounds and adjacent.
+func (m *MoveIndex) legal(move *PlayerMove) bool {
+	x, y := min(move.FromX, move.ToX), min(move.FromY, move.ToY)
+	if move.FromY == move.ToY {
+		return m.across[y]>>x&1 != 0
+	}
+	return m.down[y]>>x&1 != 0
+}
+
+func (m *MoveIndex) touch(x, y int) {
+	m.dirty[y] |= 1 << x
+}
+
+// A cleared cell makes everything above it in its column fall or refill.
+func (m *MoveIndex) cleared(p Point) {
+	if int8(p.y+1) > m.drops[p.x] {
+		m.drops[p.x] = int8(p.y + 1)
+	}
+}
+
+func (m *MoveIndex) rebuild(b *Board) {
+	for y := 0; y < b.Size(); y++ {
+		m.dirty[y] = ^uint16(0)
+	}
+	m.refresh(b)
+}
+
+// Re-evaluates the swaps that can see a dirty cell. A swap across (x,y)
+// reads row y from x-2 to x+3 and columns x and x+1 from y-2 to y+2; a swap
+// down reads column x from y-2 to y+3 and rows y and y+1 from x-2 to x+2.
+func (m *MoveIndex) refresh(b *Board) {
+	size := b.Size()
+	for x, rows := range m.drops[:size] {
+		for y := 0; y < int(rows); y++ {
+			m.dirty[y] |= 1 << x
+		}
+		m.drops[x] = 0
+	}
+
+	var stale [2][BOARD_MAX_SIZE]uint16
+	for y := 0; y < size; y++ {
+		near := uint16(0) // dirty cells within two rows of y
+		for d := max(y-2, 0); d <= min(y+2, size-1); d++ {
+			near |= m.dirty[d]
+		}
+		row := m.dirty[y]
+		stale[0][y] = row<<2 | row<<1 | row | row>>1 | row>>2 | row>>3 | near | near>>1
+
+		if y+1 < size {
+			pair := m.dirty[y] | m.dirty[y+1]
+			if y+3 < size {
+				near |= m.dirty[y+3]
+			}
+			stale[1][y] = pair<<2 | pair<<1 | pair | pair>>1 | pair>>2 | near
+		}
+	}
+	for y := 0; y < size; y++ {
+		m.dirty[y] = 0
+	}
+
+	cells := &b.Cells
+	for y := 0; y < size; y++ {
+		for dir, legal := range [2]*uint16{&m.across[y], &m.down[y]} {
+			dx, dy := 1-dir, dir
+			lanes := uint16(1)<<(size-dx) - 1
+			if y+dy >= size {
+				lanes = 0
+			}
+			old := *legal
+			for check := stale[dir][y] & lanes; check != 0; check &= check - 1 {
+				x := bits.TrailingZeros16(check)
+				if swapMatches(cells, size, x, y, x+dx, y+dy) {
+					*legal |= 1 << x
+				} else {
+					*legal &^= 1 << x
+				}
+			}
+			*legal &= lanes
+			m.count += bits.OnesCount16(*legal) - bits.OnesCount16(old)
+		}
+	}
+}
+
+// Whether swapping the two cells of a stable board completes a match.
+func swapMatches(cells *Cells, size, x1, y1, x2, y2 int) bool {
+	a, b := cells[y1][x1], cells[y2][x2]
+	if a == b {
+		return false
+	}
+	cells[y1][x1], cells[y2][x2] = b, a
+	found := matchesAt(cells, size, x1, y1) || matchesAt(cells, size, x2, y2)
+	cells[y1][x1], cells[y2][x2] = a, b
+	return found
+}
+
+// Whether the cell is part of a run of MIN_MATCH along its row or column.
+func matchesAt(cells *Cells, size, x, y int) bool {
+	t := cells[y][x]
+	if t == Empty {
+		return false
+	}
+	left, right := x, x
+	for left > 0 && cells[y][left-1] == t {
+		left--
+	}
+	for right < size-1 && cells[y][right+1] == t {
+		right++
+	}
+	if right-left+1 >= MIN_MATCH {
+		return true
+	}
+	top, bottom := y, y
+	for top > 0 && cells[top-1][x] == t {
+		top--
+	}
+	for bottom < size-1 && cells[bottom+1][x] == t {
+		bottom++
+	}
+	return bottom-top+1 >= MIN_MATCH
+}
+
+// Replaces every tile with a fresh deal that has no matches and at least
+// one legal swap, and rebuilds the index. Each cell takes one refill and
+// steps to the next color while it would complete a run with the two cells
+// left of or above it; that excludes at most two of the five colors. If a
+// few deals leave no swap, a staggered pattern that always has one is used.
+func (b *Board) deal(refill func() Tile) {
+	size := b.Size()
+	cells := &b.Cells
+	for attempt := 0; attempt < DEAL_ATTEMPTS; attempt++ {
+		for y := 0; y < size; y++ {
+			for x := 0; x < size; x++ {
+				t := refill()
+				for (x >= 2 && cells[y][x-1] == t && cells[y][x-2] == t) ||
+					(y >= 2 && cells[y-1][x] == t && cells[y-2][x] == t) {
+					t = (t-Red+1)%BOARD_COLORS + Red
+				}
+				cells[y][x] = t
+			}
+		}
+		b.moves.rebuild(b)
+		if b.moves.count > 0 {
+			return
+		}
+	}
+
+	// pairs along rows, shifted one color per row: no runs, and swapping
+	// (2,0) down completes row 1
+	offset := int(refill() - Red)
+	for y := 0; y < size; y++ {
+		for x := 0; x < size; x++ {
+			cells[y][x] = Tile((x/2+y+offset)%BOARD_COLORS) + Red
+		}
+	}
+	b.moves.rebuild(b)
+}
@@ -0,0 +1,257 @@
+#include "net_thread.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "profiler.h"
+
+#define NET_DATAGRAM_MAX 512
+#define NET_PENDING_POLL_MS 4
+
+static void
+net_drop_pending_state(NetThread* net)
+{
+  if (net->have_pending_state) {
+    net->have_pending_state = false;
+    atomic_fetch_add_explicit(&net->dropped_events, 1, memory_order_relaxed);
+  }
+}
+
+// True once nothing is left waiting for the render loop.
+static bool
+net_flush_pending(NetThread* net)
+{
+  if (net->have_pending_id) {
+    if (!NetEventRing_push(&net->inbound, &net->pending_id)) {
+      return false;
+    }
+    net->have_pending_id = false;
+  }
+  if (net->have_pending_state) {
+    if (!NetEventRing_push(&net->inbound, &net->pending_state)) {
+      return false;
+    }
+    net->have_pending_state = false;
+  }
+  return true;
+}
+
+/*
+ * A ring the render loop has not drained yet is full of states it would
+ * throw away, so the newest state waits in a slot of its own and replaces
+ * whatever state is already waiting there. A player id waits too; a state
+ * older than it belongs to the previous game and is dropped.
+ */
+static void
+net_push_event(NetThread* net, NetEvent* event)
+{
+  if (net_flush_pending(net) && NetEventRing_push(&net->inbound, event)) {
+    return;
+  }
+  if (event->type == NET_EVENT_STATE && net->have_pending_state &&
+      proto_seq_newer(net->pending_state.seq, event->seq)) {
+    atomic_fetch_add_explicit(&net->dropped_events, 1, memory_order_relaxed);
+    return;
+  }
+  net_drop_pending_state(net);
+  if (event->type == NET_EVENT_PLAYER_ID) {
+    net->pending_id = *event;
+    net->have_pending_id = true;
+  } else {
+    net->pending_state = *event;
+    net->have_pending_state = true;
+  }
+}
+
+static void
+net_flush_outbound(NetThread* net)
+{
+  NetPacket packet;
+  while (NetPacketRing_pop(&net->outbound, &packet)) {
+    if (sendto(net->sockfd,
+               packet.data,
+               packet.len,
+               0,
+               (struct sockaddr*)&net->server_addr,
+               sizeof(net->server_addr)) == -1) {
+      perror("sendto() failed");
+    }
+  }
+}
+
+static void
+net_drain_socket(NetThread* net)
+{
+  static uint8_t buffers[NET_RECV_BATCH][NET_DATAGRAM_MAX];
+  struct iovec iov[NET_RECV_BATCH];
+  struct mmsghdr msgs[NET_RECV_BATCH];
+
+  for (int i = 0; i < NET_RECV_BATCH; i++) {
+    iov[i].iov_base = buffers[i];
+    iov[i].iov_len = NET_DATAGRAM_MAX;
+    memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  for (;;) {
+    int count = recvmmsg(net->sockfd, msgs, NET_RECV_BATCH, MSG_DONTWAIT, NULL);
+    if (count <= 0) {
+      return;
+    }
+
+    // only the newest state of a batch is worth handing over, the render
+    // loop would throw the older ones away anyway
+    NetEvent latest;
+    bool have_latest = false;
+
+    for (int i = 0; i < count; i++) {
+      const uint8_t* data = buffers[i];
+      int len = (int)msgs[i].msg_len;
+
+      PacketHeader header;
+      if (!proto_read_header(data, len, &header)) {
+        continue;
+      }
+
+      if (header.opcode == OP_PLAYER_ID) {
+        NetEvent event = { .type = NET_EVENT_PLAYER_ID, .seq = header.seq };
+        if (proto_decode_player_id(data, len, &event.player_id)) {
+          if (have_latest) {
+            net_push_event(net, &latest);
+            have_latest = false;
+          }
+          net_push_event(net, &event);
+        }
+      } else if (header.opcode == OP_STATE) {
+        // a resent state keeps its sequence, it may still ack a newer move
+        if (have_latest && proto_seq_newer(latest.seq, header.seq)) {
+          continue;
+        }
+        if (proto_decode_state(data, len, &latest.state)) {
+          latest.type = NET_EVENT_STATE;
+          latest.seq = header.seq;
+          have_latest = true;
+        }
+      }
+    }
+
+    if (have_latest) {
+      net_push_event(net, &latest);
+    }
+
+    if (count < NET_RECV_BATCH) {
+      return;
+    }
+  }
+}
+
+static void*
+net_thread_main(void* arg)
+{
+  NetThread* net = (NetThread*)arg;
+  prof_thread_name("net");
+
+  struct pollfd fds[2] = {
+    { .fd = net->sockfd, .events = POLLIN },
+    { .fd = net->wakefd, .events = POLLIN },
+  };
+
+  while (atomic_load(&net->running)) {
+    // poll briefly while events wait for the render loop to make room
+    bool pending = net->have_pending_id || net->have_pending_state;
+    if (poll(fds, 2, pending ? NET_PENDING_POLL_MS : 100) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("poll() failed");
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      uint64_t wakeups;
+      if (read(net->wakefd, &wakeups, sizeof(wakeups)) == -1) {
+        perror("read() wakefd failed");
+      }
+    }
+
+    net_flush_outbound(net);
+    net_flush_pending(net);
+
+    if (fds[0].revents & POLLIN) {
+      ProfZone zone = prof_begin("net_drain_socket");
+      net_drain_socket(net);
+      prof_end(zone);
+    }
+  }
+
+  return NULL;
+}
+
+bool
+net_thread_start(NetThread* net, int sockfd, struct sockaddr_in* server_addr)
+{
+  net->sockfd = sockfd;
+  net->server_addr = *server_addr;
+  NetEventRing_init(&net->inbound);
+  NetPacketRing_init(&net->outbound);
+  net->have_pending_id = false;
+  net->have_pending_state = false;
+  atomic_init(&net->dropped_events, 0);
+  atomic_init(&net->running, true);
+
+  net->wakefd = eventfd(0, EFD_NONBLOCK);
+  if (net->wakefd == -1) {
+    return false;
+  }
+
+  if (pthread_create(&net->thread, NULL, net_thread_main, net) != 0) {
+    close(net->wakefd);
+    return false;
+  }
+
+  return true;
+}
+
+void
+net_thread_stop(NetThread* net)
+{
+  atomic_store(&net->running, false);
+
+  uint64_t one = 1;
+  if (write(net->wakefd, &one, sizeof(one)) == -1) {
+    perror("write() wakefd failed");
+  }
+
+  pthread_join(net->thread, NULL);
+  close(net->wakefd);
+}
+
+bool
+net_thread_send(NetThread* net, const uint8_t* data, int len)
+{
+  NetPacket packet;
+  packet.len = len;
+  memcpy(packet.data, data, len);
+
+  if (!NetPacketRing_push(&net->outbound, &packet)) {
+    return false;
+  }
+
+  uint64_t one = 1;
+  if (write(net->wakefd, &one, sizeof(one)) == -1) {
+    perror("write() wakefd failed");
+  }
+  return true;
+}
+
+bool
+net_thread_poll(NetThread* net, NetEvent* event)
+{
+  return NetEventRing_pop(&net->inbound, event);
+}
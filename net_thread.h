@@ -0,0 +1,69 @@
+#ifndef __ME_NET_THREAD
+#define __ME_NET_THREAD
+
+#include <netinet/in.h>
+#include <pthread.h>
+
+#include "protocol.h"
+#include "spsc.h"
+
+#define NET_RING_CAPACITY 64
+#define NET_RECV_BATCH 16
+
+typedef enum
+{
+  NET_EVENT_PLAYER_ID,
+  NET_EVENT_STATE,
+} NetEventType;
+
+typedef struct NetEvent
+{
+  NetEventType type;
+  uint16_t seq;
+  int player_id;
+  struct GameState state;
+} NetEvent;
+
+typedef struct NetPacket
+{
+  int len;
+  uint8_t data[PROTO_MAX_PACKET];
+} NetPacket;
+
+SPSC_RING(NetEventRing, NetEvent, NET_RING_CAPACITY)
+SPSC_RING(NetPacketRing, NetPacket, NET_RING_CAPACITY)
+
+typedef struct NetThread
+{
+  int sockfd;
+  int wakefd;
+  struct sockaddr_in server_addr;
+  pthread_t thread;
+  atomic_bool running;
+
+  NetEventRing inbound;  // net thread -> render loop
+  NetPacketRing outbound; // render loop -> net thread
+
+  // events that found the inbound ring full, owned by the net thread and
+  // handed over as soon as the render loop frees a slot
+  NetEvent pending_id;
+  NetEvent pending_state;
+  bool have_pending_id;
+  bool have_pending_state;
+
+  atomic_uint_fast32_t dropped_events; // states superseded while pending
+} NetThread;
+
+bool
+net_thread_start(NetThread* net, int sockfd, struct sockaddr_in* server_addr);
+
+void
+net_thread_stop(NetThread* net);
+
+bool
+net_thread_send(NetThread* net, const uint8_t* data, int len);
+
+bool
+net_thread_poll(NetThread* net, NetEvent* event);
+
+#endif // __ME_NET_THREAD
@@ -0,0 +1,87 @@
+package main
+
+import (
+	"net"
+	"net/netip"
+)
+
+const OUTBOX_SIZE = 64
+
+// Per-goroutine queue of outgoing datagrams. Packets are encoded straight
+// into preallocated slots and sent together by flush, one sendmmsg call per
+// batch where the platform has it. A slot can be queued for several
+// addresses, so a state is encoded once no matter how many receive it.
+//
+// An Outbox is not safe for concurrent use; every goroutine that sends owns
+// one.
+type Outbox struct {
+	conn  *net.UDPConn
+	bufs  [OUTBOX_SIZE][BUFLEN]byte
+	nbufs int
+
+	// queued datagrams, each pointing at a slot in bufs
+	slot  [OUTBOX_SIZE]int
+	size  [OUTBOX_SIZE]int
+	addrs [OUTBOX_SIZE]netip.AddrPort
+	count int
+
+	sys outboxSys
+}
+
+func newOutbox(conn *net.UDPConn) *Outbox {
+	o := &Outbox{conn: conn}
+	o.sys.init(o)
+	return o
+}
+
+// Returns an empty slot to encode the next packet into.
+func (o *Outbox) next() []byte {
+	if o.nbufs == OUTBOX_SIZE || o.count == OUTBOX_SIZE {
+		o.flush()
+	}
+	return o.bufs[o.nbufs][:]
+}
+
+// Queues the n bytes just encoded into the slot returned by next.
+func (o *Outbox) commit(n int, addr netip.AddrPort) {
+	o.nbufs++
+	o.push(o.nbufs-1, n, addr)
+}
+
+// Queues the last committed packet once more for another address.
+func (o *Outbox) repeat(addr netip.AddrPort) {
+	if o.count == OUTBOX_SIZE {
+		// the slot survives a flush of the queue, only its entries go
+		last, n := o.slot[o.count-1], o.size[o.count-1]
+		o.sys.send(o, o.count)
+		o.count = 0
+		o.push(last, n, addr)
+		return
+	}
+	o.push(o.slot[o.count-1], o.size[o.count-1], addr)
+}
+
+func (o *Outbox) push(slot, n int, addr netip.AddrPort) {
+	o.slot[o.count] = slot
+	o.size[o.count] = n
+	o.addrs[o.count] = addr
+	o.count++
+}
+
+func (o *Outbox) flush() {
+	if o.count > 0 {
+		o.sys.send(o, o.count)
+	}
+	o.count = 0
+	o.nbufs = 0
+}
+
+// Plain per-datagram fallback, also used when a batch send fails.
+func (o *Outbox) sendEach(from, to int) {
+	for i := from; i < to; i++ {
+		data := o.bufs[o.slot[i]][:o.size[i]]
+		if _, err := o.conn.WriteToUDPAddrPort(data, o.addrs[i]); err != nil {
+			logf(CAT_NET, LOG_WARN, "Error sending to %v: %v", o.addrs[i], err)
+		}
+	}
+}
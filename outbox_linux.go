@@ -0,0 +1,125 @@
+package main
+
+import (
+	"net/netip"
+	"runtime"
+	"syscall"
+	"unsafe"
+)
+
+type mmsghdr struct {
+	Hdr syscall.Msghdr
+	Len uint32
+}
+
+// sendmmsg(2) state, kept in the Outbox so a flush allocates nothing.
+type outboxSys struct {
+	out    *Outbox
+	raw    syscall.RawConn
+	trap   uintptr
+	family int
+
+	hdrs  [OUTBOX_SIZE]mmsghdr
+	iovs  [OUTBOX_SIZE]syscall.Iovec
+	names [OUTBOX_SIZE]syscall.RawSockaddrInet6
+
+	count int
+	sent  int
+	errno syscall.Errno
+	write func(fd uintptr) bool
+}
+
+// syscall only exports SYS_SENDMMSG for some architectures.
+func sendmmsgTrap() uintptr {
+	switch runtime.GOARCH {
+	case "amd64":
+		return 307
+	case "arm64", "riscv64", "loong64":
+		return 269
+	case "386":
+		return 345
+	case "arm":
+		return 374
+	}
+	return 0
+}
+
+func (s *outboxSys) init(o *Outbox) {
+	s.out = o
+	s.write = s.sendBatch
+
+	raw, err := o.conn.SyscallConn()
+	if err != nil {
+		return
+	}
+	s.raw = raw
+	raw.Control(func(fd uintptr) {
+		s.family, err = syscall.GetsockoptInt(int(fd), syscall.SOL_SOCKET, syscall.SO_DOMAIN)
+	})
+	if err == nil {
+		s.trap = sendmmsgTrap()
+	}
+}
+
+func (s *outboxSys) setName(i int, addr netip.AddrPort) uint32 {
+	port := addr.Port()
+	if s.family == syscall.AF_INET {
+		sa := (*syscall.RawSockaddrInet4)(unsafe.Pointer(&s.names[i]))
+		sa.Family = syscall.AF_INET
+		sa.Port = port<<8 | port>>8
+		sa.Addr = addr.Addr().Unmap().As4()
+		return syscall.SizeofSockaddrInet4
+	}
+
+	sa := &s.names[i]
+	sa.Family = syscall.AF_INET6
+	sa.Port = port<<8 | port>>8
+	sa.Flowinfo = 0
+	sa.Addr = addr.Addr().As16()
+	sa.Scope_id = 0
+	return syscall.SizeofSockaddrInet6
+}
+
+func (s *outboxSys) sendBatch(fd uintptr) bool {
+	n, _, errno := syscall.Syscall6(s.trap, fd,
+		uintptr(unsafe.Pointer(&s.hdrs[s.sent])), uintptr(s.count-s.sent), 0, 0, 0)
+	if errno == syscall.EAGAIN {
+		return false
+	}
+	if errno != 0 {
+		s.errno = errno
+		return true
+	}
+	s.sent += int(n)
+	return true
+}
+
+func (s *outboxSys) send(o *Outbox, count int) {
+	if s.trap == 0 {
+		o.sendEach(0, count)
+		return
+	}
+
+	for i := 0; i < count; i++ {
+		buf := &o.bufs[o.slot[i]]
+		s.iovs[i].Base = &buf[0]
+		s.iovs[i].SetLen(o.size[i])
+
+		h := &s.hdrs[i].Hdr
+		h.Name = (*byte)(unsafe.Pointer(&s.names[i]))
+		h.Namelen = s.setName(i, o.addrs[i])
+		h.Iov = &s.iovs[i]
+		h.Iovlen = 1
+	}
+
+	s.count = count
+	s.sent = 0
+	for s.sent < count {
+		s.errno = 0
+		if err := s.raw.Write(s.write); err != nil || s.errno != 0 {
+			// one bad destination fails the whole call, finish one by one
+			o.sendEach(s.sent, count)
+			return
+		}
+	}
+}
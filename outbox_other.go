@@ -0,0 +1,9 @@
+package main
+
+type outboxSys struct{}
+
+func (s *outboxSys) init(o *Outbox) {}
+
+func (s *outboxSys) send(o *Outbox, count int) {
+	o.sendEach(0, count)
+}
@@ -0,0 +1,250 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+atomic_bool prof_enabled = true;
+_Thread_local uint32_t prof_depth = 0;
+
+static ProfThread prof_threads[PROF_MAX_THREADS];
+static atomic_int prof_thread_count = 0;
+static _Thread_local ProfThread* prof_current = NULL;
+
+// render thread only
+static uint64_t prof_last_frame_ns = 0;
+static uint64_t prof_frames[PROF_FRAME_HISTORY];
+static uint64_t prof_frame_count = 0;
+
+uint64_t
+prof_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+prof_set_enabled(bool enabled)
+{
+  atomic_store_explicit(&prof_enabled, enabled, memory_order_relaxed);
+}
+
+// NULL once PROF_MAX_THREADS threads have registered; later ones go
+// unrecorded
+static ProfThread*
+prof_thread()
+{
+  if (prof_current != NULL) {
+    return prof_current;
+  }
+
+  int index = atomic_fetch_add(&prof_thread_count, 1);
+  if (index >= PROF_MAX_THREADS) {
+    atomic_store(&prof_thread_count, PROF_MAX_THREADS);
+    return NULL;
+  }
+
+  ProfThread* thread = &prof_threads[index];
+  thread->events = calloc(PROF_RING_CAPACITY, sizeof(ProfEvent));
+  if (thread->events == NULL) {
+    return NULL;
+  }
+  snprintf(thread->name, sizeof(thread->name), "thread %d", index);
+  atomic_init(&thread->head, 0);
+
+  prof_current = thread;
+  return thread;
+}
+
+void
+prof_thread_name(const char* name)
+{
+  ProfThread* thread = prof_thread();
+  if (thread != NULL) {
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+  }
+}
+
+void
+prof_record(const char* name,
+            uint64_t start_ns,
+            uint64_t end_ns,
+            uint32_t depth)
+{
+  ProfThread* thread = prof_thread();
+  if (thread == NULL) {
+    return;
+  }
+
+  uint64_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+  thread->events[head & (PROF_RING_CAPACITY - 1)] = (ProfEvent){
+    .name = name,
+    .start_ns = start_ns,
+    .duration_ns = (uint32_t)(end_ns - start_ns),
+    .depth = depth,
+  };
+  atomic_store_explicit(&thread->head, head + 1, memory_order_release);
+}
+
+void
+prof_frame()
+{
+  uint64_t now = prof_now_ns();
+  if (prof_last_frame_ns != 0) {
+    prof_frames[prof_frame_count++ % PROF_FRAME_HISTORY] =
+      now - prof_last_frame_ns;
+    if (atomic_load_explicit(&prof_enabled, memory_order_relaxed)) {
+      prof_record("frame", prof_last_frame_ns, now, prof_depth);
+    }
+  }
+  prof_last_frame_ns = now;
+}
+
+int
+prof_frame_times(uint64_t* out, int max)
+{
+  uint64_t count = prof_frame_count < PROF_FRAME_HISTORY ? prof_frame_count
+                                                         : PROF_FRAME_HISTORY;
+  if (count > (uint64_t)max) {
+    count = max;
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    out[i] = prof_frames[(prof_frame_count - count + i) % PROF_FRAME_HISTORY];
+  }
+  return (int)count;
+}
+
+// Index of the oldest event of thread that started at or after since_ns.
+static uint64_t
+prof_first_since(ProfThread* thread, uint64_t head, uint64_t since_ns)
+{
+  uint64_t first = head > PROF_RING_CAPACITY ? head - PROF_RING_CAPACITY : 0;
+  uint64_t i = head;
+  // events are stored by end time, so walk back until they are too old
+  while (i > first &&
+         thread->events[(i - 1) & (PROF_RING_CAPACITY - 1)].start_ns >= since_ns) {
+    i--;
+  }
+  return i;
+}
+
+int
+prof_zone_stats(ProfZoneStats* out, int max, double seconds)
+{
+  ProfThread* thread = prof_thread();
+  if (thread == NULL) {
+    return 0;
+  }
+
+  uint64_t since = prof_now_ns() - (uint64_t)(seconds * 1e9);
+  uint64_t head = atomic_load_explicit(&thread->head, memory_order_acquire);
+  int count = 0;
+
+  for (uint64_t i = prof_first_since(thread, head, since); i < head; i++) {
+    const ProfEvent* event = &thread->events[i & (PROF_RING_CAPACITY - 1)];
+    if (event->start_ns < since) {
+      continue; // a parent that ended late
+    }
+
+    int zone = 0;
+    while (zone < count && out[zone].name != event->name) {
+      zone++;
+    }
+    if (zone == count) {
+      if (count == max) {
+        continue;
+      }
+      out[count++] = (ProfZoneStats){
+        .name = event->name,
+        .depth = event->depth,
+        .first_ns = event->start_ns,
+      };
+    }
+
+    out[zone].calls++;
+    out[zone].total_ns += event->duration_ns;
+    if (event->duration_ns > out[zone].max_ns) {
+      out[zone].max_ns = event->duration_ns;
+    }
+    if (event->start_ns < out[zone].first_ns) {
+      out[zone].first_ns = event->start_ns;
+    }
+  }
+
+  for (int i = 1; i < count; i++) {
+    ProfZoneStats zone = out[i];
+    int j = i;
+    for (; j > 0 && out[j - 1].first_ns > zone.first_ns; j--) {
+      out[j] = out[j - 1];
+    }
+    out[j] = zone;
+  }
+
+  return count;
+}
+
+static void
+prof_write_string(FILE* file, const char* str)
+{
+  fputc('"', file);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', file);
+    }
+    if ((unsigned char)*str >= 0x20) {
+      fputc(*str, file);
+    }
+  }
+  fputc('"', file);
+}
+
+bool
+prof_dump_chrome(const char* path, double seconds)
+{
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    return false;
+  }
+
+  uint64_t since = prof_now_ns() - (uint64_t)(seconds * 1e9);
+  int threads = atomic_load(&prof_thread_count);
+  bool first = true;
+
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+
+  for (int t = 0; t < threads && t < PROF_MAX_THREADS; t++) {
+    ProfThread* thread = &prof_threads[t];
+    if (thread->events == NULL) {
+      continue;
+    }
+
+    fprintf(file,
+            "%s\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":",
+            first ? "" : ",",
+            t + 1);
+    prof_write_string(file, thread->name);
+    fputs("}}", file);
+    first = false;
+
+    uint64_t head = atomic_load_explicit(&thread->head, memory_order_acquire);
+    for (uint64_t i = prof_first_since(thread, head, since); i < head; i++) {
+      ProfEvent event = thread->events[i & (PROF_RING_CAPACITY - 1)];
+      if (event.start_ns < since || event.name == NULL) {
+        continue;
+      }
+      fputs(",\n{\"ph\":\"X\",\"name\":", file);
+      prof_write_string(file, event.name);
+      fprintf(file,
+              ",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              t + 1,
+              event.start_ns / 1e3,
+              event.duration_ns / 1e3);
+    }
+  }
+
+  fputs("\n]}\n", file);
+  return fclose(file) == 0;
+}
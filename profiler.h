@@ -0,0 +1,144 @@
+#ifndef __ME_PROFILER
+#define __ME_PROFILER
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Frame profiler. Zones are timed with
+ *
+ *   ProfZone zone = prof_begin("draw_board");
+ *   ...
+ *   prof_end(zone);
+ *
+ * and land in a ring owned by the calling thread, so recording takes no
+ * locks; the oldest events are overwritten. prof_set_enabled(false) turns
+ * both calls into a relaxed load and a branch, building with -DPROFILER=0
+ * removes them entirely.
+ *
+ * Readers (the overlay and the trace dump) run on the render thread and
+ * read other threads' rings without stopping them, so an event that is
+ * being overwritten at that moment may come out torn. That is fine for a
+ * profiler.
+ */
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+#define PROF_RING_CAPACITY (1 << 16) // events per thread
+#define PROF_MAX_THREADS 8
+#define PROF_FRAME_HISTORY 512
+#define PROF_THREAD_NAME_LEN 32
+
+typedef struct ProfEvent
+{
+  const char* name; // string literal, compared by address
+  uint64_t start_ns;
+  uint32_t duration_ns;
+  uint32_t depth;
+} ProfEvent;
+
+typedef struct ProfThread
+{
+  char name[PROF_THREAD_NAME_LEN];
+  atomic_uint_fast64_t head; // events written so far
+  ProfEvent* events;         // PROF_RING_CAPACITY of them
+} ProfThread;
+
+typedef struct ProfZone
+{
+  const char* name;
+  uint64_t start_ns; // 0 when the profiler was off at prof_begin
+} ProfZone;
+
+typedef struct ProfZoneStats
+{
+  const char* name;
+  uint32_t depth;
+  uint32_t calls;
+  uint64_t first_ns; // start of the earliest call
+  uint64_t total_ns;
+  uint64_t max_ns;
+} ProfZoneStats;
+
+extern atomic_bool prof_enabled;
+extern _Thread_local uint32_t prof_depth; // open zones on this thread
+
+uint64_t
+prof_now_ns();
+
+void
+prof_set_enabled(bool enabled);
+
+// Names the calling thread in traces; registers it if needed.
+void
+prof_thread_name(const char* name);
+
+void
+prof_record(const char* name,
+            uint64_t start_ns,
+            uint64_t end_ns,
+            uint32_t depth);
+
+#if PROFILER
+
+static inline ProfZone
+prof_begin(const char* name)
+{
+  ProfZone zone = { name, 0 };
+  if (atomic_load_explicit(&prof_enabled, memory_order_relaxed)) {
+    zone.start_ns = prof_now_ns();
+    prof_depth++;
+  }
+  return zone;
+}
+
+static inline void
+prof_end(ProfZone zone)
+{
+  if (zone.start_ns != 0) {
+    prof_record(zone.name, zone.start_ns, prof_now_ns(), --prof_depth);
+  }
+}
+
+#else
+
+static inline ProfZone
+prof_begin(const char* name)
+{
+  return (ProfZone){ name, 0 };
+}
+
+static inline void
+prof_end(ProfZone zone)
+{
+  (void)zone;
+}
+
+#endif
+
+/*
+ * Marks the end of a frame on the render thread: records a "frame" zone
+ * since the previous mark and adds its length to the frame history.
+ */
+void
+prof_frame();
+
+// Frame lengths in ns, oldest first; returns how many were copied.
+int
+prof_frame_times(uint64_t* out, int max);
+
+/*
+ * Per-zone totals of the calling thread's events that started within the
+ * last seconds, ordered by first call so nested zones follow their parent.
+ * Returns the number of zones.
+ */
+int
+prof_zone_stats(ProfZoneStats* out, int max, double seconds);
+
+// Writes every thread's events from the last seconds as Chrome trace JSON.
+bool
+prof_dump_chrome(const char* path, double seconds);
+
+#endif // __ME_PROFILER
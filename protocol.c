@@ -0,0 +1,220 @@
+#include "protocol.h"
+
+#include <string.h>
+
+static inline void
+put_u16(uint8_t* buf, uint16_t v)
+{
+  buf[0] = (uint8_t)v;
+  buf[1] = (uint8_t)(v >> 8);
+}
+
+static inline void
+put_u32(uint8_t* buf, uint32_t v)
+{
+  buf[0] = (uint8_t)v;
+  buf[1] = (uint8_t)(v >> 8);
+  buf[2] = (uint8_t)(v >> 16);
+  buf[3] = (uint8_t)(v >> 24);
+}
+
+static inline uint16_t
+get_u16(const uint8_t* buf)
+{
+  return (uint16_t)(buf[0] | (buf[1] << 8));
+}
+
+static inline uint32_t
+get_u32(const uint8_t* buf)
+{
+  return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
+         ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static inline uint64_t
+get_u64(const uint8_t* buf)
+{
+  return (uint64_t)get_u32(buf) | ((uint64_t)get_u32(buf + 4) << 32);
+}
+
+bool
+proto_seq_newer(uint16_t seq, uint16_t than)
+{
+  return (int16_t)(seq - than) > 0;
+}
+
+int
+proto_write_header(uint8_t* buf, Opcode opcode, uint16_t seq)
+{
+  buf[0] = PROTO_MAGIC;
+  buf[1] = PROTO_VERSION;
+  buf[2] = (uint8_t)opcode;
+  buf[3] = 0;
+  put_u16(buf + 4, seq);
+  return PROTO_HEADER_SIZE;
+}
+
+bool
+proto_read_header(const uint8_t* buf, int len, PacketHeader* header)
+{
+  if (len < PROTO_HEADER_SIZE || buf[0] != PROTO_MAGIC ||
+      buf[1] != PROTO_VERSION) {
+    return false;
+  }
+
+  header->version = buf[1];
+  header->opcode = buf[2];
+  header->flags = buf[3];
+  header->seq = get_u16(buf + 4);
+  return true;
+}
+
+int
+proto_pack_board(uint8_t* out, int size, BoardTiles board)
+{
+  uint8_t* p = out;
+  uint32_t bits = 0;
+  int pending = 0;
+
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      bits |= ((uint32_t)board[y][x] & 0x7) << pending;
+      pending += 3;
+      if (pending >= 8) {
+        *p++ = (uint8_t)bits;
+        bits >>= 8;
+        pending -= 8;
+      }
+    }
+  }
+  if (pending > 0) {
+    *p++ = (uint8_t)bits;
+  }
+
+  return (int)(p - out);
+}
+
+int
+proto_unpack_board(const uint8_t* in, int size, BoardTiles board)
+{
+  const uint8_t* p = in;
+  uint32_t bits = 0;
+  int pending = 0;
+
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      if (pending < 3) {
+        bits |= (uint32_t)*p++ << pending;
+        pending += 8;
+      }
+      Tile tile = (Tile)(bits & 0x7);
+      board[y][x] = tile > T_SPECIAL ? EMPTY : tile;
+      bits >>= 3;
+      pending -= 3;
+    }
+  }
+
+  return (int)(p - in);
+}
+
+int
+proto_encode_request(uint8_t* buf, Opcode opcode, uint16_t seq)
+{
+  return proto_write_header(buf, opcode, seq);
+}
+
+int
+proto_encode_move(uint8_t* buf,
+                  uint16_t seq,
+                  int player_id,
+                  int from_x,
+                  int from_y,
+                  int to_x,
+                  int to_y)
+{
+  uint8_t* p = buf + proto_write_header(buf, OP_MOVE, seq);
+  *p++ = (uint8_t)player_id;
+  *p++ = (uint8_t)((from_x & 0xF) | (from_y << 4));
+  *p++ = (uint8_t)((to_x & 0xF) | (to_y << 4));
+  return (int)(p - buf);
+}
+
+int
+proto_encode_connect(uint8_t* buf, uint16_t seq, int board_size, int rating)
+{
+  int n = proto_write_header(buf, OP_CONNECT, seq);
+  buf[n] = (uint8_t)board_size;
+  if (rating < 0) {
+    return PROTO_CONNECT_SIZE;
+  }
+  if (rating >= PROTO_UNRATED) {
+    rating = PROTO_UNRATED - 1;
+  }
+  put_u16(buf + n + 1, (uint16_t)rating);
+  return PROTO_CONNECT_RATED_SIZE;
+}
+
+int
+proto_encode_ack(uint8_t* buf, uint16_t seq, uint16_t state_seq)
+{
+  int n = proto_write_header(buf, OP_ACK, seq);
+  put_u16(buf + n, state_seq);
+  return PROTO_ACK_SIZE;
+}
+
+int
+proto_encode_spectate(uint8_t* buf,
+                      uint16_t seq,
+                      int32_t game_id,
+                      uint16_t ack,
+                      bool leave)
+{
+  uint8_t* p = buf + proto_write_header(buf, OP_SPECTATE, seq);
+  put_u32(p, (uint32_t)game_id);
+  put_u16(p + 4, ack);
+  p[6] = leave ? 1 : 0;
+  return PROTO_SPECTATE_SIZE;
+}
+
+bool
+proto_decode_player_id(const uint8_t* buf, int len, int* player_id)
+{
+  if (len < PROTO_PLAYER_ID_SIZE) {
+    return false;
+  }
+
+  *player_id = buf[PROTO_HEADER_SIZE];
+  return true;
+}
+
+bool
+proto_decode_state(const uint8_t* buf, int len, struct GameState* state)
+{
+  if (len < PROTO_STATE_SIZE(0)) {
+    return false;
+  }
+
+  const uint8_t* p = buf + PROTO_HEADER_SIZE;
+  int size = p[13];
+  if (!board_size_supported(size) || len < PROTO_STATE_SIZE(size)) {
+    return false;
+  }
+
+  state->game_id = (int32_t)get_u32(p);
+  state->player1_score = (int32_t)get_u32(p + 4);
+  state->player2_score = (int32_t)get_u32(p + 8);
+
+  uint8_t flags = p[12];
+  state->current_turn = (flags & PROTO_STATE_TURN) ? 1 : 0;
+  state->game_started = (flags & PROTO_STATE_STARTED) != 0;
+  state->game_over = (flags & PROTO_STATE_OVER) != 0;
+
+  state->rng = get_u64(p + 14);
+  state->move_ack[0] = get_u16(p + 22);
+  state->move_ack[1] = get_u16(p + 24);
+
+  memset(state->board, 0, sizeof(state->board));
+  state->board_size = size;
+  proto_unpack_board(p + 26, size, state->board);
+  return true;
+}
@@ -0,0 +1,184 @@
+/**
+ * Wire format, see protocol.h for the layout. Both files must stay in sync.
+ */
+package main
+
+import "encoding/binary"
+
+const (
+	PROTO_MAGIC   = 0xB3
+	PROTO_VERSION = 5
+
+	PROTO_HEADER_SIZE        = 6
+	PROTO_CONNECT_SIZE       = PROTO_HEADER_SIZE + 1
+	PROTO_CONNECT_RATED_SIZE = PROTO_HEADER_SIZE + 3
+	PROTO_MOVE_SIZE          = PROTO_HEADER_SIZE + 3
+	PROTO_PLAYER_ID_SIZE     = PROTO_HEADER_SIZE + 1
+	PROTO_ACK_SIZE           = PROTO_HEADER_SIZE + 2
+	PROTO_STATE_FIXED        = PROTO_HEADER_SIZE + 26
+	PROTO_SPECTATE_SIZE      = PROTO_HEADER_SIZE + 7
+
+	PROTO_STATE_TURN    = 0x01
+	PROTO_STATE_STARTED = 0x02
+	PROTO_STATE_OVER    = 0x04
+
+	PROTO_UNRATED = 0xFFFF
+)
+
+const (
+	OP_CONNECT uint8 = iota + 1
+	OP_DISCONNECT
+	OP_MOVE
+	OP_PLAYER_ID
+	OP_STATE
+	OP_SPECTATE
+	OP_ACK
+)
+
+type PacketHeader struct {
+	Version uint8
+	Opcode  uint8
+	Flags   uint8
+	Seq     uint16
+}
+
+func writeHeader(buf []byte, opcode uint8, seq uint16) int {
+	buf[0] = PROTO_MAGIC
+	buf[1] = PROTO_VERSION
+	buf[2] = opcode
+	buf[3] = 0
+	binary.LittleEndian.PutUint16(buf[4:], seq)
+	return PROTO_HEADER_SIZE
+}
+
+// Whether seq comes after than, allowing for wrap-around.
+func seqNewer(seq, than uint16) bool {
+	return int16(seq-than) > 0
+}
+
+func readHeader(buf []byte, header *PacketHeader) bool {
+	if len(buf) < PROTO_HEADER_SIZE || buf[0] != PROTO_MAGIC || buf[1] != PROTO_VERSION {
+		return false
+	}
+	header.Version = buf[1]
+	header.Opcode = buf[2]
+	header.Flags = buf[3]
+	header.Seq = binary.LittleEndian.Uint16(buf[4:])
+	return true
+}
+
+// Writes the board's tiles at 3 bits each and returns the bytes used.
+func packBoard(out []byte, board *Board) int {
+	size := board.Size()
+	o := 0
+	var bits uint32
+	pending := 0
+
+	for y := 0; y < size; y++ {
+		for x := 0; x < size; x++ {
+			bits |= (uint32(board.Cells[y][x]) & 0x7) << pending
+			pending += 3
+			if pending >= 8 {
+				out[o] = byte(bits)
+				o++
+				bits >>= 8
+				pending -= 8
+			}
+		}
+	}
+	if pending > 0 {
+		out[o] = byte(bits)
+		o++
+	}
+	return o
+}
+
+// Board size asked for in a connect request, 0 for the server's default,
+// and the player's rating, -1 when they sent none.
+func decodeConnect(buf []byte) (size int, rating int) {
+	if len(buf) < PROTO_CONNECT_SIZE {
+		return 0, -1
+	}
+	size = int(buf[PROTO_HEADER_SIZE])
+	if len(buf) < PROTO_CONNECT_RATED_SIZE {
+		return size, -1
+	}
+	if r := binary.LittleEndian.Uint16(buf[PROTO_CONNECT_SIZE:]); r != PROTO_UNRATED {
+		return size, int(r)
+	}
+	return size, -1
+}
+
+func decodeMove(buf []byte, move *PlayerMove) bool {
+	if len(buf) < PROTO_MOVE_SIZE {
+		return false
+	}
+	move.Seq = binary.LittleEndian.Uint16(buf[4:])
+	p := buf[PROTO_HEADER_SIZE:]
+	move.PlayerID = int32(p[0])
+	move.FromX = int(p[1] & 0xF)
+	move.FromY = int(p[1] >> 4)
+	move.ToX = int(p[2] & 0xF)
+	move.ToY = int(p[2] >> 4)
+	return true
+}
+
+// Newest state sequence an OP_ACK reports.
+func decodeAck(buf []byte) (uint16, bool) {
+	if len(buf) < PROTO_ACK_SIZE {
+		return 0, false
+	}
+	return binary.LittleEndian.Uint16(buf[PROTO_HEADER_SIZE:]), true
+}
+
+type SpectateRequest struct {
+	GameID int32 // 0 for the server's pick
+	Ack    uint16
+	Leave  bool
+}
+
+func decodeSpectate(buf []byte, req *SpectateRequest) bool {
+	if len(buf) < PROTO_SPECTATE_SIZE {
+		return false
+	}
+	p := buf[PROTO_HEADER_SIZE:]
+	req.GameID = int32(binary.LittleEndian.Uint32(p[0:]))
+	req.Ack = binary.LittleEndian.Uint16(p[4:])
+	req.Leave = p[6] != 0
+	return true
+}
+
+func encodePlayerID(buf []byte, seq uint16, playerID int) int {
+	n := writeHeader(buf, OP_PLAYER_ID, seq)
+	buf[n] = byte(playerID)
+	return n + 1
+}
+
+func stateFlags(g *GameState) byte {
+	var flags byte
+	if g.CurrentTurn == 1 {
+		flags |= PROTO_STATE_TURN
+	}
+	if g.GameStarted {
+		flags |= PROTO_STATE_STARTED
+	}
+	if g.GameOver {
+		flags |= PROTO_STATE_OVER
+	}
+	return flags
+}
+
+func encodeState(buf []byte, seq uint16, g *GameState) int {
+	n := writeHeader(buf, OP_STATE, seq)
+	p := buf[n:]
+	binary.LittleEndian.PutUint32(p[0:], uint32(g.GameID))
+	binary.LittleEndian.PutUint32(p[4:], uint32(g.Player1Score))
+	binary.LittleEndian.PutUint32(p[8:], uint32(g.Player2Score))
+	p[12] = stateFlags(g)
+	p[13] = byte(g.Board.Size())
+	binary.LittleEndian.PutUint64(p[14:], uint64(g.Rng))
+	binary.LittleEndian.PutUint16(p[22:], g.MoveSeq[0])
+	binary.LittleEndian.PutUint16(p[24:], g.MoveSeq[1])
+
+	return PROTO_STATE_FIXED + packBoard(p[26:], &g.Board)
+}
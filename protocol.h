@@ -0,0 +1,155 @@
+#ifndef __ME_PROTOCOL
+#define __ME_PROTOCOL
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "board.h"
+
+/*
+ * Wire format shared by client.c and server.go (protocol.go mirrors it).
+ * All multi-byte fields are little endian.
+ *
+ * Header, 6 bytes:
+ *   0  u8   magic, PROTO_MAGIC
+ *   1  u8   version, PROTO_VERSION
+ *   2  u8   opcode
+ *   3  u8   flags, reserved, 0
+ *   4  u16  sequence, per sender, wraps
+ *
+ * Payloads:
+ *   OP_CONNECT     optional u8 board size wanted, 0 or absent for the
+ *                  server's default, optional u16 rating, PROTO_UNRATED
+ *                  or absent for none; queues the sender for an opponent,
+ *                  repeat every PROTO_QUEUE_RENEW_MS until OP_PLAYER_ID
+ *                  arrives or the server drops the ticket
+ *   OP_DISCONNECT  none
+ *   OP_MOVE        u8 player_id, u8 from (x | y << 4), u8 to (x | y << 4);
+ *                  resent under the same sequence until a state acks it
+ *   OP_PLAYER_ID   u8 player_id, sent once an opponent is matched
+ *   OP_STATE       u32 game_id, i32 player1_score, i32 player2_score,
+ *                  u8 state (bit 0 current_turn, bit 1 started, bit 2 over),
+ *                  u8 board size n, one of BOARD_VARIANTS,
+ *                  u64 refill generator state (BoardRng) for the next
+ *                  move only, the server reseeds it after every move,
+ *                  u16 move_ack[2], sequence of the newest move the
+ *                  server handled from each player,
+ *                  PROTO_BOARD_BYTES(n) bytes board, 3 bits per tile,
+ *                  row-major, tile i at bit 3 * i counted from the lsb of
+ *                  byte 0
+ *   OP_SPECTATE    u32 game_id (0 for the server's pick), u16 sequence of
+ *                  the newest state received, u8 leave; repeat at least
+ *                  every PROTO_SPECTATE_RENEW_MS with the game_id of the
+ *                  states received, or the server stops sending them
+ *   OP_ACK         u16 sequence of the newest state received; players send
+ *                  it every PROTO_ACK_INTERVAL_MS and the server resends
+ *                  its newest state if the ack trails it
+ *
+ * Packets with the wrong magic, version or length are dropped.
+ */
+
+#define PROTO_MAGIC 0xB3
+#define PROTO_VERSION 5
+
+#define PROTO_HEADER_SIZE 6
+#define PROTO_BOARD_BYTES(n) (((n) * (n) * 3 + 7) / 8)
+#define PROTO_CONNECT_SIZE (PROTO_HEADER_SIZE + 1)
+#define PROTO_CONNECT_RATED_SIZE (PROTO_HEADER_SIZE + 3)
+#define PROTO_MOVE_SIZE (PROTO_HEADER_SIZE + 3)
+#define PROTO_PLAYER_ID_SIZE (PROTO_HEADER_SIZE + 1)
+#define PROTO_ACK_SIZE (PROTO_HEADER_SIZE + 2)
+#define PROTO_STATE_SIZE(n) (PROTO_HEADER_SIZE + 26 + PROTO_BOARD_BYTES(n))
+#define PROTO_SPECTATE_SIZE (PROTO_HEADER_SIZE + 7)
+#define PROTO_MAX_PACKET PROTO_STATE_SIZE(BOARD_MAX_SIZE)
+
+#define PROTO_STATE_TURN 0x01
+#define PROTO_STATE_STARTED 0x02
+#define PROTO_STATE_OVER 0x04
+
+#define PROTO_UNRATED 0xFFFF
+
+#define PROTO_QUEUE_RENEW_MS 1000
+#define PROTO_SPECTATE_RENEW_MS 1000
+#define PROTO_ACK_INTERVAL_MS 250
+
+typedef enum
+{
+  OP_CONNECT = 1,
+  OP_DISCONNECT,
+  OP_MOVE,
+  OP_PLAYER_ID,
+  OP_STATE,
+  OP_SPECTATE,
+  OP_ACK,
+} Opcode;
+
+typedef struct PacketHeader
+{
+  uint8_t version;
+  uint8_t opcode;
+  uint8_t flags;
+  uint16_t seq;
+} PacketHeader;
+
+struct GameState
+{
+  int32_t game_id;
+  int32_t board_size;
+  BoardTiles board;
+  int32_t current_turn;
+  int32_t player1_score;
+  int32_t player2_score;
+  bool game_started;
+  bool game_over;
+  BoardRng rng; // draws the refills of the next move
+  uint16_t move_ack[2]; // newest move sequence handled per player
+};
+
+bool
+proto_seq_newer(uint16_t seq, uint16_t than);
+
+int
+proto_write_header(uint8_t* buf, Opcode opcode, uint16_t seq);
+
+bool
+proto_read_header(const uint8_t* buf, int len, PacketHeader* header);
+
+int
+proto_pack_board(uint8_t* out, int size, BoardTiles board);
+
+int
+proto_unpack_board(const uint8_t* in, int size, BoardTiles board);
+
+int
+proto_encode_request(uint8_t* buf, Opcode opcode, uint16_t seq);
+
+// rating < 0 sends none
+int
+proto_encode_connect(uint8_t* buf, uint16_t seq, int board_size, int rating);
+
+int
+proto_encode_move(uint8_t* buf,
+                  uint16_t seq,
+                  int player_id,
+                  int from_x,
+                  int from_y,
+                  int to_x,
+                  int to_y);
+
+int
+proto_encode_ack(uint8_t* buf, uint16_t seq, uint16_t state_seq);
+
+int
+proto_encode_spectate(uint8_t* buf,
+                      uint16_t seq,
+                      int32_t game_id,
+                      uint16_t ack,
+                      bool leave);
+
+bool
+proto_decode_player_id(const uint8_t* buf, int len, int* player_id);
+
+bool
+proto_decode_state(const uint8_t* buf, int len, struct GameState* state);
+
+#endif // __ME_PROTOCOL
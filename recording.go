@@ -0,0 +1,152 @@
+/**
+ * Match recordings, see replay.h for the layout. The client reads them with
+ * -r; keep both files in sync.
+ */
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"path/filepath"
+	"time"
+)
+
+const (
+	REPLAY_MAGIC             = 0x50524A42 // "BJRP"
+	REPLAY_INDEX_MAGIC       = 0x58444E49 // "INDX"
+	REPLAY_VERSION           = 1
+	REPLAY_HEADER_SIZE       = 16
+	REPLAY_RECORD_HEADER     = 5
+	REPLAY_STATE_FIXED       = REPLAY_RECORD_HEADER + 13
+	REPLAY_KEYFRAME_INTERVAL = 32
+	REPLAY_SEAT_SERVER       = 0xFF
+)
+
+const (
+	REPLAY_KEYFRAME uint8 = iota + 1
+	REPLAY_DELTA
+	REPLAY_MOVE
+)
+
+// Directory games are recorded to, empty when -record is not given.
+var recordDir string
+
+// Append-only writer for one game. It is only touched with the game's lock
+// held, like the rest of the GameState.
+type Recorder struct {
+	file   *os.File
+	w      *bufio.Writer
+	start  time.Time
+	offset uint32
+	steps  uint32
+	lastMS uint32
+	last   Cells
+	index  []uint32
+	buf    [REPLAY_STATE_FIXED + 2 + 2*BOARD_MAX_SIZE*BOARD_MAX_SIZE]byte
+}
+
+func newRecorder(dir string, game *GameState) (*Recorder, error) {
+	name := fmt.Sprintf("replay_%d_%d.bjr", game.GameID, time.Now().Unix())
+	file, err := os.Create(filepath.Join(dir, name))
+	if err != nil {
+		return nil, err
+	}
+
+	r := &Recorder{file: file, w: bufio.NewWriter(file), start: time.Now()}
+	header := r.buf[:REPLAY_HEADER_SIZE]
+	clear(header)
+	binary.LittleEndian.PutUint32(header[0:], REPLAY_MAGIC)
+	header[4] = REPLAY_VERSION
+	header[5] = byte(game.Board.Size())
+	header[6] = REPLAY_KEYFRAME_INTERVAL
+	header[7] = REPLAY_SEAT_SERVER
+	binary.LittleEndian.PutUint32(header[8:], uint32(game.GameID))
+	r.write(header)
+	return r, nil
+}
+
+func (r *Recorder) write(p []byte) {
+	r.w.Write(p)
+	r.offset += uint32(len(p))
+}
+
+func (r *Recorder) recordHeader(kind uint8) []byte {
+	r.lastMS = uint32(time.Since(r.start).Milliseconds())
+	r.buf[0] = kind
+	binary.LittleEndian.PutUint32(r.buf[1:], r.lastMS)
+	return r.buf[:REPLAY_RECORD_HEADER]
+}
+
+func (r *Recorder) writeMove(move *PlayerMove) {
+	p := append(r.recordHeader(REPLAY_MOVE),
+		byte(move.PlayerID),
+		byte(move.FromX&0xF|move.FromY<<4),
+		byte(move.ToX&0xF|move.ToY<<4))
+	r.write(p)
+}
+
+// Records the game's current state: a keyframe every
+// REPLAY_KEYFRAME_INTERVAL states, the changed cells otherwise.
+func (r *Recorder) writeState(g *GameState) {
+	keyframe := r.steps%REPLAY_KEYFRAME_INTERVAL == 0
+	kind := REPLAY_DELTA
+	if keyframe {
+		kind = REPLAY_KEYFRAME
+		r.index = append(r.index, r.offset)
+	}
+
+	p := r.recordHeader(kind)[:REPLAY_STATE_FIXED]
+	binary.LittleEndian.PutUint32(p[5:], r.steps)
+	binary.LittleEndian.PutUint32(p[9:], uint32(g.Player1Score))
+	binary.LittleEndian.PutUint32(p[13:], uint32(g.Player2Score))
+	p[17] = stateFlags(g)
+
+	size := g.Board.Size()
+	if keyframe {
+		p = p[:REPLAY_STATE_FIXED+packBoard(r.buf[REPLAY_STATE_FIXED:], &g.Board)]
+	} else {
+		count := 0
+		cells := r.buf[REPLAY_STATE_FIXED+2:]
+		for y := 0; y < size; y++ {
+			for x := 0; x < size; x++ {
+				if tile := g.Board.Cells[y][x]; tile != r.last[y][x] {
+					cells[count*2] = byte(y*size + x)
+					cells[count*2+1] = byte(tile)
+					count++
+				}
+			}
+		}
+		binary.LittleEndian.PutUint16(r.buf[REPLAY_STATE_FIXED:], uint16(count))
+		p = r.buf[:REPLAY_STATE_FIXED+2+count*2]
+	}
+
+	r.write(p)
+	r.last = g.Board.Cells
+	r.steps++
+
+	// a crash loses at most the records since the last keyframe
+	if keyframe {
+		r.w.Flush()
+	}
+}
+
+// Appends the keyframe index and closes the file.
+func (r *Recorder) Close() error {
+	var word [4]byte
+	for _, offset := range r.index {
+		binary.LittleEndian.PutUint32(word[:], offset)
+		r.write(word[:])
+	}
+	for _, v := range [...]uint32{r.steps, r.lastMS, uint32(len(r.index)), REPLAY_INDEX_MAGIC} {
+		binary.LittleEndian.PutUint32(word[:], v)
+		r.write(word[:])
+	}
+
+	err := r.w.Flush()
+	if cerr := r.file.Close(); err == nil {
+		err = cerr
+	}
+	return err
+}
@@ -0,0 +1,436 @@
+#include "replay.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// put_u16/put_u32/get_u16/get_u32 come from protocol.c
+
+static uint8_t
+replay_state_flags(const struct GameState* state)
+{
+  return (state->current_turn == 1 ? PROTO_STATE_TURN : 0) |
+         (state->game_started ? PROTO_STATE_STARTED : 0) |
+         (state->game_over ? PROTO_STATE_OVER : 0);
+}
+
+static void
+replay_writer_put(ReplayWriter* writer, const uint8_t* data, size_t len)
+{
+  if (fwrite(data, 1, len, writer->file) != len) {
+    perror("replay write failed");
+  }
+  writer->offset += (uint32_t)len;
+}
+
+bool
+replay_writer_open(ReplayWriter* writer,
+                   const char* path,
+                   int board_size,
+                   int seat,
+                   uint32_t game_id)
+{
+  memset(writer, 0, sizeof(*writer));
+  writer->file = fopen(path, "wb");
+  if (writer->file == NULL) {
+    return false;
+  }
+  writer->board_size = board_size;
+
+  uint8_t header[REPLAY_HEADER_SIZE] = { 0 };
+  put_u32(header, REPLAY_MAGIC);
+  header[4] = REPLAY_VERSION;
+  header[5] = (uint8_t)board_size;
+  header[6] = REPLAY_KEYFRAME_INTERVAL;
+  header[7] = (uint8_t)seat;
+  put_u32(header + 8, game_id);
+  replay_writer_put(writer, header, sizeof(header));
+  return true;
+}
+
+void
+replay_write_state(ReplayWriter* writer,
+                   struct GameState* state,
+                   uint32_t time_ms)
+{
+  int size = writer->board_size;
+  if (writer->file == NULL || state->board_size != size) {
+    return;
+  }
+
+  uint8_t record[REPLAY_STATE_FIXED + 2 + 2 * BOARD_MAX_SIZE * BOARD_MAX_SIZE];
+  bool keyframe = writer->steps % REPLAY_KEYFRAME_INTERVAL == 0;
+
+  record[0] = keyframe ? REPLAY_KEYFRAME : REPLAY_DELTA;
+  put_u32(record + 1, time_ms);
+  put_u32(record + 5, writer->steps);
+  put_u32(record + 9, (uint32_t)state->player1_score);
+  put_u32(record + 13, (uint32_t)state->player2_score);
+  record[17] = replay_state_flags(state);
+  size_t len = REPLAY_STATE_FIXED;
+
+  if (keyframe) {
+    uint32_t keyframes = writer->steps / REPLAY_KEYFRAME_INTERVAL;
+    if (keyframes == writer->index_capacity) {
+      uint32_t capacity = keyframes ? keyframes * 2 : 64;
+      uint32_t* index = realloc(writer->index, capacity * sizeof(uint32_t));
+      if (index == NULL) {
+        // end the recording here, the steps so far all have their index
+        fprintf(stderr, "replay index full, recording stopped\n");
+        replay_writer_close(writer);
+        return;
+      }
+      writer->index = index;
+      writer->index_capacity = capacity;
+    }
+    writer->index[keyframes] = writer->offset;
+
+    len += proto_pack_board(record + len, size, state->board);
+  } else {
+    uint16_t count = 0;
+    uint8_t* cells = record + len + 2;
+    for (int y = 0; y < size; y++) {
+      for (int x = 0; x < size; x++) {
+        if (state->board[y][x] != writer->last.board[y][x]) {
+          cells[count * 2] = (uint8_t)(y * size + x);
+          cells[count * 2 + 1] = (uint8_t)state->board[y][x];
+          count++;
+        }
+      }
+    }
+    put_u16(record + len, count);
+    len += 2 + count * 2;
+  }
+
+  replay_writer_put(writer, record, len);
+  memcpy(&writer->last, state, sizeof(struct GameState));
+  writer->steps++;
+  writer->last_ms = time_ms;
+
+  // a crash loses at most the records since the last keyframe
+  if (keyframe) {
+    fflush(writer->file);
+  }
+}
+
+void
+replay_write_move(ReplayWriter* writer,
+                  int player_id,
+                  int from_x,
+                  int from_y,
+                  int to_x,
+                  int to_y,
+                  uint32_t time_ms)
+{
+  if (writer->file == NULL) {
+    return;
+  }
+
+  uint8_t record[REPLAY_RECORD_HEADER + 3];
+  record[0] = REPLAY_MOVE;
+  put_u32(record + 1, time_ms);
+  record[5] = (uint8_t)player_id;
+  record[6] = (uint8_t)((from_x & 0xF) | (from_y << 4));
+  record[7] = (uint8_t)((to_x & 0xF) | (to_y << 4));
+  replay_writer_put(writer, record, sizeof(record));
+  writer->last_ms = time_ms;
+}
+
+void
+replay_writer_close(ReplayWriter* writer)
+{
+  if (writer->file == NULL) {
+    return;
+  }
+
+  uint32_t keyframes =
+    (writer->steps + REPLAY_KEYFRAME_INTERVAL - 1) / REPLAY_KEYFRAME_INTERVAL;
+  for (uint32_t i = 0; i < keyframes; i++) {
+    uint8_t offset[4];
+    put_u32(offset, writer->index[i]);
+    replay_writer_put(writer, offset, sizeof(offset));
+  }
+
+  uint8_t trailer[REPLAY_TRAILER_SIZE];
+  put_u32(trailer, writer->steps);
+  put_u32(trailer + 4, writer->last_ms);
+  put_u32(trailer + 8, keyframes);
+  put_u32(trailer + 12, REPLAY_INDEX_MAGIC);
+  replay_writer_put(writer, trailer, sizeof(trailer));
+
+  fclose(writer->file);
+  free(writer->index);
+  memset(writer, 0, sizeof(*writer));
+}
+
+// Length of the record at offset, 0 if it is malformed or runs past end.
+static size_t
+replay_record_size(const Replay* replay, size_t offset)
+{
+  if (offset + REPLAY_RECORD_HEADER > replay->end) {
+    return 0;
+  }
+
+  const uint8_t* p = replay->data + offset;
+  size_t size;
+  switch (p[0]) {
+    case REPLAY_KEYFRAME:
+      size = REPLAY_STATE_FIXED + PROTO_BOARD_BYTES(replay->board_size);
+      break;
+    case REPLAY_DELTA:
+      if (offset + REPLAY_STATE_FIXED + 2 > replay->end) {
+        return 0;
+      }
+      size = REPLAY_STATE_FIXED + 2 + 2 * (size_t)get_u16(p + REPLAY_STATE_FIXED);
+      break;
+    case REPLAY_MOVE:
+      size = REPLAY_RECORD_HEADER + 3;
+      break;
+    default:
+      return 0;
+  }
+
+  return offset + size <= replay->end ? size : 0;
+}
+
+static bool
+replay_load_index(Replay* replay)
+{
+  if (replay->size < REPLAY_HEADER_SIZE + REPLAY_TRAILER_SIZE) {
+    return false;
+  }
+
+  const uint8_t* trailer = replay->data + replay->size - REPLAY_TRAILER_SIZE;
+  uint32_t keyframes = get_u32(trailer + 8);
+  if (get_u32(trailer + 12) != REPLAY_INDEX_MAGIC ||
+      (uint64_t)keyframes * 4 >
+        replay->size - REPLAY_HEADER_SIZE - REPLAY_TRAILER_SIZE) {
+    return false;
+  }
+
+  uint32_t steps = get_u32(trailer);
+  uint32_t interval = replay->keyframe_interval;
+  if (keyframes != (steps + interval - 1) / interval) {
+    return false;
+  }
+
+  size_t end = replay->size - REPLAY_TRAILER_SIZE - (size_t)keyframes * 4;
+  uint32_t* index = malloc((keyframes ? keyframes : 1) * sizeof(uint32_t));
+  if (index == NULL) {
+    return false;
+  }
+  for (uint32_t i = 0; i < keyframes; i++) {
+    index[i] = get_u32(replay->data + end + i * 4);
+    if (index[i] < REPLAY_HEADER_SIZE || index[i] >= end ||
+        replay->data[index[i]] != REPLAY_KEYFRAME) {
+      free(index);
+      return false;
+    }
+  }
+
+  replay->end = end;
+  replay->index = index;
+  replay->keyframes = keyframes;
+  replay->steps = steps;
+  replay->duration_ms = get_u32(trailer + 4);
+  return true;
+}
+
+// For recordings that were never closed: one pass over the records,
+// stopping at the first one that is cut short.
+static bool
+replay_build_index(Replay* replay)
+{
+  uint32_t capacity = 64;
+  replay->index = malloc(capacity * sizeof(uint32_t));
+  if (replay->index == NULL) {
+    return false;
+  }
+
+  replay->end = replay->size;
+  size_t offset = REPLAY_HEADER_SIZE;
+  size_t size;
+
+  while ((size = replay_record_size(replay, offset)) != 0) {
+    const uint8_t* p = replay->data + offset;
+    if (p[0] != REPLAY_MOVE) {
+      uint32_t step = get_u32(p + REPLAY_RECORD_HEADER);
+      bool keyframe = p[0] == REPLAY_KEYFRAME;
+      if (step != replay->steps ||
+          keyframe != (step % replay->keyframe_interval == 0)) {
+        break;
+      }
+
+      if (keyframe) {
+        if (replay->keyframes == capacity) {
+          capacity *= 2;
+          uint32_t* index =
+            realloc(replay->index, capacity * sizeof(uint32_t));
+          if (index == NULL) {
+            break;
+          }
+          replay->index = index;
+        }
+        replay->index[replay->keyframes++] = (uint32_t)offset;
+      }
+      replay->steps++;
+    }
+    replay->duration_ms = get_u32(p + 1);
+    offset += size;
+  }
+
+  replay->end = offset;
+  return true;
+}
+
+bool
+replay_open(Replay* replay, const char* path)
+{
+  memset(replay, 0, sizeof(*replay));
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < REPLAY_HEADER_SIZE) {
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  replay->data = data;
+  replay->size = st.st_size;
+
+  const uint8_t* header = replay->data;
+  replay->board_size = header[5];
+  replay->keyframe_interval = header[6];
+  replay->seat = header[7];
+  replay->game_id = get_u32(header + 8);
+
+  if (get_u32(header) != REPLAY_MAGIC || header[4] != REPLAY_VERSION ||
+      !board_size_supported(replay->board_size) ||
+      replay->keyframe_interval == 0 ||
+      (!replay_load_index(replay) && !replay_build_index(replay))) {
+    fprintf(stderr, "%s: not a valid recording\n", path);
+    replay_close(replay);
+    return false;
+  }
+
+  replay_seek(replay, 0);
+  return true;
+}
+
+void
+replay_close(Replay* replay)
+{
+  if (replay->data != NULL) {
+    munmap((void*)replay->data, replay->size);
+  }
+  free(replay->index);
+  memset(replay, 0, sizeof(*replay));
+}
+
+// Applies the record at the cursor; false if there is none left.
+static bool
+replay_read(Replay* replay, bool* was_state)
+{
+  size_t size = replay_record_size(replay, replay->cursor);
+  if (size == 0) {
+    return false;
+  }
+
+  const uint8_t* p = replay->data + replay->cursor;
+  struct GameState* state = &replay->state;
+  int cells = replay->board_size * replay->board_size;
+
+  replay->cursor += size;
+  replay->time_ms = get_u32(p + 1);
+  *was_state = p[0] != REPLAY_MOVE;
+
+  if (p[0] == REPLAY_MOVE) {
+    replay->have_move = true;
+    replay->move = (ReplayMove){
+      .player_id = p[5],
+      .from_x = p[6] & 0xF,
+      .from_y = p[6] >> 4,
+      .to_x = p[7] & 0xF,
+      .to_y = p[7] >> 4,
+    };
+    return true;
+  }
+
+  replay->step = get_u32(p + REPLAY_RECORD_HEADER) + 1;
+  state->player1_score = (int32_t)get_u32(p + 9);
+  state->player2_score = (int32_t)get_u32(p + 13);
+  state->current_turn = (p[17] & PROTO_STATE_TURN) ? 1 : 0;
+  state->game_started = (p[17] & PROTO_STATE_STARTED) != 0;
+  state->game_over = (p[17] & PROTO_STATE_OVER) != 0;
+
+  if (p[0] == REPLAY_KEYFRAME) {
+    proto_unpack_board(p + REPLAY_STATE_FIXED, replay->board_size, state->board);
+  } else {
+    uint16_t count = get_u16(p + REPLAY_STATE_FIXED);
+    const uint8_t* cell = p + REPLAY_STATE_FIXED + 2;
+    for (uint16_t i = 0; i < count; i++, cell += 2) {
+      if (cell[0] < cells && cell[1] <= T_SPECIAL) {
+        state->board[cell[0] / replay->board_size][cell[0] % replay->board_size] =
+          (Tile)cell[1];
+      }
+    }
+  }
+  return true;
+}
+
+bool
+replay_seek(Replay* replay, uint32_t steps)
+{
+  if (steps > replay->steps) {
+    steps = replay->steps;
+  }
+
+  memset(&replay->state, 0, sizeof(replay->state));
+  replay->state.game_id = (int32_t)replay->game_id;
+  replay->state.board_size = replay->board_size;
+  replay->have_move = false;
+  replay->step = 0;
+  replay->time_ms = 0;
+  replay->cursor = REPLAY_HEADER_SIZE;
+
+  if (steps == 0) {
+    return true;
+  }
+
+  uint32_t keyframe = (steps - 1) / replay->keyframe_interval;
+  replay->cursor = replay->index[keyframe];
+
+  bool was_state;
+  while (replay->step < steps && replay_read(replay, &was_state)) {
+  }
+  return replay->step == steps;
+}
+
+bool
+replay_advance(Replay* replay, uint32_t until_ms)
+{
+  bool was_state = false;
+  while (replay->cursor + REPLAY_RECORD_HEADER <= replay->end &&
+         get_u32(replay->data + replay->cursor + 1) <= until_ms) {
+    if (!replay_read(replay, &was_state)) {
+      return false;
+    }
+    if (was_state) {
+      return true;
+    }
+  }
+  return false;
+}
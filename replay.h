@@ -0,0 +1,153 @@
+#ifndef __ME_REPLAY
+#define __ME_REPLAY
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "protocol.h"
+
+/*
+ * Match recordings, written append-only by the client and by the server
+ * with -record (recording.go mirrors the writer). All multi-byte fields are
+ * little endian.
+ *
+ * Header, REPLAY_HEADER_SIZE bytes:
+ *   0  u32  magic, REPLAY_MAGIC
+ *   4  u8   version, REPLAY_VERSION
+ *   5  u8   board size
+ *   6  u8   keyframe interval k
+ *   7  u8   recording seat, REPLAY_SEAT_SERVER for the server
+ *   8  u32  game_id
+ *   12 u32  reserved, 0
+ *
+ * Records, each starting with u8 type and u32 milliseconds since the
+ * recording started:
+ *   REPLAY_KEYFRAME  u32 step, u32 player1_score, u32 player2_score,
+ *                    u8 state (PROTO_STATE_* bits), board packed as in
+ *                    OP_STATE
+ *   REPLAY_DELTA     u32 step, scores and state as above, u16 count,
+ *                    count times u8 cell (y * size + x) and u8 tile
+ *   REPLAY_MOVE      u8 player_id, u8 from, u8 to, as in OP_MOVE
+ *
+ * Every recorded state is one step. Step s is a keyframe when s % k == 0,
+ * otherwise a delta against step s - 1, so a seek decodes at most k
+ * records. Moves are written before the state they produced.
+ *
+ * Closing a recording appends the keyframe index:
+ *   u32 offset[n]   of keyframe i, the record of step i * k
+ *   u32 steps, u32 duration_ms, u32 n, u32 REPLAY_INDEX_MAGIC
+ * A recording cut short has no index; replay_open rebuilds it with one
+ * pass over the records.
+ */
+#define REPLAY_MAGIC 0x50524A42 // "BJRP"
+#define REPLAY_INDEX_MAGIC 0x58444E49 // "INDX"
+#define REPLAY_VERSION 1
+#define REPLAY_HEADER_SIZE 16
+#define REPLAY_RECORD_HEADER 5
+#define REPLAY_STATE_FIXED (REPLAY_RECORD_HEADER + 13)
+#define REPLAY_TRAILER_SIZE 16
+#define REPLAY_KEYFRAME_INTERVAL 32
+#define REPLAY_SEAT_SERVER 0xFF
+#define REPLAY_MAX_SPEED 100.0
+
+typedef enum
+{
+  REPLAY_KEYFRAME = 1,
+  REPLAY_DELTA,
+  REPLAY_MOVE,
+} ReplayRecordType;
+
+typedef struct ReplayWriter
+{
+  FILE* file;
+  int board_size;
+  uint32_t offset; // bytes written so far
+  uint32_t steps;
+  uint32_t last_ms;
+  struct GameState last; // previous step, deltas are taken against it
+  uint32_t* index;
+  uint32_t index_capacity;
+} ReplayWriter;
+
+bool
+replay_writer_open(ReplayWriter* writer,
+                   const char* path,
+                   int board_size,
+                   int seat,
+                   uint32_t game_id);
+
+void
+replay_write_state(ReplayWriter* writer,
+                   struct GameState* state,
+                   uint32_t time_ms);
+
+void
+replay_write_move(ReplayWriter* writer,
+                  int player_id,
+                  int from_x,
+                  int from_y,
+                  int to_x,
+                  int to_y,
+                  uint32_t time_ms);
+
+// Writes the index and closes the file.
+void
+replay_writer_close(ReplayWriter* writer);
+
+typedef struct ReplayMove
+{
+  int player_id;
+  int from_x, from_y, to_x, to_y;
+} ReplayMove;
+
+/*
+ * A mapped recording and a playback cursor. state is the board after
+ * `step` states and time_ms the time of the last record applied.
+ */
+typedef struct Replay
+{
+  const uint8_t* data;
+  size_t size;
+  size_t end; // first byte after the records
+
+  int board_size;
+  int seat;
+  uint32_t game_id;
+  uint32_t keyframe_interval;
+  uint32_t* index;
+  uint32_t keyframes;
+  uint32_t steps;
+  uint32_t duration_ms;
+
+  size_t cursor;
+  uint32_t step; // states applied, 0 before the first one
+  uint32_t time_ms;
+  struct GameState state;
+  bool have_move;
+  ReplayMove move; // last move read, the one that led to state
+} Replay;
+
+bool
+replay_open(Replay* replay, const char* path);
+
+void
+replay_close(Replay* replay);
+
+/*
+ * Moves the cursor so that state is the one after the given number of
+ * steps (clamped to the recording): one index lookup and at most
+ * keyframe_interval records.
+ */
+bool
+replay_seek(Replay* replay, uint32_t steps);
+
+/*
+ * Applies records up to and including the next state that was recorded at
+ * or before until_ms. Returns false when there is none yet or the
+ * recording has ended.
+ */
+bool
+replay_advance(Replay* replay, uint32_t until_ms);
+
+#endif // __ME_REPLAY
@@ -5,22 +5,28 @@
 package main
 
 import (
-	"bytes"
+	"crypto/sha256"
 	"encoding/binary"
+	"flag"
 	"fmt"
-	"math/rand"
 	"net"
+	"net/netip"
+	"os"
+	"runtime"
 	"sync"
+	"sync/atomic"
 	"time"
 )
 
 const (
 	PORT         = 8080
 	BUFLEN       = 512
-	BOARD_SIZE   = 8
 	MIN_MATCH    = 3
 	GAME_TIMEOUT = 30 * time.Second
-	MAX_GAMES    = 100
+
+	// An ack behind the game's newest state only triggers a resend once the
+	// state had time to arrive.
+	STATE_RESEND_GRACE = 20 * time.Millisecond
 )
 
 type Tile int32
@@ -36,19 +42,33 @@ const (
 )
 
 type GameState struct {
+	mu           sync.Mutex
+	Slot         int
+	Closed       bool
 	GameID       int32
-	Board        [BOARD_SIZE][BOARD_SIZE]Tile
+	Board        Board
 	CurrentTurn  int32
 	Player1Score int32
 	Player2Score int32
 	GameStarted  bool
 	GameOver     bool
-	Player1Addr  *net.UDPAddr
-	Player2Addr  *net.UDPAddr
-	LastActivity [2]time.Time
+	Player1Addr  netip.AddrPort
+	Player2Addr  netip.AddrPort
+	Inactivity   [2]Timer
+	StateSeq     uint16
+	StateSentAt  int64     // unix nanoseconds of the last broadcast
+	MoveSeq      [2]uint16 // newest move handled per seat, echoed in every state
+	MoveSeen     [2]bool
+	Recorder     *Recorder   // nil unless -record is given
+	Seed         uint64      // secret, logged so a game can be reproduced
+	Streams      uint64      // refill streams drawn from Seed, one per move
+	Rng          BoardRng    // refills of the next move
+	refill       func() Tile // Rng.tile, bound once
+	Spectators   SpectatorList
 }
 
 type PlayerMove struct {
+	Seq      uint16 // sender's packet sequence
 	PlayerID int32
 	FromX    int
 	FromY    int
@@ -57,231 +77,406 @@ type PlayerMove struct {
 }
 
 var (
-	games      [MAX_GAMES]GameState
-	gameCount  int
-	nextGameID int = 1
-	gameMutex  sync.Mutex
+	table        = newGameTable()
+	wheel        *TimerWheel
+	gameTimeout  = GAME_TIMEOUT
+	boardDefault = boardVariantFor(BOARD_DEFAULT_SIZE)
+	seedCounter  atomic.Uint64
 )
 
-func (g *GameState) Serialize() ([]byte, error) {
-	buf := new(bytes.Buffer)
-
-	// fixed-size fields
-	if err := binary.Write(buf, binary.LittleEndian, g.GameID); err != nil {
-		return nil, err
-	}
-
-	if err := binary.Write(buf, binary.LittleEndian, g.Board); err != nil {
-		return nil, err
+// Queues the player for the board size they asked for, or renews their
+// ticket. Players only ever meet others who asked for the same size.
+func joinGame(out *Outbox, addr netip.AddrPort, size int, rating int) {
+	if game := seatOrQueue(out, addr, size, rating); game != nil {
+		game.begin(out)
 	}
+}
 
-	if err := binary.Write(buf, binary.LittleEndian, g.CurrentTurn); err != nil {
-		return nil, err
-	}
+// The table side of joinGame, the game a match started if any.
+func seatOrQueue(out *Outbox, addr netip.AddrPort, size int, rating int) *GameState {
+	table.mu.Lock()
+	defer table.mu.Unlock()
 
-	if err := binary.Write(buf, binary.LittleEndian, g.Player1Score); err != nil {
-		return nil, err
+	if logEnabled(CAT_GAME, LOG_DEBUG) {
+		logWrite(CAT_GAME, LOG_DEBUG, "Attempting to join game for player at %v", addr)
 	}
 
-	if err := binary.Write(buf, binary.LittleEndian, g.Player2Score); err != nil {
-		return nil, err
+	if ref, ok := table.players[addr]; ok {
+		if logEnabled(CAT_GAME, LOG_INFO) {
+			logWrite(CAT_GAME, LOG_INFO, "Player %v already seated in game %d", addr, ref.Game.GameID)
+		}
+		sendPlayerID(out, addr, ref.Seat)
+		return nil
 	}
 
-	if err := binary.Write(buf, binary.LittleEndian, g.GameStarted); err != nil {
-		return nil, err
+	variant := boardDefault
+	if size != 0 {
+		if variant = boardVariantFor(size); variant == nil {
+			if logEnabled(CAT_GAME, LOG_INFO) {
+				logWrite(CAT_GAME, LOG_INFO, "Player %v asked for unsupported board size %d", addr, size)
+			}
+			variant = boardDefault
+		}
 	}
-
-	if err := binary.Write(buf, binary.LittleEndian, g.GameOver); err != nil {
-		return nil, err
+	if rating < 0 {
+		rating = RATING_DEFAULT
 	}
 
-	return buf.Bytes(), nil
+	return table.join(out, addr, variant, rating, time.Now().UnixNano())
 }
 
-func joinGame(conn *net.UDPConn, addr *net.UDPAddr) {
-	gameMutex.Lock()
-	defer gameMutex.Unlock()
-
-	fmt.Printf("Attempting to join game for player at %v\n", addr)
+// Allocates a game for two matched players, the first queued taking seat 0.
+// Must be called with t.mu held. The game is returned locked; the caller
+// releases t.mu and then calls begin, which unlocks it.
+func (t *GameTable) startGame(out *Outbox, first, second *Ticket, matched int64) *GameState {
+	game := t.allocate(first.Variant)
+	game.mu.Lock()
+
+	for seat, ticket := range [2]*Ticket{first, second} {
+		t.players[ticket.Addr] = PlayerRef{Game: game, Seat: seat}
+		sendPlayerID(out, ticket.Addr, seat)
+	}
+	game.Player1Addr = first.Addr
+	game.Player2Addr = second.Addr
+	game.GameStarted = true
+	game.CurrentTurn = 0
+	now := time.Now()
+	for seat := range game.Inactivity {
+		timer := &game.Inactivity[seat]
+		timer.Game = game
+		timer.Seat = seat
+		wheel.arm(timer, now.Add(gameTimeout))
+	}
+	if logEnabled(CAT_GAME, LOG_INFO) {
+		logWrite(CAT_GAME, LOG_INFO, "Matched %v (rating %d) and %v (rating %d) in game %d after %v",
+			first.Addr, first.Rating, second.Addr, second.Rating, game.GameID,
+			time.Duration(matched-first.Queued).Round(time.Millisecond))
+	}
+	return game
+}
 
-	var game *GameState
-	for i := range games {
-		if games[i].GameID != 0 && !games[i].GameStarted {
-			game = &games[i]
-			fmt.Printf("Found existing game %d\n", game.GameID)
-			break
+// Deals the board of a game startGame returned, opens its recording and
+// sends the first state, then unlocks it. Runs without table.mu so the
+// recording's file I/O holds up nobody but the game's own players.
+func (game *GameState) begin(out *Outbox) {
+	defer game.mu.Unlock()
+
+	variant := game.Board.Variant
+	game.seedRng(newGameSeed())
+	game.Board = generateBoard(variant, game.refill)
+	game.nextStream()
+	if logEnabled(CAT_GAME, LOG_INFO) {
+		logWrite(CAT_GAME, LOG_INFO, "Game %d started on a %dx%d board. Seed %#x",
+			game.GameID, variant.Size, variant.Size, game.Seed)
+	}
+	if recordDir != "" {
+		recorder, err := newRecorder(recordDir, game)
+		if err != nil {
+			logf(CAT_GAME, LOG_WARN, "Cannot record game %d: %v", game.GameID, err)
 		}
+		game.Recorder = recorder
 	}
+	broadcastGameState(out, game)
+}
 
-	if game == nil {
-		for i := range games {
-			if games[i].GameID == 0 {
-				games[i].GameID = int32(nextGameID)
-				nextGameID++
-				game = &games[i]
-				gameCount++
-				fmt.Printf("Created new game %d\n", game.GameID)
-				break
-			}
-		}
+func main() {
+	logLevel := flag.String("log-level", "info", "debug, info, warn, error or off")
+	logSample := flag.String("log-sample", "", "keep 1 in N debug/info entries per category, e.g. net=100,board=10")
+	flag.DurationVar(&gameTimeout, "timeout", GAME_TIMEOUT, "inactivity before a player is disconnected")
+	timeoutTick := flag.Duration("timeout-tick", DEFAULT_TIMEOUT_TICK, "precision of inactivity timeouts")
+	boardSize := flag.Int("board-size", BOARD_DEFAULT_SIZE, "board size for players that do not ask for one")
+	flag.StringVar(&recordDir, "record", "", "directory to record every game to, replay with game_client -r")
+	flag.DurationVar(&matchMaxWait, "match-wait", MATCH_MAX_WAIT, "queue time before a player accepts opponents one rating bucket further away")
+	flag.IntVar(&ratingBucket, "rating-bucket", DEFAULT_RATING_BUCKET, "rating points per matchmaking bucket")
+	flag.Parse()
+
+	if boardDefault = boardVariantFor(*boardSize); boardDefault == nil {
+		fmt.Fprintf(os.Stderr, "unsupported board size %d\n", *boardSize)
+		os.Exit(2)
 	}
 
-	if game == nil {
-		fmt.Println("Max games reached!")
-		return
+	if *timeoutTick <= 0 {
+		fmt.Fprintln(os.Stderr, "timeout-tick must be positive")
+		os.Exit(2)
 	}
+	wheel = newTimerWheel(*timeoutTick)
 
-	if game.Player1Addr == nil {
-		game.Player1Addr = addr
-		sendPlayerID(conn, addr, 0)
-		fmt.Printf("Player 1 connected to game %d\n", game.GameID)
-	} else if game.Player2Addr == nil && !addrEqual(game.Player1Addr, addr) {
-		game.Player2Addr = addr
-		sendPlayerID(conn, addr, 1)
-		game.GameStarted = true
-		game.CurrentTurn = 0
-		game.LastActivity[0] = time.Now()
-		game.LastActivity[1] = time.Now()
-		game.Board = generateBoard()
-		fmt.Printf("Player 2 connected to game %d. Game started!\n", game.GameID)
-		broadcastGameState(conn, game)
-	} else {
-		fmt.Printf("Unable to join game %d. Game full or already started.\n", game.GameID)
+	if matchMaxWait <= 0 || ratingBucket <= 0 {
+		fmt.Fprintln(os.Stderr, "match-wait and rating-bucket must be positive")
+		os.Exit(2)
 	}
 
-	fmt.Printf("Game %d state: Started=%v, Player1=%v, Player2=%v\n",
-		game.GameID, game.GameStarted, game.Player1Addr, game.Player2Addr)
-}
+	level, ok := parseLogLevel(*logLevel)
+	if !ok {
+		fmt.Fprintf(os.Stderr, "unknown log level %q\n", *logLevel)
+		os.Exit(2)
+	}
+	logger.level.Store(int32(level))
+	if err := parseLogSampling(*logSample); err != nil {
+		fmt.Fprintln(os.Stderr, err)
+		os.Exit(2)
+	}
 
-func main() {
 	addr := net.UDPAddr{
 		Port: PORT,
 		IP:   net.ParseIP("0.0.0.0"),
 	}
 	conn, err := net.ListenUDP("udp", &addr)
 	if err != nil {
-		fmt.Println("Error listening:", err)
+		logf(CAT_SERVER, LOG_ERROR, "Error listening: %v", err)
+		logger.Close()
 		return
 	}
 	defer conn.Close()
 
-	fmt.Printf("Server started on port %d\n", PORT)
+	logf(CAT_SERVER, LOG_INFO, "Server started on port %d", PORT)
 
-	go checkForDisconnects(conn)
+	timeouts := newOutbox(conn)
+	go wheel.run(func(fired []*Timer) {
+		for _, t := range fired {
+			expirePlayer(timeouts, t)
+		}
+		timeouts.flush()
+	})
 
-	for {
-		handleClient(conn)
+	go runMatchmaker(newOutbox(conn))
+
+	for i := 0; i < runtime.NumCPU(); i++ {
+		go runFanout(conn)
 	}
+
+	// games lock independently, so packets for different games are handled
+	// in parallel by one reader per core
+	for i := 1; i < runtime.NumCPU(); i++ {
+		go serveClients(conn)
+	}
+	serveClients(conn)
 }
 
-func handleClient(conn *net.UDPConn) {
+func serveClients(conn *net.UDPConn) {
 	buffer := make([]byte, BUFLEN)
-	n, remoteAddr, err := conn.ReadFromUDP(buffer)
+	out := newOutbox(conn)
+	for {
+		handleClient(conn, out, buffer)
+		out.flush()
+	}
+}
+
+func handleClient(conn *net.UDPConn, out *Outbox, buffer []byte) {
+	n, remoteAddr, err := conn.ReadFromUDPAddrPort(buffer)
 	if err != nil {
-		fmt.Println("Error reading from UDP:", err)
+		logf(CAT_NET, LOG_WARN, "Error reading from UDP: %v", err)
 		return
 	}
 
-	message := string(buffer[:n])
-	fmt.Printf("Received message from %v: %s\n", remoteAddr, message)
+	packet := buffer[:n]
+	var header PacketHeader
+	if !readHeader(packet, &header) {
+		if logEnabled(CAT_NET, LOG_INFO) {
+			logWrite(CAT_NET, LOG_INFO, "Dropped malformed packet from %v (%d bytes)", remoteAddr, n)
+		}
+		return
+	}
 
-	if message == "CONNECT" {
-		joinGame(conn, remoteAddr)
-	} else if message == "DISCONNECT" {
-		disconnectPlayer(conn, remoteAddr)
-	} else {
-		handlePlayerMove(conn, remoteAddr, message)
+	if logEnabled(CAT_NET, LOG_DEBUG) {
+		logWrite(CAT_NET, LOG_DEBUG, "Received opcode %d seq %d from %v", header.Opcode, header.Seq, remoteAddr)
+	}
+
+	switch header.Opcode {
+	case OP_CONNECT:
+		size, rating := decodeConnect(packet)
+		joinGame(out, remoteAddr, size, rating)
+	case OP_DISCONNECT:
+		disconnectPlayer(out, remoteAddr)
+	case OP_MOVE:
+		handlePlayerMove(out, remoteAddr, packet)
+	case OP_SPECTATE:
+		handleSpectate(out, remoteAddr, packet)
+	case OP_ACK:
+		handleAck(out, remoteAddr, packet)
 	}
 }
 
-func addrEqual(addr1, addr2 *net.UDPAddr) bool {
-	return addr1.IP.Equal(addr2.IP) && addr1.Port == addr2.Port
+// Distinct seeds without a shared lock: a splitmix64 step over an atomic
+// counter that starts from the clock.
+func newGameSeed() uint64 {
+	z := seedCounter.Add(0x9E3779B97F4A7C15)
+	z = (z ^ z>>30) * 0xBF58476D1CE4E5B9
+	z = (z ^ z>>27) * 0x94D049BB133111EB
+	return z ^ z>>31
 }
 
-func generateBoard() [BOARD_SIZE][BOARD_SIZE]Tile {
-	var board [BOARD_SIZE][BOARD_SIZE]Tile
-	for i := 0; i < BOARD_SIZE; i++ {
-		for j := 0; j < BOARD_SIZE; j++ {
-			board[i][j] = Tile(rand.Intn(5) + 1)
-		}
-	}
-	return board
+func (game *GameState) seedRng(seed uint64) {
+	game.Seed = seed
+	game.Streams = 0
+	game.refill = game.Rng.tile
+	game.nextStream()
 }
 
-func sendPlayerID(conn *net.UDPConn, addr *net.UDPAddr, playerID int) {
-	message := fmt.Sprintf("PLAYER_ID:%d", playerID)
-	_, err := conn.WriteToUDP([]byte(message), addr)
-	if err != nil {
-		fmt.Println("Error sending player ID:", err)
-	}
+// Starts a fresh refill stream for the next move. OP_STATE carries the
+// generator so clients can predict that move's refills exactly; the streams
+// come from the secret seed through SHA-256, so one stream tells nothing
+// about the next and no one can plan cascades moves ahead.
+func (game *GameState) nextStream() {
+	var key [16]byte
+	binary.LittleEndian.PutUint64(key[:], game.Seed)
+	binary.LittleEndian.PutUint64(key[8:], game.Streams)
+	sum := sha256.Sum256(key[:])
+	game.Rng.seed(binary.LittleEndian.Uint64(sum[:]))
+	game.Streams++
 }
 
-func disconnectPlayer(conn *net.UDPConn, addr *net.UDPAddr) {
-	gameMutex.Lock()
-	defer gameMutex.Unlock()
+func generateBoard(variant *BoardVariant, refill func() Tile) Board {
+	board := Board{Variant: variant, moves: &MoveIndex{}}
+	board.deal(refill)
+	return board
+}
 
-	for i := range games {
-		if (games[i].Player1Addr != nil && addrEqual(games[i].Player1Addr, addr)) ||
-			(games[i].Player2Addr != nil && addrEqual(games[i].Player2Addr, addr)) {
-			games[i].GameOver = true
-			broadcastGameState(conn, &games[i])
-			fmt.Printf("Player disconnected from game %d. Game reset.\n", games[i].GameID)
-			games[i] = GameState{}
-			gameCount--
-			break
+func sendPlayerID(out *Outbox, addr netip.AddrPort, playerID int) {
+	n := encodePlayerID(out.next(), 0, playerID)
+	out.commit(n, addr)
+}
+
+// Ends the game and broadcasts the final state. Must be called with
+// game.mu held; the caller releases the slot with table.release afterwards.
+func closeGame(out *Outbox, game *GameState) {
+	game.GameOver = true
+	broadcastGameState(out, game)
+	game.Closed = true
+	if game.Recorder != nil {
+		if err := game.Recorder.Close(); err != nil {
+			logf(CAT_GAME, LOG_WARN, "Recording of game %d failed: %v", game.GameID, err)
 		}
+		game.Recorder = nil
 	}
+	wheel.cancel(&game.Inactivity[0])
+	wheel.cancel(&game.Inactivity[1])
 }
 
-func broadcastGameState(conn *net.UDPConn, game *GameState) {
-	data, err := game.Serialize()
-	if err != nil {
-		fmt.Println("Error serializing game state:", err)
+func disconnectPlayer(out *Outbox, addr netip.AddrPort) {
+	if table.leaveQueue(addr) {
+		if logEnabled(CAT_GAME, LOG_INFO) {
+			logWrite(CAT_GAME, LOG_INFO, "Player %v left the queue", addr)
+		}
+		return
+	}
+	ref, ok := table.lookup(addr)
+	if !ok {
 		return
 	}
 
-	if game.Player1Addr != nil {
-		_, err := conn.WriteToUDP(data, game.Player1Addr)
-		if err != nil {
-			fmt.Printf("Error sending to player 1 (%v): %v\n", game.Player1Addr, err)
-		} else {
-			fmt.Printf("Sent game state to player 1 (%v)\n", game.Player1Addr)
-		}
+	game := ref.Game
+	game.mu.Lock()
+	if game.Closed {
+		game.mu.Unlock()
+		return
+	}
+	closeGame(out, game)
+	if logEnabled(CAT_GAME, LOG_INFO) {
+		logWrite(CAT_GAME, LOG_INFO, "Player disconnected from game %d. Game reset.", game.GameID)
 	}
+	game.mu.Unlock()
 
-	if game.Player2Addr != nil {
-		_, err := conn.WriteToUDP(data, game.Player2Addr)
-		if err != nil {
-			fmt.Printf("Error sending to player 2 (%v): %v\n", game.Player2Addr, err)
+	table.release(game)
+}
+
+// Encodes the state once into the outbox and queues it for both players;
+// the datagrams go out with the outbox's next flush. Spectators get a copy
+// of the same bytes through the fan-out.
+func broadcastGameState(out *Outbox, game *GameState) {
+	game.StateSeq++
+	game.StateSentAt = time.Now().UnixNano()
+	packet := out.next()
+	n := encodeState(packet, game.StateSeq, game)
+	if game.Recorder != nil {
+		game.Recorder.writeState(game)
+	}
+	game.Spectators.publish(packet[:n], game.StateSeq, game.GameOver)
+
+	queued := false
+	for _, addr := range [2]netip.AddrPort{game.Player1Addr, game.Player2Addr} {
+		if !addr.IsValid() {
+			continue
+		}
+		if queued {
+			out.repeat(addr)
 		} else {
-			fmt.Printf("Sent game state to player 2 (%v)\n", game.Player2Addr)
+			out.commit(n, addr)
+			queued = true
 		}
 	}
+
+	if logEnabled(CAT_NET, LOG_DEBUG) {
+		logWrite(CAT_NET, LOG_DEBUG, "Queued game %d state seq %d", game.GameID, game.StateSeq)
+	}
 }
 
-func checkForDisconnects(conn *net.UDPConn) {
-	for {
-		time.Sleep(time.Second)
-		gameMutex.Lock()
-		for i := range games {
-			game := &games[i]
-			if game.GameStarted && !game.GameOver {
-				for player := 0; player < 2; player++ {
-					if time.Since(game.LastActivity[player]) > GAME_TIMEOUT {
-						fmt.Printf("Player %d disconnected from game %d\n", player+1, game.GameID)
-						game.GameOver = true
-						broadcastGameState(conn, game)
-						games[i] = GameState{}
-						gameCount--
-						break
-					}
-				}
-			}
-		}
-		gameMutex.Unlock()
+// Sends the newest state again to one address, under the same sequence.
+func sendState(out *Outbox, game *GameState, addr netip.AddrPort) {
+	if addr.IsValid() {
+		out.commit(encodeState(out.next(), game.StateSeq, game), addr)
 	}
 }
 
+func (game *GameState) seatAddr(seat int32) netip.AddrPort {
+	if seat == 0 {
+		return game.Player1Addr
+	}
+	return game.Player2Addr
+}
+
+// Resends the newest state to a player whose ack trails it, once the
+// grace for the state to arrive has passed.
+func handleAck(out *Outbox, addr netip.AddrPort, packet []byte) {
+	ack, ok := decodeAck(packet)
+	if !ok {
+		return
+	}
+	ref, ok := table.lookup(addr)
+	if !ok {
+		return
+	}
+
+	game := ref.Game
+	game.mu.Lock()
+	defer game.mu.Unlock()
+
+	if game.Closed || !seqNewer(game.StateSeq, ack) ||
+		time.Now().UnixNano()-game.StateSentAt < int64(STATE_RESEND_GRACE) {
+		return
+	}
+	sendState(out, game, addr)
+	if logEnabled(CAT_NET, LOG_DEBUG) {
+		logWrite(CAT_NET, LOG_DEBUG, "Resent game %d state seq %d to %v, acked %d", game.GameID, game.StateSeq, addr, ack)
+	}
+}
+
+// Called by the timer wheel once a seat's deadline has passed.
+func expirePlayer(out *Outbox, t *Timer) {
+	game := t.Game
+	game.mu.Lock()
+
+	if game.Closed || !game.GameStarted || game.GameOver {
+		game.mu.Unlock()
+		return
+	}
+
+	// a move may have landed between the wheel firing and taking the lock
+	if deadline := t.deadline.Load(); deadline > time.Now().UnixNano() {
+		wheel.arm(t, time.Unix(0, deadline))
+		game.mu.Unlock()
+		return
+	}
+
+	if logEnabled(CAT_GAME, LOG_INFO) {
+		logWrite(CAT_GAME, LOG_INFO, "Player %d disconnected from game %d", t.Seat+1, game.GameID)
+	}
+	closeGame(out, game)
+	game.mu.Unlock()
+
+	table.release(game)
+}
+
 func abs(x int) int {
 	if x < 0 {
 		return -x
@@ -290,116 +485,179 @@ func abs(x int) int {
 }
 
 func init() {
-	rand.Seed(time.Now().UnixNano())
-}
-
-func isWithinBounds(x, y int) bool {
-	return x >= 0 && x < BOARD_SIZE && y >= 0 && y < BOARD_SIZE
+	seedCounter.Store(uint64(time.Now().UnixNano()))
 }
 
-func removeMatches(board *[BOARD_SIZE][BOARD_SIZE]Tile, matches []Match) {
+func removeMatches(board *Cells, matches []Match) {
 	for _, match := range matches {
 		for _, point := range match.Points {
-			(*board)[point.y][point.x] = Empty
+			board[point.y][point.x] = Empty
 		}
 	}
 }
 
-func processPlayerMove(conn *net.UDPConn, game *GameState, move *PlayerMove) {
+func processPlayerMove(out *Outbox, game *GameState, move *PlayerMove) {
+	if move.PlayerID < 0 || move.PlayerID > 1 {
+		logf(CAT_MOVE, LOG_INFO, "Invalid PlayerID.")
+		return
+	}
+	seat := move.PlayerID
+
 	if !game.GameStarted || game.GameOver {
-		fmt.Println("Invalid move. Game not started or already over.")
+		rejectMove(out, game, seat, "Invalid move. Game not started or already over.")
 		return
 	}
 
-	if move.PlayerID < 0 || move.PlayerID > 1 {
-		fmt.Println("Invalid PlayerID.")
+	// moves are retransmitted until a state acks them, so a move seen
+	// before only means the state in answer was lost
+	if game.MoveSeen[seat] && !seqNewer(move.Seq, game.MoveSeq[seat]) {
+		if logEnabled(CAT_MOVE, LOG_DEBUG) {
+			logWrite(CAT_MOVE, LOG_DEBUG, "Duplicate move %d from player %d, state resent.", move.Seq, seat+1)
+		}
+		sendState(out, game, game.seatAddr(seat))
 		return
 	}
+	game.MoveSeq[seat], game.MoveSeen[seat] = move.Seq, true
 
-	if !isWithinBounds(move.FromX, move.FromY) || !isWithinBounds(move.ToX, move.ToY) {
-		fmt.Println("Move coordinates out of bounds.")
+	if !game.Board.inBounds(move.FromX, move.FromY) || !game.Board.inBounds(move.ToX, move.ToY) {
+		rejectMove(out, game, seat, "Move coordinates out of bounds.")
 		return
 	}
 
-	game.LastActivity[move.PlayerID] = time.Now()
+	game.Inactivity[move.PlayerID].touch(time.Now().Add(gameTimeout))
 
 	if int32(move.PlayerID) != game.CurrentTurn {
-		fmt.Println("Invalid move. Not player's turn.")
+		rejectMove(out, game, seat, "Invalid move. Not player's turn.")
 		return
 	}
 
-	if !isValidMove(game.Board, move) {
-		fmt.Println("Invalid move. Tiles not adjacent.")
+	if !isValidMove(move) {
+		rejectMove(out, game, seat, "Invalid move. Tiles not adjacent.")
+		return
+	}
+
+	if game.Recorder != nil {
+		game.Recorder.writeMove(move)
+	}
+
+	totalScore := applyMove(&game.Board, move, game.refill)
+	if totalScore == 0 {
+		broadcastGameState(out, game)
 		return
 	}
+	game.nextStream()
 
-	// swap tiles
-	game.Board[move.FromY][move.FromX], game.Board[move.ToY][move.ToX] =
-		game.Board[move.ToY][move.ToX], game.Board[move.FromY][move.FromX]
+	if move.PlayerID == 0 {
+		game.Player1Score += totalScore
+	} else {
+		game.Player2Score += totalScore
+	}
 
-	fmt.Println("Tiles swapped. Checking for matches...")
-	printBoard(game.Board)
+	game.CurrentTurn = (game.CurrentTurn + 1) % 2
 
+	if logEnabled(CAT_MOVE, LOG_INFO) {
+		logWrite(CAT_MOVE, LOG_INFO, "Player %d scored %d points this move.", move.PlayerID+1, totalScore)
+	}
+	broadcastGameState(out, game)
+}
+
+// Answers a move that changes nothing with the current state, which acks
+// it so the sender stops retransmitting.
+func rejectMove(out *Outbox, game *GameState, seat int32, reason string) {
+	if logEnabled(CAT_MOVE, LOG_INFO) {
+		logWrite(CAT_MOVE, LOG_INFO, "%s", reason)
+	}
+	sendState(out, game, game.seatAddr(seat))
+}
+
+// Swaps the tiles and runs the cascade to completion, drawing refills from
+// refill. A swap that matches nothing is reverted and scores 0; with a move
+// index it is turned away before the swap, and a board left without moves
+// is dealt again.
+func applyMove(board *Board, move *PlayerMove, refill func() Tile) int32 {
+	if board.moves != nil && !board.moves.legal(move) {
+		logf(CAT_MOVE, LOG_DEBUG, "Swap completes no match. Move rejected.")
+		return 0
+	}
+
+	cells := &board.Cells
+	cells[move.FromY][move.FromX], cells[move.ToY][move.ToX] =
+		cells[move.ToY][move.ToX], cells[move.FromY][move.FromX]
+
+	logf(CAT_MOVE, LOG_DEBUG, "Tiles swapped. Checking for matches...")
+	logBoard(board)
+
+	totalScore := resolveCascade(board, refill)
+	if totalScore == 0 {
+		cells[move.FromY][move.FromX], cells[move.ToY][move.ToX] =
+			cells[move.ToY][move.ToX], cells[move.FromY][move.FromX]
+		logf(CAT_MOVE, LOG_DEBUG, "No matches found. Move reverted.")
+	} else if moves := board.moves; moves != nil {
+		moves.touch(move.FromX, move.FromY)
+		moves.touch(move.ToX, move.ToY)
+		moves.refresh(board)
+		if moves.count == 0 {
+			board.deal(refill)
+			logf(CAT_GAME, LOG_INFO, "No moves left, board dealt again.")
+			logBoard(board)
+		}
+	}
+	return totalScore
+}
+
+// Clears matches, drops and refills until the board is stable and returns
+// the points scored on the way. The kernels come from the board's size
+// variant.
+func resolveCascade(board *Board, refill func() Tile) int32 {
+	variant := board.Variant
+	cells := &board.Cells
 	totalScore := int32(0)
-	matchesFound := false
 
 	for {
-		matches := findMatches(game.Board)
+		matches := variant.findMatches(cells)
 		if len(matches) == 0 {
 			break
 		}
-		matchesFound = true
 
 		for _, match := range matches {
 			matchScore := int32(len(match.Points) * 10)
 			totalScore += matchScore
 		}
 
-		removeMatches(&game.Board, matches)
+		removeMatches(cells, matches)
+		if board.moves != nil {
+			for _, match := range matches {
+				for _, point := range match.Points {
+					board.moves.cleared(point)
+				}
+			}
+		}
 		for _, match := range matches {
 			if len(match.Points) > MIN_MATCH {
-				spawnSpecialTile(&game.Board, match)
+				spawnSpecialTile(cells, match)
 			}
 		}
 
-		fmt.Println("Matches removed and special tiles spawned. Board after removal:")
-		printBoard(game.Board)
-
-		dropTiles(&game.Board)
-		fmt.Println("Tiles dropped. Board after dropping:")
-		printBoard(game.Board)
+		logf(CAT_MOVE, LOG_DEBUG, "Matches removed and special tiles spawned. Board after removal:")
+		logBoard(board)
 
-		fillEmptySpaces(&game.Board)
-		fmt.Println("Empty spaces filled. Board after filling:")
-		printBoard(game.Board)
-	}
+		variant.dropTiles(cells)
+		logf(CAT_MOVE, LOG_DEBUG, "Tiles dropped. Board after dropping:")
+		logBoard(board)
 
-	if !matchesFound {
-		game.Board[move.FromY][move.FromX], game.Board[move.ToY][move.ToX] =
-			game.Board[move.ToY][move.ToX], game.Board[move.FromY][move.FromX]
-		fmt.Println("No matches found. Move reverted.")
-		broadcastGameState(conn, game)
-		return
+		variant.fillEmptySpaces(cells, refill)
+		logf(CAT_MOVE, LOG_DEBUG, "Empty spaces filled. Board after filling:")
+		logBoard(board)
 	}
 
-	if move.PlayerID == 0 {
-		game.Player1Score += totalScore
-	} else {
-		game.Player2Score += totalScore
-	}
-
-	game.CurrentTurn = (game.CurrentTurn + 1) % 2
-
-	fmt.Printf("Player %d scored %d points this move.\n", move.PlayerID+1, totalScore)
-	broadcastGameState(conn, game)
+	return totalScore
 }
 
-func printBoard(board [BOARD_SIZE][BOARD_SIZE]Tile) {
-	for i := 0; i < BOARD_SIZE; i++ {
-		for j := 0; j < BOARD_SIZE; j++ {
-			fmt.Printf("%s ", tileToString(board[i][j]))
-		}
-		fmt.Println()
+// Board dumps are debug-only and copied so the writer formats a stable
+// snapshot.
+func logBoard(board *Board) {
+	if logEnabled(CAT_BOARD, LOG_DEBUG) {
+		logWrite(CAT_BOARD, LOG_DEBUG, "%v", boardDump(*board))
 	}
 }
 
@@ -424,7 +682,7 @@ func tileToString(t Tile) string {
 	}
 }
 
-func isValidMove(board [BOARD_SIZE][BOARD_SIZE]Tile, move *PlayerMove) bool {
+func isValidMove(move *PlayerMove) bool {
 	return (abs(move.FromX-move.ToX) == 1 && move.FromY == move.ToY) ||
 		(abs(move.FromY-move.ToY) == 1 && move.FromX == move.ToX)
 }
@@ -438,107 +696,41 @@ type Match struct {
 	Direction string // "horizontal" or "vertical"
 }
 
-func findMatches(board [BOARD_SIZE][BOARD_SIZE]Tile) []Match {
-	var matches []Match
-
-	// horizontal matches
-	for y := 0; y < BOARD_SIZE; y++ {
-		x := 0
-		for x < BOARD_SIZE {
-			currentTile := board[y][x]
-			if currentTile == Empty {
-				x++
-				continue
-			}
-			match := []Point{{x, y}}
-			k := x + 1
-			for k < BOARD_SIZE && board[y][k] == currentTile {
-				match = append(match, Point{k, y})
-				k++
-			}
-			if len(match) >= MIN_MATCH {
-				matches = append(matches, Match{Points: match, Direction: "horizontal"})
-			}
-			x = k
-		}
-	}
-
-	// vertical matches
-	for x := 0; x < BOARD_SIZE; x++ {
-		y := 0
-		for y < BOARD_SIZE {
-			currentTile := board[y][x]
-			if currentTile == Empty {
-				y++
-				continue
-			}
-			match := []Point{{x, y}}
-			k := y + 1
-			for k < BOARD_SIZE && board[k][x] == currentTile {
-				match = append(match, Point{x, k})
-				k++
-			}
-			if len(match) >= MIN_MATCH {
-				matches = append(matches, Match{Points: match, Direction: "vertical"})
-			}
-			y = k
-		}
-	}
-
-	return matches
-}
-
-func spawnSpecialTile(board *[BOARD_SIZE][BOARD_SIZE]Tile, match Match) {
+func spawnSpecialTile(board *Cells, match Match) {
 	centerIndex := len(match.Points) / 2
 	specialX := match.Points[centerIndex].x
 	specialY := match.Points[centerIndex].y
 
 	board[specialY][specialX] = Special
-	fmt.Printf("Special tile spawned at (%d, %d)\n", specialX, specialY)
+	if logEnabled(CAT_MOVE, LOG_DEBUG) {
+		logWrite(CAT_MOVE, LOG_DEBUG, "Special tile spawned at (%d, %d)", specialX, specialY)
+	}
 }
 
-func dropTiles(board *[BOARD_SIZE][BOARD_SIZE]Tile) {
-	for x := 0; x < BOARD_SIZE; x++ {
-		emptyRow := BOARD_SIZE - 1
-		for y := BOARD_SIZE - 1; y >= 0; y-- {
-			if (*board)[y][x] != Empty {
-				(*board)[emptyRow][x] = (*board)[y][x]
-				if emptyRow != y {
-					(*board)[y][x] = Empty
-				}
-				emptyRow--
-			}
-		}
+func handlePlayerMove(out *Outbox, addr netip.AddrPort, packet []byte) {
+	var move PlayerMove
+	if !decodeMove(packet, &move) {
+		logf(CAT_NET, LOG_INFO, "Error parsing move: short packet")
+		return
 	}
-}
 
-func fillEmptySpaces(board *[BOARD_SIZE][BOARD_SIZE]Tile) {
-	for y := 0; y < BOARD_SIZE; y++ {
-		for x := 0; x < BOARD_SIZE; x++ {
-			if (*board)[y][x] == Empty {
-				(*board)[y][x] = Tile(rand.Intn(5) + 1)
-			}
-		}
+	ref, ok := table.lookup(addr)
+	if !ok {
+		return
 	}
-}
 
-func handlePlayerMove(conn *net.UDPConn, addr *net.UDPAddr, message string) {
-	var move PlayerMove
-	_, err := fmt.Sscanf(message, "%d %d %d %d %d", &move.PlayerID, &move.FromX, &move.FromY, &move.ToX, &move.ToY)
-	if err != nil {
-		fmt.Println("Error parsing move:", err)
+	if int(move.PlayerID) != ref.Seat {
+		if logEnabled(CAT_MOVE, LOG_WARN) {
+			logWrite(CAT_MOVE, LOG_WARN, "Move from %v claims player %d but holds seat %d", addr, move.PlayerID, ref.Seat)
+		}
 		return
 	}
 
-	gameMutex.Lock()
-	defer gameMutex.Unlock()
+	game := ref.Game
+	game.mu.Lock()
+	defer game.mu.Unlock()
 
-	for i := range games {
-		game := &games[i]
-		if (game.Player1Addr != nil && addrEqual(game.Player1Addr, addr)) ||
-			(game.Player2Addr != nil && addrEqual(game.Player2Addr, addr)) {
-			processPlayerMove(conn, game, &move)
-			break
-		}
+	if !game.Closed {
+		processPlayerMove(out, game, &move)
 	}
 }
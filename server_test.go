@@ -0,0 +1,706 @@
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"net"
+	"net/netip"
+	"os"
+	"os/exec"
+	"strings"
+	"testing"
+	"time"
+)
+
+// Loopback sink for outbox sends; nobody reads it, the kernel drops what
+// does not fit.
+func newTestOutbox(tb testing.TB) (*Outbox, netip.AddrPort) {
+	conn, err := net.ListenUDP("udp", &net.UDPAddr{IP: net.IPv4(127, 0, 0, 1)})
+	if err != nil {
+		tb.Fatal(err)
+	}
+	sink, err := net.ListenUDP("udp", &net.UDPAddr{IP: net.IPv4(127, 0, 0, 1)})
+	if err != nil {
+		tb.Fatal(err)
+	}
+	tb.Cleanup(func() {
+		conn.Close()
+		sink.Close()
+	})
+	return newOutbox(conn), sink.LocalAddr().(*net.UDPAddr).AddrPort()
+}
+
+func newTestGame(addr netip.AddrPort) *GameState {
+	game := &GameState{GameID: 1, GameStarted: true}
+	game.seedRng(1)
+	game.Board = generateBoard(boardDefault, game.refill)
+	game.Player1Addr = addr
+	game.Player2Addr = addr
+	return game
+}
+
+func TestBroadcastDoesNotAllocate(t *testing.T) {
+	out, addr := newTestOutbox(t)
+	game := newTestGame(addr)
+
+	allocs := testing.AllocsPerRun(1000, func() {
+		broadcastGameState(out, game)
+		out.flush()
+	})
+	if allocs != 0 {
+		t.Fatalf("broadcastGameState allocates %.1f times per call", allocs)
+	}
+}
+
+func BenchmarkBroadcastGameState(b *testing.B) {
+	out, addr := newTestOutbox(b)
+	game := newTestGame(addr)
+
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		broadcastGameState(out, game)
+		out.flush()
+	}
+}
+
+// Sixteen games per flush, as the timer wheel or a busy reader would queue
+// them.
+func BenchmarkBroadcastBatched(b *testing.B) {
+	out, addr := newTestOutbox(b)
+	games := make([]*GameState, 16)
+	for i := range games {
+		games[i] = newTestGame(addr)
+	}
+
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		for _, game := range games {
+			broadcastGameState(out, game)
+		}
+		out.flush()
+	}
+}
+
+const (
+	BENCH_SEED   = 0x9E3779B97F4A7C15
+	BENCH_BOARDS = 1024
+	DIFF_CASES   = 20000
+	DIFF_REFILLS = 256
+)
+
+// xorshift64, the same stream enginebench.c draws from, so both harnesses
+// time identical boards, moves and refills.
+type benchRandom uint64
+
+func (r *benchRandom) next() uint64 {
+	*r ^= *r << 13
+	*r ^= *r >> 7
+	*r ^= *r << 17
+	return uint64(*r)
+}
+
+func (r *benchRandom) tile() Tile {
+	return Tile(r.next()%BOARD_COLORS + 1)
+}
+
+// Adjacent swap to the right or downwards, mirrored at the board edge.
+func (r *benchRandom) move(size int) PlayerMove {
+	cell := int(r.next() % uint64(size*size))
+	move := PlayerMove{FromX: cell % size, FromY: cell / size}
+	move.ToX, move.ToY = move.FromX, move.FromY
+
+	if r.next()&1 != 0 {
+		if move.FromX < size-1 {
+			move.ToX++
+		} else {
+			move.ToX--
+		}
+	} else {
+		if move.FromY < size-1 {
+			move.ToY++
+		} else {
+			move.ToY--
+		}
+	}
+	return move
+}
+
+func benchBoards(rng *benchRandom, variant *BoardVariant) ([]Board, []PlayerMove) {
+	boards := make([]Board, BENCH_BOARDS)
+	moves := make([]PlayerMove, BENCH_BOARDS)
+	for i := range boards {
+		boards[i].Variant = variant
+		variant.fillEmptySpaces(&boards[i].Cells, rng.tile)
+		moves[i] = rng.move(variant.Size)
+	}
+	return boards, moves
+}
+
+// Runs bench once per board size, named like enginebench's report. The
+// largest is BOARD_MAX_SIZE, see enginebench.c.
+func benchVariants(b *testing.B, bench func(b *testing.B, boards []Board, moves []PlayerMove, rng *benchRandom)) {
+	for i := range boardVariants {
+		variant := &boardVariants[i]
+		b.Run(fmt.Sprintf("%dx%d", variant.Size, variant.Size), func(b *testing.B) {
+			rng := benchRandom(BENCH_SEED)
+			boards, moves := benchBoards(&rng, variant)
+			b.ReportAllocs()
+			b.ResetTimer()
+			bench(b, boards, moves, &rng)
+		})
+	}
+}
+
+func BenchmarkFindMatches(b *testing.B) {
+	benchVariants(b, func(b *testing.B, boards []Board, _ []PlayerMove, _ *benchRandom) {
+		for i := 0; i < b.N; i++ {
+			board := &boards[i&(BENCH_BOARDS-1)]
+			board.Variant.findMatches(&board.Cells)
+		}
+	})
+}
+
+func BenchmarkCascade(b *testing.B) {
+	benchVariants(b, func(b *testing.B, boards []Board, _ []PlayerMove, rng *benchRandom) {
+		refill := rng.tile
+		for i := 0; i < b.N; i++ {
+			board := boards[i&(BENCH_BOARDS-1)]
+			resolveCascade(&board, refill)
+		}
+	})
+}
+
+func BenchmarkMove(b *testing.B) {
+	benchVariants(b, func(b *testing.B, boards []Board, moves []PlayerMove, rng *benchRandom) {
+		refill := rng.tile
+		for i := 0; i < b.N; i++ {
+			board := boards[i&(BENCH_BOARDS-1)]
+			applyMove(&board, &moves[i&(BENCH_BOARDS-1)], refill)
+		}
+	})
+}
+
+// Native engine driven through enginebench -d, one case per line.
+type nativeEngine struct {
+	cmd *exec.Cmd
+	in  io.WriteCloser
+	out *bufio.Scanner
+}
+
+func startNativeEngine(tb testing.TB) *nativeEngine {
+	if _, err := os.Stat("./enginebench"); err != nil {
+		tb.Skip("enginebench not built, run make enginebench")
+	}
+
+	cmd := exec.Command("./enginebench", "-d")
+	cmd.Stderr = os.Stderr
+	in, err := cmd.StdinPipe()
+	if err != nil {
+		tb.Fatal(err)
+	}
+	out, err := cmd.StdoutPipe()
+	if err != nil {
+		tb.Fatal(err)
+	}
+	if err := cmd.Start(); err != nil {
+		tb.Fatal(err)
+	}
+	tb.Cleanup(func() {
+		in.Close()
+		cmd.Wait()
+	})
+	return &nativeEngine{cmd: cmd, in: in, out: bufio.NewScanner(out)}
+}
+
+func tileDigits(board *Board) string {
+	var sb strings.Builder
+	for y := 0; y < board.Size(); y++ {
+		for x := 0; x < board.Size(); x++ {
+			sb.WriteByte(byte('0' + board.Cells[y][x]))
+		}
+	}
+	return sb.String()
+}
+
+func (e *nativeEngine) apply(tb testing.TB, board Board, move PlayerMove, refills []Tile) string {
+	var stream strings.Builder
+	for _, t := range refills {
+		stream.WriteByte(byte('0' + t))
+	}
+	fmt.Fprintf(e.in, "%d %s %d %d %d %d %s\n", board.Size(), tileDigits(&board),
+		move.FromX, move.FromY, move.ToX, move.ToY, stream.String())
+
+	if !e.out.Scan() {
+		tb.Fatalf("enginebench exited: %v", e.out.Err())
+	}
+	return e.out.Text()
+}
+
+// Runs the server's engine on the same case, formatted like enginebench's
+// answer. Past the end of refills both engines continue with the seeded
+// xorshift stream.
+func goApply(board Board, move PlayerMove, refills []Tile) string {
+	consumed := 0
+	tail := benchRandom(BENCH_SEED)
+	score := applyMove(&board, &move, func() Tile {
+		consumed++
+		if consumed <= len(refills) {
+			return refills[consumed-1]
+		}
+		return tail.tile()
+	})
+	return fmt.Sprintf("%d %s %d", score, tileDigits(&board), consumed)
+}
+
+func checkEngines(t *testing.T, native *nativeEngine, board Board, move PlayerMove, refills []Tile) {
+	want := goApply(board, move, refills)
+	got := native.apply(t, board, move, refills)
+	if got != want {
+		t.Fatalf("engines diverge on %dx%d board%v\nmove (%d,%d)->(%d,%d)\ngo:     %s\nnative: %s",
+			board.Size(), board.Size(), boardDump(board),
+			move.FromX, move.FromY, move.ToX, move.ToY, want, got)
+	}
+}
+
+// Seeded random boards, moves and refill streams through both engines, on
+// every board size.
+func TestEngineDifferential(t *testing.T) {
+	native := startNativeEngine(t)
+	rng := benchRandom(BENCH_SEED)
+	refills := make([]Tile, DIFF_REFILLS)
+
+	cases := DIFF_CASES
+	if testing.Short() {
+		cases /= 10
+	}
+	for i := 0; i < cases; i++ {
+		board := Board{Variant: &boardVariants[i%BOARD_VARIANTS]}
+		size := board.Size()
+		board.Variant.fillEmptySpaces(&board.Cells, rng.tile)
+		// salt in specials so runs of them are covered too
+		if i%4 == 0 {
+			cell := int(rng.next() % uint64(size*size))
+			board.Cells[cell/size][cell%size] = Special
+		}
+		move := rng.move(size)
+		for j := range refills {
+			refills[j] = rng.tile()
+		}
+		checkEngines(t, native, board, move, refills)
+	}
+}
+
+// go test -fuzz FuzzEngineDifferential explores arbitrary boards, including
+// holes and specials the server never produces.
+func FuzzEngineDifferential(f *testing.F) {
+	rng := benchRandom(BENCH_SEED)
+	for i := 0; i < 8; i++ {
+		cells := make([]byte, BOARD_MAX_SIZE*BOARD_MAX_SIZE)
+		for j := range cells {
+			cells[j] = byte(rng.tile())
+		}
+		f.Add(byte(i), cells, uint16(rng.next()), []byte{1, 2, 3, 4, 5})
+	}
+
+	native := startNativeEngine(f)
+	f.Fuzz(func(t *testing.T, variant byte, cells []byte, swap uint16, stream []byte) {
+		board := Board{Variant: &boardVariants[int(variant)%BOARD_VARIANTS]}
+		size := board.Size()
+		if len(cells) < size*size {
+			t.Skip()
+		}
+
+		for i := 0; i < size*size; i++ {
+			board.Cells[i/size][i%size] = Tile(cells[i] % byte(Special+1))
+		}
+
+		cell := int(swap>>1) % (size * size)
+		move := PlayerMove{FromX: cell % size, FromY: cell / size}
+		move.ToX, move.ToY = move.FromX, move.FromY
+		if swap&1 != 0 {
+			move.ToX = move.FromX ^ 1
+		} else {
+			move.ToY = move.FromY ^ 1
+		}
+
+		if len(stream) > DIFF_REFILLS {
+			stream = stream[:DIFF_REFILLS]
+		}
+		refills := make([]Tile, len(stream))
+		for i, b := range stream {
+			refills[i] = Tile(b%BOARD_COLORS + 1)
+		}
+		checkEngines(t, native, board, move, refills)
+	})
+}
+
+// Decodes a recording front to back, returning the board of every state
+// and the keyframe index from its trailer.
+func readRecording(t *testing.T, path string, size int) ([]Cells, []uint32) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		t.Fatal(err)
+	}
+	le := binary.LittleEndian
+	if le.Uint32(data) != REPLAY_MAGIC || int(data[5]) != size || data[6] != REPLAY_KEYFRAME_INTERVAL {
+		t.Fatalf("bad recording header % x", data[:REPLAY_HEADER_SIZE])
+	}
+
+	trailer := data[len(data)-16:]
+	if le.Uint32(trailer[12:]) != REPLAY_INDEX_MAGIC {
+		t.Fatal("recording has no index")
+	}
+	keyframes := int(le.Uint32(trailer[8:]))
+	end := len(data) - 16 - keyframes*4
+	index := make([]uint32, keyframes)
+	for i := range index {
+		index[i] = le.Uint32(data[end+i*4:])
+	}
+
+	var states []Cells
+	var cells Cells
+	for o := REPLAY_HEADER_SIZE; o < end; {
+		p := data[o:]
+		switch p[0] {
+		case REPLAY_MOVE:
+			o += REPLAY_RECORD_HEADER + 3
+			continue
+		case REPLAY_KEYFRAME:
+			bits, pending, b := uint32(0), 0, REPLAY_STATE_FIXED
+			for i := 0; i < size*size; i++ {
+				if pending < 3 {
+					bits |= uint32(p[b]) << pending
+					b++
+					pending += 8
+				}
+				cells[i/size][i%size] = Tile(bits & 7)
+				bits >>= 3
+				pending -= 3
+			}
+			o += b
+		case REPLAY_DELTA:
+			count := int(le.Uint16(p[REPLAY_STATE_FIXED:]))
+			for i := 0; i < count; i++ {
+				cell := int(p[REPLAY_STATE_FIXED+2+i*2])
+				cells[cell/size][cell%size] = Tile(p[REPLAY_STATE_FIXED+3+i*2])
+			}
+			o += REPLAY_STATE_FIXED + 2 + count*2
+		default:
+			t.Fatalf("unknown record %d at %d", p[0], o)
+		}
+		if step := int(le.Uint32(p[REPLAY_RECORD_HEADER:])); step != len(states) {
+			t.Fatalf("state %d recorded as step %d", len(states), step)
+		}
+		states = append(states, cells)
+	}
+	if int(le.Uint32(trailer)) != len(states) {
+		t.Fatalf("trailer counts %d states, found %d", le.Uint32(trailer), len(states))
+	}
+	return states, index
+}
+
+// A recorded game decodes to the boards it went through, and every index
+// entry points at the keyframe of its step.
+func TestRecordingRoundTrip(t *testing.T) {
+	rng := benchRandom(BENCH_SEED)
+	for i := range boardVariants {
+		variant := &boardVariants[i]
+		game := &GameState{GameID: int32(i + 1), GameStarted: true}
+		game.Board = Board{Variant: variant}
+		variant.fillEmptySpaces(&game.Board.Cells, rng.tile)
+
+		recorder, err := newRecorder(t.TempDir(), game)
+		if err != nil {
+			t.Fatal(err)
+		}
+		path := recorder.file.Name()
+
+		var want []Cells
+		recorder.writeState(game)
+		want = append(want, game.Board.Cells)
+		for len(want) < 3*REPLAY_KEYFRAME_INTERVAL+5 {
+			move := rng.move(variant.Size)
+			recorder.writeMove(&move)
+			game.Player1Score += applyMove(&game.Board, &move, rng.tile)
+			recorder.writeState(game)
+			want = append(want, game.Board.Cells)
+		}
+		if err := recorder.Close(); err != nil {
+			t.Fatal(err)
+		}
+
+		states, index := readRecording(t, path, variant.Size)
+		if len(states) != len(want) {
+			t.Fatalf("%dx%d: %d states recorded, %d read", variant.Size, variant.Size, len(want), len(states))
+		}
+		for s := range want {
+			if states[s] != want[s] {
+				t.Fatalf("%dx%d: state %d differs", variant.Size, variant.Size, s)
+			}
+		}
+		if len(index) != (len(want)+REPLAY_KEYFRAME_INTERVAL-1)/REPLAY_KEYFRAME_INTERVAL {
+			t.Fatalf("%d keyframes indexed for %d states", len(index), len(want))
+		}
+
+		data, _ := os.ReadFile(path)
+		for k, offset := range index {
+			p := data[offset:]
+			if p[0] != REPLAY_KEYFRAME || binary.LittleEndian.Uint32(p[REPLAY_RECORD_HEADER:]) != uint32(k*REPLAY_KEYFRAME_INTERVAL) {
+				t.Fatalf("index entry %d does not point at keyframe %d", k, k*REPLAY_KEYFRAME_INTERVAL)
+			}
+		}
+	}
+}
+
+// First draws of board_rng_* in board.c for seed 42; client prediction
+// relies on both generators producing the same stream.
+func TestRngMatchesNative(t *testing.T) {
+	var rng BoardRng
+	rng.seed(42)
+	for i, want := range []uint32{0xc2f57bd6, 0x6b07c4a9, 0x72b7b29b, 0x44215383} {
+		if got := rng.next(); got != want {
+			t.Fatalf("draw %d: got %#x, want %#x", i, got, want)
+		}
+	}
+	if rng != 0xdb7d5d08fbb86588 {
+		t.Fatalf("state after 4 draws is %#x", uint64(rng))
+	}
+
+	var tiles strings.Builder
+	for i := 0; i < 16; i++ {
+		tiles.WriteByte(byte('0' + rng.tile()))
+	}
+	if tiles.String() != "5345354315514114" {
+		t.Fatalf("tiles %s", tiles.String())
+	}
+}
+
+// The move index agrees with playing every swap on a bare copy of the
+// board, which must be stable and have a move left.
+func checkMoveIndex(t *testing.T, board *Board, refill func() Tile, when string) {
+	size := board.Size()
+	if len(board.Variant.findMatches(&board.Cells)) != 0 {
+		t.Fatalf("%dx%d: %s left matches on the board%v", size, size, when, boardDump(*board))
+	}
+	count := 0
+	for k := 0; k < 2*size*size; k++ {
+		move := PlayerMove{FromX: k % size, FromY: k / size % size}
+		move.ToX, move.ToY = move.FromX+1, move.FromY
+		if k >= size*size {
+			move.ToX, move.ToY = move.FromX, move.FromY+1
+		}
+		if !board.inBounds(move.ToX, move.ToY) {
+			continue
+		}
+		bare := Board{Variant: board.Variant, Cells: board.Cells}
+		legal := applyMove(&bare, &move, refill) > 0
+		if legal != board.moves.legal(&move) {
+			t.Fatalf("%dx%d: %s, index says %v for (%d,%d)->(%d,%d)%v", size, size, when,
+				!legal, move.FromX, move.FromY, move.ToX, move.ToY, boardDump(*board))
+		}
+		if legal {
+			count++
+		}
+	}
+	if count != board.moves.count || count == 0 {
+		t.Fatalf("%dx%d: %s has %d moves, index counts %d", size, size, when, count, board.moves.count)
+	}
+}
+
+func TestMoveIndex(t *testing.T) {
+	rng := benchRandom(BENCH_SEED)
+	moves := 100
+	if testing.Short() {
+		moves /= 10
+	}
+	for i := range boardVariants {
+		variant := &boardVariants[i]
+		var boardRng BoardRng
+		boardRng.seed(uint64(i))
+		board := generateBoard(variant, boardRng.tile)
+
+		for step := 0; step < moves; step++ {
+			checkMoveIndex(t, &board, boardRng.tile, fmt.Sprintf("step %d", step))
+			move := rng.move(variant.Size)
+			applyMove(&board, &move, boardRng.tile)
+		}
+
+		// deals from degenerate refill streams still leave a move
+		for color := Red; color <= Purple; color++ {
+			board.deal(func() Tile { return color })
+			checkMoveIndex(t, &board, boardRng.tile, fmt.Sprintf("deal of %v", tileToString(color)))
+		}
+		// a cycling stream deals dead boards on 8x8 and 16x16, down to the
+		// staggered pattern
+		n := 0
+		board.deal(func() Tile { n++; return Tile(n%BOARD_COLORS) + Red })
+		checkMoveIndex(t, &board, boardRng.tile, "deal of a cycling stream")
+	}
+}
+
+// Spectators get the players' bytes through the fan-out, and slow or silent
+// ones are dropped.
+func TestSpectatorFanout(t *testing.T) {
+	out, addr := newTestOutbox(t)
+	game := newTestGame(addr)
+
+	var watchers [3]*net.UDPConn
+	for i := range watchers {
+		conn, err := net.ListenUDP("udp", &net.UDPAddr{IP: net.IPv4(127, 0, 0, 1)})
+		if err != nil {
+			t.Fatal(err)
+		}
+		defer conn.Close()
+		watchers[i] = conn
+		if !game.Spectators.add(conn.LocalAddr().(*net.UDPAddr).AddrPort(), time.Now().UnixNano()) {
+			t.Fatal("spectator turned away")
+		}
+	}
+
+	broadcastGameState(out, game)
+	out.flush()
+	want := make([]byte, BUFLEN)
+	want = want[:encodeState(want, game.StateSeq, game)]
+
+	fanOut(out, <-fanout, nil)
+	out.flush()
+	buf := make([]byte, BUFLEN)
+	for i, conn := range watchers {
+		conn.SetReadDeadline(time.Now().Add(time.Second))
+		n, err := conn.Read(buf)
+		if err != nil {
+			t.Fatalf("spectator %d: %v", i, err)
+		}
+		if string(buf[:n]) != string(want) {
+			t.Fatalf("spectator %d got a different state", i)
+		}
+	}
+
+	// one acks a state far behind the stream, another stops renewing
+	l := &game.Spectators
+	now := time.Now().UnixNano()
+	slow := watchers[0].LocalAddr().(*net.UDPAddr).AddrPort()
+	if got := l.renew(slow, game.StateSeq-SPECTATOR_MAX_LAG-1, false, now); got != SPECTATOR_EVICTED {
+		t.Fatalf("slow spectator renewal: %d", got)
+	}
+	if l.add(slow, now) {
+		t.Fatal("evicted spectator came straight back")
+	}
+	l.members[l.index[watchers[1].LocalAddr().(*net.UDPAddr).AddrPort()]].LastSeen = now - int64(2*SPECTATOR_TIMEOUT)
+
+	_, targets := l.take(buf, nil, now)
+	if len(targets) != 1 || targets[0] != watchers[2].LocalAddr().(*net.UDPAddr).AddrPort() {
+		t.Fatalf("fan-out targets %v", targets)
+	}
+}
+
+func TestDuplicateMoveIsIdempotent(t *testing.T) {
+	out, addr := newTestOutbox(t)
+	game := newTestGame(addr)
+
+	// any swap the index says scores
+	size := game.Board.Size()
+	move := PlayerMove{PlayerID: 0, Seq: 7}
+	for i := 0; i < 2*size*size; i++ {
+		x, y := i%size, i/size%size
+		dx, dy := 1, 0
+		if i >= size*size {
+			dx, dy = 0, 1
+		}
+		move.FromX, move.FromY, move.ToX, move.ToY = x, y, x+dx, y+dy
+		if game.Board.inBounds(move.ToX, move.ToY) && game.Board.moves.legal(&move) {
+			break
+		}
+	}
+
+	// what the old stream would have drawn next, had it carried on
+	bare := game.Board
+	index := *game.Board.moves
+	bare.moves = &index
+	carried := game.Rng
+	applyMove(&bare, &move, carried.tile)
+
+	processPlayerMove(out, game, &move)
+	score, seq := game.Player1Score, game.StateSeq
+	if game.Rng == carried {
+		t.Fatal("refill stream not reseeded after the move")
+	}
+	if score == 0 || game.CurrentTurn != 1 {
+		t.Fatalf("move %+v did not score", move)
+	}
+
+	// the same move again, as if the state answering it was lost
+	processPlayerMove(out, game, &move)
+	out.flush()
+	if game.Player1Score != score || game.StateSeq != seq || game.CurrentTurn != 1 {
+		t.Fatalf("duplicate move applied: score %d seq %d turn %d", game.Player1Score, game.StateSeq, game.CurrentTurn)
+	}
+
+	// a newer one out of turn is answered but changes nothing either
+	move.Seq++
+	processPlayerMove(out, game, &move)
+	out.flush()
+	if game.Player1Score != score || game.StateSeq != seq {
+		t.Fatal("out of turn move applied")
+	}
+}
+
+func TestMatchQueue(t *testing.T) {
+	out, _ := newTestOutbox(t)
+	addr := func(port uint16) netip.AddrPort {
+		return netip.AddrPortFrom(netip.MustParseAddr("127.0.0.1"), port)
+	}
+	saved := wheel
+	wheel = newTimerWheel(DEFAULT_TIMEOUT_TICK)
+	t.Cleanup(func() { wheel = saved })
+	tab := newGameTable()
+	join := func(port uint16, variant *BoardVariant, rating int, now int64) {
+		if game := tab.join(out, addr(port), variant, rating, now); game != nil {
+			game.begin(out)
+		}
+	}
+	now := time.Now().UnixNano()
+
+	// a repeated connect only renews the ticket, and nobody holds a game
+	join(1, boardDefault, RATING_DEFAULT, now)
+	join(1, boardDefault, RATING_DEFAULT, now)
+	join(2, boardDefault, RATING_DEFAULT+5*ratingBucket, now)
+	if tab.count != 0 || len(tab.queue.tickets) != 2 {
+		t.Fatalf("%d games and %d tickets before a match", tab.count, len(tab.queue.tickets))
+	}
+
+	// a player in the same bucket is paired at once, the first queued in seat 0
+	join(3, boardDefault, RATING_DEFAULT+ratingBucket/2, now)
+	if tab.count != 1 || tab.players[addr(1)].Seat != 0 || tab.players[addr(3)].Seat != 1 {
+		t.Fatalf("same bucket not matched: %d games, %v", tab.count, tab.players)
+	}
+
+	// five buckets apart, and a player of another board size in the same
+	// bucket as addr 2, who is never matched with it
+	join(4, boardDefault, RATING_DEFAULT, now+1)
+	join(5, boardVariantFor(10), RATING_DEFAULT+5*ratingBucket, now)
+	for wait := 1; wait <= 5; wait++ {
+		now += int64(matchMaxWait)
+		for _, port := range []uint16{2, 4, 5} {
+			join(port, tab.queue.tickets[addr(port)].Variant, 0, now)
+		}
+		for _, game := range tab.sweepQueue(out, now, nil) {
+			game.begin(out)
+		}
+		if matched := tab.count == 2; matched != (wait == 5) {
+			t.Fatalf("after %d waits: %d games", wait, tab.count)
+		}
+	}
+	if tab.players[addr(2)].Seat != 0 || tab.players[addr(4)].Seat != 1 {
+		t.Fatalf("widened match seats: %v", tab.players)
+	}
+
+	// a ticket that stops renewing is dropped, one that leaves is gone
+	tab.sweepQueue(out, now+int64(QUEUE_TIMEOUT)+1, nil)
+	join(6, boardDefault, RATING_DEFAULT, now)
+	if !tab.leaveQueue(addr(6)) || len(tab.queue.tickets) != 0 {
+		t.Fatalf("tickets left: %v", tab.queue.tickets)
+	}
+}
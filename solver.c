@@ -0,0 +1,157 @@
+#include "solver.h"
+
+#include <stdlib.h>
+
+typedef struct SolverJob
+{
+  const Board* board;
+  BoardRng rng;
+  int swaps;
+  SolverMove moves[SOLVER_MAX_SWAPS]; // every swap, by index
+  bool scored[SOLVER_MAX_SWAPS];
+  bool replied[SOLVER_MAX_SWAPS];
+  int scoring[SOLVER_MAX_SWAPS]; // indices into moves
+  int scoring_count;
+} SolverJob;
+
+void
+solver_swap(int size, int i, SolverMove* move)
+{
+  int row_swaps = size * (size - 1);
+  if (i < row_swaps) {
+    move->from_x = (int8_t)(i % (size - 1));
+    move->from_y = (int8_t)(i / (size - 1));
+    move->to_x = move->from_x + 1;
+    move->to_y = move->from_y;
+  } else {
+    i -= row_swaps;
+    move->from_x = (int8_t)(i % size);
+    move->from_y = (int8_t)(i / size);
+    move->to_x = move->from_x;
+    move->to_y = move->from_y + 1;
+  }
+}
+
+static int32_t
+solver_play(Board* board, BoardRng* rng, const SolverMove* move)
+{
+  return board_apply_move(board,
+                          move->from_x,
+                          move->from_y,
+                          move->to_x,
+                          move->to_y,
+                          board_rng_tile,
+                          rng);
+}
+
+static void
+solver_score_swap(void* user, int i)
+{
+  SolverJob* job = (SolverJob*)user;
+  Board board = *job->board;
+  BoardRng rng = job->rng;
+
+  job->moves[i].score = solver_play(&board, &rng, &job->moves[i]);
+  job->scored[i] = true;
+}
+
+static void
+solver_search_reply(void* user, int j)
+{
+  SolverJob* job = (SolverJob*)user;
+  int i = job->scoring[j];
+  Board after = *job->board;
+  BoardRng rng = job->rng;
+  solver_play(&after, &rng, &job->moves[i]);
+
+  int32_t best = 0;
+  for (int k = 0; k < job->swaps; k++) {
+    SolverMove reply;
+    solver_swap(after.size, k, &reply);
+
+    Board board = after;
+    BoardRng reply_rng = rng;
+    int32_t score = solver_play(&board, &reply_rng, &reply);
+    if (score > best) {
+      best = score;
+    }
+  }
+
+  job->moves[i].reply = best;
+  job->replied[i] = true;
+}
+
+static int
+solver_by_score(const void* a, const void* b)
+{
+  const SolverMove* x = (const SolverMove*)a;
+  const SolverMove* y = (const SolverMove*)b;
+  return (y->score > x->score) - (y->score < x->score);
+}
+
+static int
+solver_by_margin(const void* a, const void* b)
+{
+  const SolverMove* x = (const SolverMove*)a;
+  const SolverMove* y = (const SolverMove*)b;
+  int32_t mx = x->score - x->reply;
+  int32_t my = y->score - y->reply;
+  if (mx != my) {
+    return (my > mx) - (my < mx);
+  }
+  return solver_by_score(a, b);
+}
+
+bool
+solver_solve(WorkPool* pool,
+             const Board* board,
+             BoardRng rng,
+             uint64_t deadline_ns,
+             SolverResult* result)
+{
+  SolverJob* job = malloc(sizeof(SolverJob));
+  if (job == NULL) {
+    result->count = 0;
+    return false;
+  }
+
+  int size = board->size;
+  job->board = board;
+  job->rng = rng;
+  job->swaps = 2 * size * (size - 1);
+  job->scoring_count = 0;
+  for (int i = 0; i < job->swaps; i++) {
+    solver_swap(size, i, &job->moves[i]);
+    job->moves[i].score = 0;
+    job->moves[i].reply = 0;
+    job->scored[i] = false;
+    job->replied[i] = false;
+  }
+
+  result->swaps = job->swaps;
+  result->evaluated =
+    work_pool_run(pool, job->swaps, solver_score_swap, job, deadline_ns);
+
+  for (int i = 0; i < job->swaps; i++) {
+    if (job->scored[i] && job->moves[i].score > 0) {
+      job->scoring[job->scoring_count++] = i;
+    }
+  }
+
+  int replied = work_pool_run(
+    pool, job->scoring_count, solver_search_reply, job, deadline_ns);
+  result->replies_known =
+    result->evaluated == job->swaps && replied == job->scoring_count;
+
+  result->count = 0;
+  for (int j = 0; j < job->scoring_count; j++) {
+    result->moves[result->count++] = job->moves[job->scoring[j]];
+  }
+  qsort(result->moves,
+        result->count,
+        sizeof(SolverMove),
+        result->replies_known ? solver_by_margin : solver_by_score);
+
+  free(job);
+  return result->count > 0;
+}
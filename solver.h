@@ -0,0 +1,57 @@
+#ifndef __ME_SOLVER
+#define __ME_SOLVER
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "board.h"
+#include "work_pool.h"
+
+/*
+ * Best-move search for hints and bots. Every adjacent swap is played
+ * through board_apply_move, the engine the server's processPlayerMove
+ * matches, with refills drawn from the game's BoardRng, so a swap's score
+ * is exactly what the server will award. For each scoring swap the
+ * opponent's best reply on the resulting board is searched as well, and
+ * swaps rank by score minus that reply. The server reseeds the generator
+ * after every move, so the reply's refills are a guess drawn from the same
+ * stream and only the first move is exact.
+ *
+ * Both passes run on a WorkPool and stop at the deadline. If the reply
+ * pass does not finish, swaps rank by their own score alone.
+ */
+#define SOLVER_MAX_SWAPS (2 * BOARD_MAX_SIZE * (BOARD_MAX_SIZE - 1))
+
+typedef struct SolverMove
+{
+  int8_t from_x, from_y, to_x, to_y;
+  int32_t score; // points the swap scores
+  int32_t reply; // best score the opponent can answer with
+} SolverMove;
+
+typedef struct SolverResult
+{
+  int count; // scoring swaps, best first
+  SolverMove moves[SOLVER_MAX_SWAPS];
+  int swaps;          // swaps on the board
+  int evaluated;      // swaps whose score is known
+  bool replies_known; // ranking includes the opponent's replies
+} SolverResult;
+
+// Swap i of the board's 2 * size * (size - 1), rows first then columns.
+void
+solver_swap(int size, int i, SolverMove* move);
+
+/*
+ * Ranks the swaps of board for the player to move. Returns false when no
+ * swap is known to score, which with enough budget means the board has no
+ * moves left.
+ */
+bool
+solver_solve(WorkPool* pool,
+             const Board* board,
+             BoardRng rng,
+             uint64_t deadline_ns,
+             SolverResult* result);
+
+#endif // __ME_SOLVER
@@ -0,0 +1,282 @@
+/**
+ * Spectators. A client sends OP_SPECTATE to watch a game and repeats it to
+ * stay subscribed; every state the game broadcasts is then fanned out to
+ * it as well.
+ *
+ * The players' path only copies the already encoded state into the game's
+ * SpectatorList and hands the list to a fan-out goroutine, which queues the
+ * one copy for every subscriber in batched sends. States that come faster
+ * than the fan-out drains are coalesced, spectators only ever need the
+ * latest board.
+ */
+package main
+
+import (
+	"net"
+	"net/netip"
+	"sync"
+	"time"
+)
+
+const (
+	SPECTATORS_MAX    = 1024            // per game
+	SPECTATOR_TIMEOUT = 5 * time.Second // without a renewal
+	SPECTATOR_MAX_LAG = 64              // states a renewal may trail the stream by
+	FANOUT_QUEUE      = 1024            // lists waiting for a fan-out goroutine
+)
+
+var fanout = make(chan *SpectatorList, FANOUT_QUEUE)
+
+type Spectator struct {
+	Addr     netip.AddrPort
+	LastSeen int64 // unix nanoseconds of the last renewal
+}
+
+// Subscribers of one game and the newest state for them. broadcastGameState
+// takes the lock with game.mu held, so nothing under it may block; sends
+// happen after it is released.
+type SpectatorList struct {
+	mu      sync.Mutex
+	members []Spectator
+	index   map[netip.AddrPort]int   // position in members
+	evicted map[netip.AddrPort]int64 // slow spectators, kept out until then
+	frame   [BUFLEN]byte
+	frameN  int
+	seq     uint16 // of the frame
+	queued  bool   // waiting in fanout
+	final   bool   // the game is over, everyone leaves after this frame
+}
+
+// Outcome of a renewal.
+const (
+	SPECTATOR_RENEWED = iota
+	SPECTATOR_UNKNOWN // not subscribed yet
+	SPECTATOR_LEFT
+	SPECTATOR_EVICTED // fell too far behind
+)
+
+// Copies the encoded state for the fan-out and queues the list unless it
+// is queued already. Called with game.mu held.
+func (l *SpectatorList) publish(packet []byte, seq uint16, over bool) {
+	l.mu.Lock()
+	if len(l.members) == 0 {
+		l.mu.Unlock()
+		return
+	}
+	l.frameN = copy(l.frame[:], packet)
+	l.seq = seq
+	l.final = over
+	queued := l.queued
+	l.queued = true
+	l.mu.Unlock()
+
+	if queued {
+		return
+	}
+	select {
+	case fanout <- l:
+	default:
+		// spectators miss this state and get the next one
+		l.mu.Lock()
+		l.queued = false
+		l.mu.Unlock()
+		if logEnabled(CAT_NET, LOG_WARN) {
+			logWrite(CAT_NET, LOG_WARN, "Fan-out queue full, state seq %d skipped for spectators", seq)
+		}
+	}
+}
+
+func (l *SpectatorList) renew(addr netip.AddrPort, ack uint16, leave bool, now int64) int {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	i, ok := l.index[addr]
+	switch {
+	case !ok:
+		if leave {
+			return SPECTATOR_LEFT
+		}
+		return SPECTATOR_UNKNOWN
+	case leave:
+		l.remove(i)
+		return SPECTATOR_LEFT
+	case l.frameN > 0 && l.seq-ack > SPECTATOR_MAX_LAG && l.seq-ack < 1<<15:
+		l.remove(i)
+		if l.evicted == nil {
+			l.evicted = make(map[netip.AddrPort]int64)
+		}
+		l.evicted[addr] = now + int64(SPECTATOR_TIMEOUT)
+		return SPECTATOR_EVICTED
+	}
+	l.members[i].LastSeen = now
+	return SPECTATOR_RENEWED
+}
+
+// Subscribes addr, false when the game is full or addr was evicted
+// recently. Called with game.mu held, so the caller can send the current
+// state without racing a broadcast.
+func (l *SpectatorList) add(addr netip.AddrPort, now int64) bool {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	if _, ok := l.index[addr]; ok {
+		return true
+	}
+	if until, ok := l.evicted[addr]; ok {
+		if now < until {
+			return false
+		}
+		delete(l.evicted, addr)
+	}
+	if len(l.members) >= SPECTATORS_MAX {
+		return false
+	}
+	if l.index == nil {
+		l.index = make(map[netip.AddrPort]int)
+	}
+	l.index[addr] = len(l.members)
+	l.members = append(l.members, Spectator{Addr: addr, LastSeen: now})
+	return true
+}
+
+// Swap-removes member i. Must be called with l.mu held.
+func (l *SpectatorList) remove(i int) {
+	last := len(l.members) - 1
+	delete(l.index, l.members[i].Addr)
+	if i != last {
+		l.members[i] = l.members[last]
+		l.index[l.members[i].Addr] = i
+	}
+	l.members = l.members[:last]
+}
+
+// Copies the pending frame into buf and the live subscribers into targets,
+// dropping the ones whose renewals stopped. Returns the frame length.
+func (l *SpectatorList) take(buf []byte, targets []netip.AddrPort, now int64) (int, []netip.AddrPort) {
+	l.mu.Lock()
+	defer l.mu.Unlock()
+
+	l.queued = false
+	n := copy(buf, l.frame[:l.frameN])
+	expired := now - int64(SPECTATOR_TIMEOUT)
+	for i := 0; i < len(l.members); {
+		if l.members[i].LastSeen < expired {
+			if logEnabled(CAT_NET, LOG_INFO) {
+				logWrite(CAT_NET, LOG_INFO, "Spectator %v timed out", l.members[i].Addr)
+			}
+			l.remove(i)
+			continue
+		}
+		targets = append(targets, l.members[i].Addr)
+		i++
+	}
+
+	if l.final {
+		l.members = l.members[:0]
+		clear(l.index)
+	}
+	return n, targets
+}
+
+// Sends queued frames to every subscriber of their game, flushing once the
+// queue runs dry so frames of several games share a batch.
+func runFanout(conn *net.UDPConn) {
+	out := newOutbox(conn)
+	targets := make([]netip.AddrPort, 0, SPECTATORS_MAX)
+	for l := range fanout {
+		targets = fanOut(out, l, targets[:0])
+		if len(fanout) == 0 {
+			out.flush()
+		}
+	}
+}
+
+// Queues the list's frame for its subscribers, one slot for all of them.
+func fanOut(out *Outbox, l *SpectatorList, targets []netip.AddrPort) []netip.AddrPort {
+	n, targets := l.take(out.next(), targets, time.Now().UnixNano())
+	if n > 0 && len(targets) > 0 {
+		out.commit(n, targets[0])
+		for _, addr := range targets[1:] {
+			out.repeat(addr)
+		}
+	}
+	return targets
+}
+
+// The game with the highest combined score among those that broadcast a
+// state recently, nil when none did.
+func (t *GameTable) topGame() *GameState {
+	t.mu.RLock()
+	defer t.mu.RUnlock()
+
+	var top *GameState
+	best := int32(-1)
+	active := time.Now().UnixNano() - int64(SPECTATOR_TIMEOUT)
+	for _, game := range t.slots {
+		if game == nil {
+			continue
+		}
+		game.mu.Lock()
+		score := game.Player1Score + game.Player2Score
+		live := game.GameStarted && !game.GameOver && !game.Closed && game.StateSentAt > active
+		game.mu.Unlock()
+		if live && score > best {
+			top, best = game, score
+		}
+	}
+	return top
+}
+
+func (t *GameTable) gameByID(id int32) *GameState {
+	t.mu.RLock()
+	game := t.games[id]
+	t.mu.RUnlock()
+	return game
+}
+
+// Subscribes, renews or unsubscribes the sender. A new spectator gets the
+// current state right away; later ones come from the fan-out.
+func handleSpectate(out *Outbox, addr netip.AddrPort, packet []byte) {
+	var req SpectateRequest
+	if !decodeSpectate(packet, &req) {
+		logf(CAT_NET, LOG_INFO, "Error parsing spectate request: short packet")
+		return
+	}
+
+	var game *GameState
+	if req.GameID == 0 {
+		game = table.topGame()
+	} else {
+		game = table.gameByID(req.GameID)
+	}
+	if game == nil {
+		return
+	}
+
+	now := time.Now().UnixNano()
+	switch game.Spectators.renew(addr, req.Ack, req.Leave, now) {
+	case SPECTATOR_RENEWED, SPECTATOR_LEFT:
+		return
+	case SPECTATOR_EVICTED:
+		if logEnabled(CAT_NET, LOG_INFO) {
+			logWrite(CAT_NET, LOG_INFO, "Spectator %v of game %d fell behind and was dropped", addr, game.GameID)
+		}
+		return
+	}
+
+	game.mu.Lock()
+	defer game.mu.Unlock()
+	if game.Closed || game.GameOver || !game.GameStarted {
+		return
+	}
+	if !game.Spectators.add(addr, now) {
+		if logEnabled(CAT_NET, LOG_INFO) {
+			logWrite(CAT_NET, LOG_INFO, "Spectator %v turned away from game %d", addr, game.GameID)
+		}
+		return
+	}
+	sendState(out, game, addr)
+	if logEnabled(CAT_NET, LOG_DEBUG) {
+		logWrite(CAT_NET, LOG_DEBUG, "Spectator %v watching game %d", addr, game.GameID)
+	}
+}
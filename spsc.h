@@ -0,0 +1,63 @@
+#ifndef __ME_SPSC
+#define __ME_SPSC
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Bounded lock-free single-producer/single-consumer ring.
+ *
+ *   SPSC_RING(EventRing, Event, 64)
+ *
+ * defines EventRing with EventRing_push / EventRing_pop. Capacity must be a
+ * power of two. head is only written by the consumer and tail only by the
+ * producer, each on its own cache line.
+ */
+#define SPSC_RING(name, type, capacity)                                        \
+  _Static_assert(((capacity) & ((capacity)-1)) == 0,                           \
+                 #name " capacity must be a power of two");                    \
+                                                                               \
+  typedef struct name                                                          \
+  {                                                                            \
+    alignas(64) atomic_uint_fast32_t head;                                     \
+    alignas(64) atomic_uint_fast32_t tail;                                     \
+    alignas(64) type items[capacity];                                          \
+  } name;                                                                      \
+                                                                               \
+  static inline void name##_init(name* ring)                                   \
+  {                                                                            \
+    atomic_init(&ring->head, 0);                                               \
+    atomic_init(&ring->tail, 0);                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_push(name* ring, const type* item)                 \
+  {                                                                            \
+    uint_fast32_t tail =                                                       \
+      atomic_load_explicit(&ring->tail, memory_order_relaxed);                 \
+    uint_fast32_t head =                                                       \
+      atomic_load_explicit(&ring->head, memory_order_acquire);                 \
+    if (tail - head == (capacity)) {                                           \
+      return false;                                                            \
+    }                                                                          \
+    ring->items[tail & ((capacity)-1)] = *item;                                \
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);        \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_pop(name* ring, type* item)                        \
+  {                                                                            \
+    uint_fast32_t head =                                                       \
+      atomic_load_explicit(&ring->head, memory_order_relaxed);                 \
+    uint_fast32_t tail =                                                       \
+      atomic_load_explicit(&ring->tail, memory_order_acquire);                 \
+    if (head == tail) {                                                        \
+      return false;                                                            \
+    }                                                                          \
+    *item = ring->items[head & ((capacity)-1)];                                \
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);        \
+    return true;                                                               \
+  }
+
+#endif // __ME_SPSC
@@ -0,0 +1,207 @@
+#include "text_cache.h"
+
+#include <math.h>
+#include <rlgl.h>
+#include <string.h>
+
+static uint32_t
+text_hash(const char* str)
+{
+  uint32_t hash = 2166136261u;
+  for (; *str; str++) {
+    hash = (hash ^ (uint8_t)*str) * 16777619u;
+  }
+  return hash;
+}
+
+static bool
+color_equal(Color a, Color b)
+{
+  return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+}
+
+void
+text_cache_init(TextCache* cache, Font* font)
+{
+  memset(cache, 0, sizeof(*cache));
+  cache->font = font;
+}
+
+void
+text_cache_destroy(TextCache* cache)
+{
+  for (int i = 0; i < cache->count; i++) {
+    if (cache->entries[i].texture.id != 0) {
+      UnloadRenderTexture(cache->entries[i].texture);
+    }
+  }
+  cache->count = 0;
+}
+
+static TextCacheEntry*
+text_cache_slot(TextCache* cache)
+{
+  if (cache->count < TEXT_CACHE_CAPACITY) {
+    return &cache->entries[cache->count++];
+  }
+
+  TextCacheEntry* oldest = &cache->entries[0];
+  for (int i = 1; i < TEXT_CACHE_CAPACITY; i++) {
+    if (cache->entries[i].last_used < oldest->last_used) {
+      oldest = &cache->entries[i];
+    }
+  }
+
+  if (oldest->texture.id != 0) {
+    UnloadRenderTexture(oldest->texture);
+  }
+  memset(oldest, 0, sizeof(*oldest));
+  cache->evictions++;
+  return oldest;
+}
+
+/*
+ * Finds or lays out the entry for key. With a color the entry is also
+ * rendered in that color; measuring passes NULL and leaves the texture
+ * alone. Returns NULL for strings that do not fit an entry.
+ */
+static TextCacheEntry*
+text_cache_lookup(TextCache* cache,
+                  const char* key,
+                  const char* text,
+                  float font_size,
+                  const Color* color)
+{
+  if (key == NULL) {
+    key = text;
+  }
+  if (strlen(key) >= TEXT_CACHE_MAX_LEN || strlen(text) >= TEXT_CACHE_MAX_LEN) {
+    cache->uncached++;
+    return NULL;
+  }
+
+  uint32_t hash = text_hash(key);
+  TextCacheEntry* entry = NULL;
+  for (int i = 0; i < cache->count; i++) {
+    if (cache->entries[i].hash == hash &&
+        strcmp(cache->entries[i].key, key) == 0) {
+      entry = &cache->entries[i];
+      break;
+    }
+  }
+
+  if (entry == NULL) {
+    cache->misses++;
+    entry = text_cache_slot(cache);
+    entry->hash = hash;
+    strcpy(entry->key, key);
+    entry->text[0] = '\0';
+    entry->font_size = 0;
+  } else if (strcmp(entry->text, text) != 0 || entry->font_size != font_size ||
+             (color && entry->rendered && !color_equal(entry->color, *color))) {
+    cache->rebuilds++;
+  } else if (color && !entry->rendered) {
+    cache->misses++;
+  } else {
+    cache->hits++;
+  }
+  entry->last_used = ++cache->tick;
+
+  if (strcmp(entry->text, text) != 0 || entry->font_size != font_size) {
+    strcpy(entry->text, text);
+    entry->font_size = font_size;
+    entry->size = MeasureTextEx(*cache->font, text, font_size, TEXT_SPACING);
+    entry->rendered = false;
+  }
+
+  if (color && (!entry->rendered || !color_equal(entry->color, *color))) {
+    int width = (int)ceilf(entry->size.x + TEXT_SHADOW_OFFSET);
+    int height = (int)ceilf(entry->size.y + TEXT_SHADOW_OFFSET);
+
+    if (entry->texture.id != 0 && (entry->texture.texture.width != width ||
+                                   entry->texture.texture.height != height)) {
+      UnloadRenderTexture(entry->texture);
+      entry->texture.id = 0;
+    }
+    if (entry->texture.id == 0) {
+      entry->texture = LoadRenderTexture(width, height);
+    }
+
+    // Alpha is accumulated rather than blended so the cleared texture does
+    // not darken the glyph edges; the result is premultiplied.
+    BeginTextureMode(entry->texture);
+    ClearBackground(BLANK);
+    rlSetBlendFactorsSeparate(RL_SRC_ALPHA,
+                              RL_ONE_MINUS_SRC_ALPHA,
+                              RL_ONE,
+                              RL_ONE_MINUS_SRC_ALPHA,
+                              RL_FUNC_ADD,
+                              RL_FUNC_ADD);
+    BeginBlendMode(BLEND_CUSTOM_SEPARATE);
+    DrawTextEx(*cache->font,
+               text,
+               (Vector2){ TEXT_SHADOW_OFFSET, TEXT_SHADOW_OFFSET },
+               font_size,
+               TEXT_SPACING,
+               BLACK);
+    DrawTextEx(
+      *cache->font, text, (Vector2){ 0, 0 }, font_size, TEXT_SPACING, *color);
+    EndBlendMode();
+    EndTextureMode();
+
+    entry->color = *color;
+    entry->rendered = true;
+  }
+
+  return entry;
+}
+
+Vector2
+text_cache_measure(TextCache* cache,
+                   const char* key,
+                   const char* text,
+                   float font_size)
+{
+  TextCacheEntry* entry = text_cache_lookup(cache, key, text, font_size, NULL);
+  if (entry == NULL) {
+    return MeasureTextEx(*cache->font, text, font_size, TEXT_SPACING);
+  }
+  return entry->size;
+}
+
+void
+text_cache_draw(TextCache* cache,
+                const char* key,
+                const char* text,
+                Vector2 position,
+                float font_size,
+                Color color)
+{
+  TextCacheEntry* entry =
+    text_cache_lookup(cache, key, text, font_size, &color);
+
+  if (entry == NULL) {
+    DrawTextEx(*cache->font,
+               text,
+               (Vector2){ position.x + TEXT_SHADOW_OFFSET,
+                          position.y + TEXT_SHADOW_OFFSET },
+               font_size,
+               TEXT_SPACING,
+               BLACK);
+    DrawTextEx(*cache->font, text, position, font_size, TEXT_SPACING, color);
+    return;
+  }
+
+  RenderTexture2D* texture = &entry->texture;
+  Rectangle source = {
+    0, 0, texture->texture.width, -texture->texture.height
+  };
+
+  // whole pixels keep the cached glyphs from being resampled
+  BeginBlendMode(BLEND_ALPHA_PREMULTIPLY);
+  DrawTextureRec(texture->texture,
+                 source,
+                 (Vector2){ roundf(position.x), roundf(position.y) },
+                 WHITE);
+  EndBlendMode();
+}
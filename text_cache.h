@@ -0,0 +1,71 @@
+#ifndef __ME_TEXT_CACHE
+#define __ME_TEXT_CACHE
+
+#include <raylib.h>
+#include <stdint.h>
+
+#define TEXT_CACHE_CAPACITY 64
+#define TEXT_CACHE_MAX_LEN 64
+#define TEXT_SHADOW_OFFSET 1.5f
+#define TEXT_SPACING 1.0f
+
+/*
+ * One laid out string. The size is measured when the entry is created; the
+ * texture holds the string with its drop shadow and is rendered on first
+ * draw, so strings that are only measured never allocate one.
+ */
+typedef struct TextCacheEntry
+{
+  uint32_t hash;
+  uint32_t last_used;
+  char key[TEXT_CACHE_MAX_LEN];
+  char text[TEXT_CACHE_MAX_LEN];
+  float font_size;
+  Vector2 size;
+
+  bool rendered;
+  Color color;
+  RenderTexture2D texture; // premultiplied alpha, stored upside down
+} TextCacheEntry;
+
+/*
+ * Entries are found by key. Static strings are their own key; strings that
+ * change, such as scores, use a fixed key so a new value replaces the old
+ * entry instead of filling the cache. The least recently used entry is
+ * evicted when all slots are taken.
+ */
+typedef struct TextCache
+{
+  Font* font;
+  uint32_t tick;
+  int count;
+  TextCacheEntry entries[TEXT_CACHE_CAPACITY];
+
+  uint32_t hits;      // laid out and rendered, drawn as is
+  uint32_t misses;    // key not cached
+  uint32_t rebuilds;  // key cached with another string, size or color
+  uint32_t evictions; // entries dropped to make room
+  uint32_t uncached;  // strings too long to cache, drawn directly
+} TextCache;
+
+void
+text_cache_init(TextCache* cache, Font* font);
+
+void
+text_cache_destroy(TextCache* cache);
+
+Vector2
+text_cache_measure(TextCache* cache,
+                   const char* key,
+                   const char* text,
+                   float font_size);
+
+void
+text_cache_draw(TextCache* cache,
+                const char* key,
+                const char* text,
+                Vector2 position,
+                float font_size,
+                Color color);
+
+#endif // __ME_TEXT_CACHE
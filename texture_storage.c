@@ -1,11 +1,123 @@
 #include "texture_storage.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "profiler.h"
+
+static void*
+texture_storage_worker(void* arg)
+{
+  TextureWorker* worker = (TextureWorker*)arg;
+  prof_thread_name("texture");
+
+  while (atomic_load(worker->running)) {
+    uint64_t wakeups;
+    if (read(worker->wakefd, &wakeups, sizeof(wakeups)) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("read() texture wakefd failed");
+      break;
+    }
+
+    TextureJob job;
+    while (TextureJobRing_pop(&worker->jobs, &job)) {
+      ProfZone zone = prof_begin("texture_decode");
+      TraceLog(LOG_INFO, "Decoding texture %s", job.path);
+      Image image = LoadImage(job.path);
+
+      if (image.data != NULL && !Vector2Equals(job.size, Vector2Zero())) {
+        TraceLog(
+          LOG_INFO, "Resizing texture %s to %f, %f", job.path, job.size.x, job.size.y);
+        ImageResize(&image, (int)job.size.x, (int)job.size.y);
+      }
+
+      // one slot per texture type, so the ring never fills up
+      TextureDecoded decoded = { .type = job.type, .image = image };
+      TextureDecodedRing_push(&worker->decoded, &decoded);
+      prof_end(zone);
+    }
+  }
+
+  return NULL;
+}
+
+bool
+texture_storage_init(TextureStorage* storage)
+{
+  assert(storage != NULL);
+  for (int i = 0; i < TEXTURE_COUNT; i++) {
+    storage->data[i]->width = 0;
+    storage->data[i]->height = 0;
+    storage->data[i]->state = TEXTURE_EMPTY;
+  }
+
+  // magenta and black, hard to mistake for a real asset
+  Image checker = GenImageChecked(2, 2, 1, 1, MAGENTA, BLACK);
+  storage->placeholder = LoadTextureFromImage(checker);
+  UnloadImage(checker);
+
+  atomic_init(&storage->running, true);
+  storage->next_worker = 0;
+
+  int wanted = TEXTURE_DECODE_WORKERS;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cores >= 1 && cores < wanted) {
+    wanted = (int)cores;
+  }
+  storage->worker_count = 0;
+  while (storage->worker_count < wanted) {
+    TextureWorker* worker = &storage->workers[storage->worker_count];
+    TextureJobRing_init(&worker->jobs);
+    TextureDecodedRing_init(&worker->decoded);
+    worker->running = &storage->running;
+
+    worker->wakefd = eventfd(0, 0);
+    if (worker->wakefd == -1) {
+      break;
+    }
+    if (pthread_create(
+          &worker->thread, NULL, texture_storage_worker, worker) != 0) {
+      close(worker->wakefd);
+      break;
+    }
+    storage->worker_count++;
+  }
+
+  // one worker is enough to load everything, more only go faster
+  return storage->worker_count > 0;
+}
+
 void
 texture_storage_destroy(TextureStorage* storage)
 {
+  atomic_store(&storage->running, false);
+
+  for (int i = 0; i < storage->worker_count; i++) {
+    TextureWorker* worker = &storage->workers[i];
+    uint64_t one = 1;
+    if (write(worker->wakefd, &one, sizeof(one)) == -1) {
+      perror("write() texture wakefd failed");
+    }
+    pthread_join(worker->thread, NULL);
+    close(worker->wakefd);
+
+    TextureDecoded decoded;
+    while (TextureDecodedRing_pop(&worker->decoded, &decoded)) {
+      UnloadImage(decoded.image);
+    }
+  }
+
   for (int i = 0; i < TEXTURE_COUNT; i++) {
-    UnloadTexture(*storage->data[i]->texture);
+    if (storage->data[i]->state == TEXTURE_READY) {
+      UnloadTexture(*storage->data[i]->texture);
+    }
+    storage->data[i]->state = TEXTURE_EMPTY;
   }
+  UnloadTexture(storage->placeholder);
 }
 
 void
@@ -15,33 +127,88 @@ texture_storage_load(TextureStorage* storage,
                      Vector2 size)
 {
   assert(storage != NULL);
-  if (Vector2Equals(size, Vector2Zero())) {
-    Texture tex = LoadTexture(path);
-    *storage->data[type]->texture = tex;
+  TextureStorageEntry* entry = storage->data[type];
 
-    storage->data[type]->width = tex.width;
-    storage->data[type]->height = tex.height;
+  if (entry->state == TEXTURE_LOADING) {
+    TraceLog(LOG_WARNING, "Texture %d is already loading, %s ignored", type, path);
     return;
   }
+  if (strlen(path) >= TEXTURE_PATH_MAX) {
+    TraceLog(LOG_WARNING, "Texture path %s is too long", path);
+    entry->state = TEXTURE_FAILED;
+    return;
+  }
+
+  TextureJob job = { .type = type, .size = size };
+  strcpy(job.path, path);
+
+  // at most one job per entry is in flight, see the assert in the header
+  TextureWorker* worker = &storage->workers[storage->next_worker];
+  storage->next_worker = (storage->next_worker + 1) % storage->worker_count;
+  TextureJobRing_push(&worker->jobs, &job);
+  entry->state = TEXTURE_LOADING;
+
+  uint64_t one = 1;
+  if (write(worker->wakefd, &one, sizeof(one)) == -1) {
+    perror("write() texture wakefd failed");
+  }
+}
+
+void
+texture_storage_load_image(TextureStorage* storage,
+                           Image image,
+                           TEXTURE_TYPE type)
+{
+  assert(storage != NULL);
+  TextureStorageEntry* entry = storage->data[type];
+
+  if (entry->state == TEXTURE_READY) {
+    UnloadTexture(*entry->texture);
+  }
+  *entry->texture = LoadTextureFromImage(image);
+
+  entry->width = image.width;
+  entry->height = image.height;
+  entry->state = TEXTURE_READY;
+}
 
-  TraceLog(LOG_INFO, "Loading texture %s", path);
-  Image image = LoadImage(path);
+void
+texture_storage_update(TextureStorage* storage, double budget)
+{
+  double deadline = GetTime() + budget;
+  TextureDecoded decoded;
 
-  TraceLog(LOG_INFO, "Resizing texture %s to %f, %f", path, size.x, size.y);
-  ImageResize(&image, (int)size.x, (int)size.y);
+  for (int i = 0; i < storage->worker_count; i++) {
+    TextureWorker* worker = &storage->workers[i];
+    while (TextureDecodedRing_pop(&worker->decoded, &decoded)) {
+      TextureStorageEntry* entry = storage->data[decoded.type];
 
-  TraceLog(LOG_INFO, "Loading texture %s", path);
-  *storage->data[type]->texture = LoadTextureFromImage(image);
+      if (decoded.image.data == NULL) {
+        TraceLog(LOG_WARNING, "Texture %d failed to decode", decoded.type);
+        entry->state = TEXTURE_FAILED;
+      } else {
+        texture_storage_load_image(storage, decoded.image, decoded.type);
+        UnloadImage(decoded.image);
+      }
 
-  storage->data[type]->width = image.width;
-  storage->data[type]->height = image.height;
+      if (GetTime() >= deadline) {
+        return;
+      }
+    }
+  }
+}
 
-  TraceLog(LOG_INFO, "Unloading image %s", path);
-  UnloadImage(image);
+bool
+texture_storage_ready(TextureStorage* storage, TEXTURE_TYPE type)
+{
+  return storage->data[type]->state == TEXTURE_READY;
 }
 
 Texture2D*
 texture_storage_get(TextureStorage* storage, TEXTURE_TYPE type)
 {
+  if (storage->data[type]->state != TEXTURE_READY) {
+    return &storage->placeholder;
+  }
   return storage->data[type]->texture;
 }
@@ -1,11 +1,17 @@
 #ifndef __ME_TEX_STORAGE
 #define __ME_TEX_STORAGE
 
+#include <pthread.h>
 #include <raylib.h>
 #include <raymath.h>
 #include <string.h>
 
 #include "arena.h"
+#include "spsc.h"
+
+#define TEXTURE_PATH_MAX 256
+#define TEXTURE_QUEUE_CAPACITY 16
+#define TEXTURE_DECODE_WORKERS 4 // fewer on machines with fewer cores
 
 typedef enum TEXTURE_STORAGE
 {
@@ -22,28 +28,99 @@ typedef enum TEXTURE_STORAGE
   TEXTURE_COUNT,
 } TEXTURE_TYPE;
 
+_Static_assert(TEXTURE_COUNT <= TEXTURE_QUEUE_CAPACITY,
+               "every texture must fit the load queues at once");
+
+typedef enum
+{
+  TEXTURE_EMPTY,
+  TEXTURE_LOADING, // queued for decode or upload
+  TEXTURE_READY,
+  TEXTURE_FAILED,
+} TextureState;
+
 typedef struct TextureStorageEntry {
   Texture *texture;
   int32_t width;
   int32_t height;
+  TextureState state;
 } TextureStorageEntry;
 
+typedef struct TextureJob
+{
+  TEXTURE_TYPE type;
+  char path[TEXTURE_PATH_MAX];
+  Vector2 size;
+} TextureJob;
+
+typedef struct TextureDecoded
+{
+  TEXTURE_TYPE type;
+  Image image; // data is NULL when decoding failed
+} TextureDecoded;
+
+SPSC_RING(TextureJobRing, TextureJob, TEXTURE_QUEUE_CAPACITY)
+SPSC_RING(TextureDecodedRing, TextureDecoded, TEXTURE_QUEUE_CAPACITY)
+
+// One decode thread. Its rings have a single producer and a single
+// consumer each, so workers never share a queue.
+typedef struct TextureWorker
+{
+  TextureJobRing jobs;         // render loop -> worker
+  TextureDecodedRing decoded;  // worker -> render loop
+  pthread_t thread;
+  int wakefd;
+  atomic_bool* running;
+} TextureWorker;
+
+/*
+ * Textures load in two steps. Worker threads decode and resize images in
+ * parallel as texture_storage_load hands them out round robin, and
+ * texture_storage_update uploads the decoded ones on the render thread
+ * within a time budget per frame. Until an entry is ready
+ * texture_storage_get hands out a placeholder.
+ */
 typedef struct TextureStorage
 {
   TextureStorageEntry *data[TEXTURE_COUNT];
+  Texture placeholder;
+
+  TextureWorker workers[TEXTURE_DECODE_WORKERS];
+  int worker_count;
+  int next_worker; // receives the next job
+  atomic_bool running;
 } TextureStorage;
 
+bool
+texture_storage_init(TextureStorage* storage);
+
 void
 texture_storage_destroy(TextureStorage* storage);
 
+// Queues path for decoding; the entry turns ready in a later update.
 void
 texture_storage_load(TextureStorage* storage,
                      const char* path,
                      TEXTURE_TYPE type,
                      Vector2 size);
 
+// Uploads pixels that are already decoded, e.g. from the asset pack.
+void
+texture_storage_load_image(TextureStorage* storage,
+                           Image image,
+                           TEXTURE_TYPE type);
+
+/*
+ * Uploads decoded images until budget seconds have passed; at least one per
+ * call so loading always advances. Call once per frame on the render thread.
+ */
+void
+texture_storage_update(TextureStorage* storage, double budget);
+
+bool
+texture_storage_ready(TextureStorage* storage, TEXTURE_TYPE type);
 
 Texture2D*
 texture_storage_get(TextureStorage* storage, TEXTURE_TYPE type);
 
-#endif // __ME_TEX_STORAGE
\ No newline at end of file
+#endif // __ME_TEX_STORAGE
@@ -0,0 +1,187 @@
+package main
+
+import (
+	"sync"
+	"sync/atomic"
+	"time"
+)
+
+const (
+	WHEEL_BITS   = 6
+	WHEEL_SLOTS  = 1 << WHEEL_BITS
+	WHEEL_MASK   = WHEEL_SLOTS - 1
+	WHEEL_LEVELS = 4
+
+	DEFAULT_TIMEOUT_TICK = 250 * time.Millisecond
+)
+
+// Inactivity deadline of one seat. Owners move the deadline forward with
+// touch() under their own lock only; the wheel notices when the slot the
+// timer sits in comes due and re-slots it instead of firing.
+type Timer struct {
+	deadline atomic.Int64 // unix nanoseconds
+
+	expires    uint64 // tick the timer is slotted for
+	level      int
+	slot       int
+	prev, next *Timer
+	armed      bool
+
+	Game *GameState
+	Seat int
+}
+
+func (t *Timer) touch(deadline time.Time) {
+	t.deadline.Store(deadline.UnixNano())
+}
+
+// Hierarchical timing wheel, WHEEL_LEVELS levels of WHEEL_SLOTS slots, level
+// n spanning WHEEL_SLOTS^(n+1) ticks. Arm, cancel and each tick cost O(1)
+// plus the timers that come due; live games that keep moving are never
+// visited until their old deadline slot is reached.
+//
+// mu is a leaf lock, nothing else is acquired while it is held.
+type TimerWheel struct {
+	mu     sync.Mutex
+	tick   time.Duration
+	start  time.Time
+	now    uint64
+	levels [WHEEL_LEVELS][WHEEL_SLOTS]*Timer
+}
+
+func newTimerWheel(tick time.Duration) *TimerWheel {
+	return &TimerWheel{tick: tick, start: time.Now()}
+}
+
+func (w *TimerWheel) tickOf(deadline int64) uint64 {
+	d := time.Duration(deadline - w.start.UnixNano())
+	if d <= 0 {
+		return 0
+	}
+	// round up so a timer never fires before its deadline
+	return uint64((d + w.tick - 1) / w.tick)
+}
+
+// Slots t no earlier than tick earliest. Must be called with w.mu held.
+func (w *TimerWheel) insert(t *Timer, earliest uint64) {
+	expires := w.tickOf(t.deadline.Load())
+	if expires < earliest {
+		expires = earliest
+	}
+
+	level := 0
+	for diff := expires - w.now; level < WHEEL_LEVELS-1 && diff >= WHEEL_SLOTS<<(WHEEL_BITS*level); {
+		level++
+	}
+	max := w.now + (WHEEL_SLOTS << (WHEEL_BITS * level)) - 1
+	if expires > max {
+		// beyond the top level, park it at the furthest slot and re-slot later
+		expires = max
+	}
+
+	t.expires = expires
+	t.level = level
+	t.slot = int(expires>>(WHEEL_BITS*level)) & WHEEL_MASK
+	t.prev = nil
+	t.next = w.levels[level][t.slot]
+	if t.next != nil {
+		t.next.prev = t
+	}
+	w.levels[level][t.slot] = t
+	t.armed = true
+}
+
+// Must be called with w.mu held.
+func (w *TimerWheel) unlink(t *Timer) {
+	if t.prev != nil {
+		t.prev.next = t.next
+	} else {
+		w.levels[t.level][t.slot] = t.next
+	}
+	if t.next != nil {
+		t.next.prev = t.prev
+	}
+	t.prev, t.next = nil, nil
+	t.armed = false
+}
+
+func (w *TimerWheel) arm(t *Timer, deadline time.Time) {
+	t.touch(deadline)
+	w.mu.Lock()
+	if t.armed {
+		w.unlink(t)
+	}
+	w.insert(t, w.now+1)
+	w.mu.Unlock()
+}
+
+func (w *TimerWheel) cancel(t *Timer) {
+	w.mu.Lock()
+	if t.armed {
+		w.unlink(t)
+	}
+	w.mu.Unlock()
+}
+
+// Moves the wheel forward to the current time and appends every timer whose
+// deadline has really passed to fired. Timers that were touched since they
+// were slotted are re-inserted at their new deadline.
+func (w *TimerWheel) advance(now time.Time, fired []*Timer) []*Timer {
+	w.mu.Lock()
+	defer w.mu.Unlock()
+
+	target := uint64(now.Sub(w.start) / w.tick)
+	nowNanos := now.UnixNano()
+
+	for w.now < target {
+		w.now++
+
+		// pull the next upper-level slot down whenever a level wraps; timers
+		// due on this very tick land in the level 0 slot handled below
+		for level := 1; level < WHEEL_LEVELS; level++ {
+			if w.now&(uint64(1)<<(WHEEL_BITS*level)-1) != 0 {
+				break
+			}
+			slot := int(w.now>>(WHEEL_BITS*level)) & WHEEL_MASK
+			t := w.levels[level][slot]
+			w.levels[level][slot] = nil
+			for t != nil {
+				next := t.next
+				t.armed = false
+				w.insert(t, w.now)
+				t = next
+			}
+		}
+
+		slot := int(w.now & WHEEL_MASK)
+		t := w.levels[0][slot]
+		w.levels[0][slot] = nil
+		for t != nil {
+			next := t.next
+			t.prev, t.next = nil, nil
+			t.armed = false
+			if t.deadline.Load() <= nowNanos {
+				fired = append(fired, t)
+			} else {
+				w.insert(t, w.now+1)
+			}
+			t = next
+		}
+	}
+
+	return fired
+}
+
+// Calls expire with the batch of timers that came due on each tick.
+func (w *TimerWheel) run(expire func(fired []*Timer)) {
+	ticker := time.NewTicker(w.tick)
+	defer ticker.Stop()
+
+	var fired []*Timer
+	for now := range ticker.C {
+		fired = w.advance(now, fired[:0])
+		if len(fired) > 0 {
+			expire(fired)
+		}
+	}
+}
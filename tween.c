@@ -0,0 +1,104 @@
+#include "tween.h"
+
+static const float ease_coefficients[EASE_COUNT][2] = {
+  [EASE_LINEAR] = { 1.0f, 0.0f },
+  [EASE_IN_QUAD] = { 0.0f, 1.0f },
+  [EASE_OUT_QUAD] = { 2.0f, -1.0f },
+};
+
+void
+tween_clear(TweenSystem* tweens)
+{
+  tweens->count = 0;
+}
+
+static int
+tween_find(const TweenSystem* tweens, const float* target)
+{
+  for (int i = 0; i < tweens->count; i++) {
+    if (tweens->target[i] == target) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void
+tween_remove(TweenSystem* tweens, int i)
+{
+  int last = --tweens->count;
+  tweens->target[i] = tweens->target[last];
+  tweens->from[i] = tweens->from[last];
+  tweens->span[i] = tweens->span[last];
+  tweens->elapsed[i] = tweens->elapsed[last];
+  tweens->delay[i] = tweens->delay[last];
+  tweens->inv_duration[i] = tweens->inv_duration[last];
+  tweens->ease_a[i] = tweens->ease_a[last];
+  tweens->ease_b[i] = tweens->ease_b[last];
+}
+
+bool
+tween_start(TweenSystem* tweens,
+            float* target,
+            float from,
+            float to,
+            float duration,
+            float delay,
+            Easing easing)
+{
+  int i = tween_find(tweens, target);
+  if (i < 0) {
+    if (tweens->count == TWEEN_CAPACITY) {
+      *target = to;
+      return false;
+    }
+    i = tweens->count++;
+  }
+
+  tweens->target[i] = target;
+  tweens->from[i] = from;
+  tweens->span[i] = to - from;
+  tweens->elapsed[i] = 0.0f;
+  tweens->delay[i] = delay;
+  tweens->inv_duration[i] = duration > 0.0f ? 1.0f / duration : 1e9f;
+  tweens->ease_a[i] = ease_coefficients[easing][0];
+  tweens->ease_b[i] = ease_coefficients[easing][1];
+
+  *target = from;
+  return true;
+}
+
+bool
+tween_running(const TweenSystem* tweens, const float* target)
+{
+  return tween_find(tweens, target) >= 0;
+}
+
+void
+tween_update(TweenSystem* tweens, float delta_time)
+{
+  int count = tweens->count;
+
+  // straight-line float math over the arrays, vectorizes as is
+  for (int i = 0; i < count; i++) {
+    float elapsed = tweens->elapsed[i] + delta_time;
+    float t = (elapsed - tweens->delay[i]) * tweens->inv_duration[i];
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+
+    tweens->elapsed[i] = elapsed;
+    tweens->value[i] =
+      tweens->from[i] +
+      tweens->span[i] * (tweens->ease_a[i] * t + tweens->ease_b[i] * t * t);
+  }
+
+  for (int i = 0; i < count; i++) {
+    *tweens->target[i] = tweens->value[i];
+  }
+
+  // finished tweens already wrote their end value above
+  for (int i = tweens->count - 1; i >= 0; i--) {
+    if ((tweens->elapsed[i] - tweens->delay[i]) * tweens->inv_duration[i] >= 1.0f) {
+      tween_remove(tweens, i);
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef __ME_TWEEN
+#define __ME_TWEEN
+
+#include <stdbool.h>
+
+#define TWEEN_CAPACITY 1024
+
+/*
+ * Easings are the quadratics a*t + b*t^2, so every tween eases with the
+ * same arithmetic and the update loop needs no branch per easing.
+ */
+typedef enum
+{
+  EASE_LINEAR,   // t
+  EASE_IN_QUAD,  // t^2, speeds up like a falling gem
+  EASE_OUT_QUAD, // 2t - t^2, slows down towards the end
+  EASE_COUNT
+} Easing;
+
+/*
+ * Active tweens only, as parallel arrays so the easing pass runs over plain
+ * floats. Each tween drives one float owned by the caller from `from` to
+ * `from + span` after its own delay; finished tweens leave the value at its
+ * end point and are removed by moving the last tween into their slot.
+ */
+typedef struct TweenSystem
+{
+  int count;
+  float* target[TWEEN_CAPACITY];
+  float from[TWEEN_CAPACITY];
+  float span[TWEEN_CAPACITY];
+  float elapsed[TWEEN_CAPACITY]; // includes the delay
+  float delay[TWEEN_CAPACITY];
+  float inv_duration[TWEEN_CAPACITY];
+  float ease_a[TWEEN_CAPACITY];
+  float ease_b[TWEEN_CAPACITY];
+  float value[TWEEN_CAPACITY];
+} TweenSystem;
+
+void
+tween_clear(TweenSystem* tweens);
+
+/*
+ * Animates *target, replacing any tween already driving it. *target is set
+ * to from right away. Returns false when the system is full, in which case
+ * *target jumps to to.
+ */
+bool
+tween_start(TweenSystem* tweens,
+            float* target,
+            float from,
+            float to,
+            float duration,
+            float delay,
+            Easing easing);
+
+bool
+tween_running(const TweenSystem* tweens, const float* target);
+
+void
+tween_update(TweenSystem* tweens, float delta_time);
+
+#endif // __ME_TWEEN
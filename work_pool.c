@@ -0,0 +1,224 @@
+#include "work_pool.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#define WORK_RANGE(begin, end) ((uint64_t)(begin) | (uint64_t)(end) << 32)
+#define WORK_BEGIN(range) ((uint32_t)(range))
+#define WORK_END(range) ((uint32_t)((range) >> 32))
+
+uint64_t
+work_pool_now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Front iteration of the slice, -1 once it is empty.
+static int
+work_take(WorkSlice* slice)
+{
+  uint64_t range = atomic_load_explicit(&slice->range, memory_order_relaxed);
+  while (WORK_BEGIN(range) < WORK_END(range)) {
+    if (atomic_compare_exchange_weak_explicit(
+          &slice->range,
+          &range,
+          WORK_RANGE(WORK_BEGIN(range) + 1, WORK_END(range)),
+          memory_order_relaxed,
+          memory_order_relaxed)) {
+      return (int)WORK_BEGIN(range);
+    }
+  }
+  return -1;
+}
+
+// Moves the back half of the largest other slice into self's, which is
+// empty. False when there is nothing left anywhere.
+static bool
+work_steal(WorkPool* pool, int self)
+{
+  for (;;) {
+    int victim = -1;
+    uint64_t range = 0;
+    uint32_t largest = 0;
+
+    for (int i = 0; i < pool->threads; i++) {
+      uint64_t r = atomic_load_explicit(&pool->slices[i].range, memory_order_relaxed);
+      uint32_t left = WORK_END(r) - WORK_BEGIN(r);
+      if (i != self && WORK_BEGIN(r) < WORK_END(r) && left > largest) {
+        victim = i;
+        range = r;
+        largest = left;
+      }
+    }
+    if (victim < 0) {
+      return false;
+    }
+
+    uint32_t mid = WORK_BEGIN(range) + largest / 2;
+    if (atomic_compare_exchange_strong_explicit(&pool->slices[victim].range,
+                                                &range,
+                                                WORK_RANGE(WORK_BEGIN(range), mid),
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+      atomic_store_explicit(&pool->slices[self].range,
+                            WORK_RANGE(mid, WORK_END(range)),
+                            memory_order_relaxed);
+      return true;
+    }
+  }
+}
+
+static void
+work_loop(WorkPool* pool, int self)
+{
+  int completed = 0;
+  for (;;) {
+    if (pool->deadline_ns != 0 && work_pool_now_ns() >= pool->deadline_ns) {
+      break;
+    }
+    int index = work_take(&pool->slices[self]);
+    if (index < 0) {
+      if (!work_steal(pool, self)) {
+        break;
+      }
+      continue;
+    }
+    pool->fn(pool->user, index);
+    completed++;
+  }
+  atomic_fetch_add_explicit(&pool->completed, completed, memory_order_relaxed);
+}
+
+static void*
+work_pool_worker(void* arg)
+{
+  WorkPool* pool = (WorkPool*)arg;
+
+  pthread_mutex_lock(&pool->lock);
+  // the caller is participant 0, workers take the following slices
+  int self = ++pool->busy;
+  pthread_cond_signal(&pool->done);
+  uint64_t seen = pool->generation;
+
+  for (;;) {
+    while (!pool->stop && pool->generation == seen) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->stop) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    work_loop(pool, self);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->busy == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+bool
+work_pool_init(WorkPool* pool, int threads)
+{
+  if (threads <= 0) {
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+  if (threads > WORK_POOL_MAX_THREADS) {
+    threads = WORK_POOL_MAX_THREADS;
+  }
+
+  pool->threads = 1;
+  pool->generation = 0;
+  pool->busy = 0;
+  pool->stop = false;
+  for (int i = 0; i < WORK_POOL_MAX_THREADS; i++) {
+    atomic_init(&pool->slices[i].range, 0);
+  }
+  atomic_init(&pool->completed, 0);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (int i = 1; i < threads; i++) {
+    if (pthread_create(&pool->workers[i], NULL, work_pool_worker, pool) != 0) {
+      break;
+    }
+    pool->threads++;
+  }
+
+  // wait until every worker has its index, so none misses the first run
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy != pool->threads - 1) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pool->busy = 0;
+  pthread_mutex_unlock(&pool->lock);
+  return true;
+}
+
+void
+work_pool_destroy(WorkPool* pool)
+{
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 1; i < pool->threads; i++) {
+    pthread_join(pool->workers[i], NULL);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+}
+
+int
+work_pool_run(WorkPool* pool,
+              int count,
+              WorkFn fn,
+              void* user,
+              uint64_t deadline_ns)
+{
+  if (count <= 0) {
+    return 0;
+  }
+
+  pool->fn = fn;
+  pool->user = user;
+  pool->deadline_ns = deadline_ns;
+  atomic_store_explicit(&pool->completed, 0, memory_order_relaxed);
+
+  for (int i = 0; i < pool->threads; i++) {
+    uint32_t begin = (uint32_t)((int64_t)count * i / pool->threads);
+    uint32_t end = (uint32_t)((int64_t)count * (i + 1) / pool->threads);
+    atomic_store_explicit(
+      &pool->slices[i].range, WORK_RANGE(begin, end), memory_order_relaxed);
+  }
+
+  // the mutex publishes the slices and fn to the workers
+  pthread_mutex_lock(&pool->lock);
+  pool->busy = pool->threads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  work_loop(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->busy > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return atomic_load_explicit(&pool->completed, memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+#ifndef __ME_WORK_POOL
+#define __ME_WORK_POOL
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Worker threads that run the iterations of a parallel loop.
+ *
+ *   work_pool_run(&pool, count, fn, user, deadline_ns);
+ *
+ * calls fn(user, i) for every i in [0, count) on the workers and the
+ * calling thread. Every participant starts with an equal slice of the
+ * iterations and takes from its front; one that runs dry steals the back
+ * half of the largest remaining slice. A slice is one atomic word holding
+ * both ends, so taking and stealing are a compare-and-swap each.
+ */
+#define WORK_POOL_MAX_THREADS 16
+
+typedef void (*WorkFn)(void* user, int index);
+
+typedef struct WorkSlice
+{
+  alignas(64) atomic_uint_fast64_t range; // begin | end << 32
+} WorkSlice;
+
+typedef struct WorkPool
+{
+  int threads; // workers plus the calling thread
+  pthread_t workers[WORK_POOL_MAX_THREADS];
+  WorkSlice slices[WORK_POOL_MAX_THREADS];
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  uint64_t generation; // bumped for every run
+  int busy;            // workers still in the current run
+  bool stop;
+
+  WorkFn fn;
+  void* user;
+  uint64_t deadline_ns;
+  atomic_int completed;
+} WorkPool;
+
+// threads <= 0 uses one per online CPU, the caller counting as one.
+bool
+work_pool_init(WorkPool* pool, int threads);
+
+void
+work_pool_destroy(WorkPool* pool);
+
+/*
+ * Runs the loop and returns how many iterations ran. No iteration starts
+ * once CLOCK_MONOTONIC passes deadline_ns (0 for none), so fn must record
+ * which indices it saw. Not reentrant; one run at a time.
+ */
+int
+work_pool_run(WorkPool* pool,
+              int count,
+              WorkFn fn,
+              void* user,
+              uint64_t deadline_ns);
+
+uint64_t
+work_pool_now_ns();
+
+#endif // __ME_WORK_POOL